@@ -0,0 +1,81 @@
+#pragma once
+
+#include <afs/fs.h>
+#include <afs/threadPool.h>
+#include <afs/constants.h>
+
+#include <string>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+
+constexpr unsigned int MAX_BATCHED_WRITES = 64; // writes of a batch before the next writes wait for it to end
+
+/**
+ * Runs the operations of a file system on a worker pool and returns futures of
+ * their results. The operations on the same file run in the order they were
+ * submitted, one after the other; a worker runs all the operations queued on a
+ * file at once. A file is known by its inode, so renames keep the order, a file
+ * that does not exist yet by its path. The inode of a path is looked up by a
+ * worker, and the path keeps it while any of its operations is queued, so a
+ * delete and a create of the same path stay in one queue. Reads of different
+ * files run in parallel, writes one at a time. Writes that run at the same time
+ * are batched, see FileSystem::beginWriteBatch. Errors are thrown by the get() of
+ * the future.
+ */
+class AsyncFileSystem
+{
+private:
+    struct queuedOperation
+    {
+        std::string path; // the normalized path it was submitted on
+        std::function<void()> run;
+    };
+
+    struct fileQueue
+    {
+        std::deque<queuedOperation> operations;
+        bool busy = false; // a worker runs the operations of the file
+    };
+
+    struct pathAlias
+    {
+        std::string key;                        // the queue of the path, empty until a worker looks it up
+        std::deque<queuedOperation> unresolved; // submitted before the key was known
+        unsigned int operations = 0;            // queued or running, the alias is dropped at 0
+    };
+
+    FileSystem* m_fs;
+    ThreadPool m_pool;
+    std::mutex m_lock; // the queues of the files
+    std::unordered_map<std::string, fileQueue> m_queues; // by "#<inode>", or by path for a file that does not exist
+    std::unordered_map<std::string, pathAlias> m_aliases; // the queue of every path with queued operations
+
+    std::mutex m_batchLock;
+    std::condition_variable m_batchEnded;
+    unsigned int m_batchWrites;  // writes that joined the open batch, 0 when none is open
+    unsigned int m_activeWrites; // writes of the batch that did not finish yet
+
+    template <typename T>
+    std::future<T> submit(const std::string& path, std::function<T()> operation);
+    void enqueue(const std::string& path, std::function<void()> operation);
+    void resolvePath(const std::string& path);
+    void scheduleQueue(const std::string& key, fileQueue& queue);
+    void runQueue(const std::string& key);
+    void runBatched(const std::function<void()>& write);
+    void leaveBatch();
+
+public:
+    explicit AsyncFileSystem(FileSystem* fs, const unsigned int threads = 0);
+    ~AsyncFileSystem();
+
+    std::future<void> createFile(const std::string& path, const bool isDir = false);
+    std::future<void> appendContent(const std::string& filePath, std::string content);
+    std::future<void> deleteFile(const std::string& filePath);
+    std::future<std::string> getContent(const std::string& filePath);
+    std::future<dirList> listDir(const std::string& dirPath);
+    void wait();
+};
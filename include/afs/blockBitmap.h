@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <cstdint>
+
+constexpr uint32_t BITMAP_PAGE_BLOCKS = 32768; // blocks of a page of a block bitmap, 4 KB of bits
+
+/**
+ * One bit for every block of a disk, all clear at first. The pages of the bits are
+ * allocated the first time one of their bits is set, so a bitmap of a disk costs
+ * memory only for the regions that are used. Bits are tested and changed without
+ * a lock, by any amount of threads.
+ */
+class BlockBitmap
+{
+private:
+    uint32_t m_pages;
+    std::unique_ptr<std::atomic<std::atomic<uint64_t>*>[]> m_map;
+
+    std::atomic<uint64_t>* getPage(const uint32_t blockNum);
+
+public:
+    explicit BlockBitmap(const uint32_t nblocks);
+    ~BlockBitmap();
+
+    BlockBitmap(const BlockBitmap&) = delete;
+    BlockBitmap& operator=(const BlockBitmap&) = delete;
+
+    bool test(const uint32_t blockNum) const;
+    void set(const uint32_t blockNum);
+    void reset(const uint32_t blockNum);
+};
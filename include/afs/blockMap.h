@@ -0,0 +1,43 @@
+#pragma once
+
+#include <afs/disk.h>
+#include <afs/blocksTable.h>
+#include <afs/constants.h>
+
+#include <vector>
+
+#include <cstdint>
+
+/**
+ * Maps the logical blocks of a file to data blocks on the disk.
+ * The map is a chain of blocks, each one holds the addresses of the next data
+ * blocks of the file and the address of the next map block at its end.
+ * An entry of 0 means the logical block has no data block.
+ */
+class BlockMap
+{
+private:
+    Disk* m_disk;
+    BlocksTable* m_dblocksTable;
+    address m_firstAddr;
+
+    // last visited map block, so sequential access does not walk the chain again
+    uint32_t m_cursorIndex;
+    address m_cursorAddr;
+
+    uint32_t getEntriesPerBlock() const;
+    address getMapBlock(const uint32_t mapIndex, const bool create);
+
+public:
+    BlockMap(Disk* disk, BlocksTable* dblocksTable, const address firstAddr);
+
+    address getFirstAddr() const { return m_firstAddr; }
+
+    address get(const uint32_t blockIndex);
+    void set(const uint32_t blockIndex, const address dataAddr);
+    address clone(std::vector<unsigned int>& dataBlocks) const;
+    uint32_t countBlocks() const;
+    void release();
+    void punch(const uint32_t firstIndex, const uint32_t lastIndex);
+    void truncate(const uint32_t blocksAmount);
+};
@@ -4,23 +4,56 @@
 
 #include <afs/disk.h>
 #include <afs/constants.h>
+#include <afs/refCountTable.h>
 
+#include <vector>
+
+class SnapshotTable;
+
+/**
+ * Keeps a byte for every block of the disk, set while the block is in use.
+ * The table is used in place in the mapping of the disk, a table block is only
+ * touched (and its checksum verified) the first time an allocation reaches it.
+ * The free blocks are counted in the header and, for every block of the table,
+ * in the summary area so full parts of the table are skipped.
+ */
 class BlocksTable
 {
 private:
     Disk* m_disk;
-    bool* m_table;
+    struct afsHeader* m_header;
+    const unsigned char* m_table;
     int m_dblocksTableAmount;
+    RefCountTable* m_refCounts;
+    SnapshotTable* m_snapshots;
+
+    mutable std::vector<bool> m_loadedBlocks;
+    mutable unsigned int m_cursor; // the next search for a free block starts here
+
+    unsigned int getEntriesAmount() const;
+    void loadTableBlock(const unsigned int index) const;
+    unsigned int findFreeBlock(const unsigned int from, const unsigned int to) const;
+    void setEntry(const unsigned int blockNum, const unsigned char used);
+    uint32_t getRegionFreeBlocks(const unsigned int index) const;
+    void setRegionFreeBlocks(const unsigned int index, const uint32_t freeBlocks);
 
 public:
-    BlocksTable(Disk* disk, const bool isNew = false);
-    ~BlocksTable();
+    BlocksTable(Disk* disk, struct afsHeader* header);
 
     int getTableBlocksAmount() const;
+    uint32_t getSummaryBlocksAmount() const;
+    void formatSummary();
     unsigned int getFreeBlock() const;
+    unsigned int getFreeBlocks(const unsigned int amount, const unsigned int from = 0) const;
+    bool isReserved(const unsigned int blockNum) const;
+
+    void setRefCounts(RefCountTable* refCounts) { m_refCounts = refCounts; }
+    void setSnapshots(SnapshotTable* snapshots) { m_snapshots = snapshots; }
 
     void reserveDBlock(const unsigned int blockNum);
+    void reserveDBlocks(const unsigned int firstBlock, const unsigned int amount);
     void freeDBlock(const unsigned int blockNum);
+    void freeDBlocks(std::vector<unsigned int> blocks);
 
     void freeAllFileBlocks(const address fileAddress);
-};
\ No newline at end of file
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <afs/disk.h>
+#include <afs/threadPool.h>
+#include <afs/constants.h>
+#include <afs/fsStructs.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#include <cstdint>
+
+constexpr size_t MAX_REPORTED_ERRORS = 1000; // errors kept in the report, the rest are only counted
+
+typedef struct fsckReport
+{
+    uint32_t directories;
+    uint32_t files;
+    uint32_t orphans;        // deleted inodes waiting for their blocks to be reclaimed
+    uint32_t usedBlocks;     // blocks reachable from the header and the directory tree
+    uint32_t leakedBlocks;   // blocks reserved in the blocks table that nothing uses
+    uint32_t badChecksums;   // blocks that do not match their checksum
+    uint64_t errorsAmount;   // every inconsistency found
+    uint64_t unrepaired;     // inconsistencies a repair can not fix
+    bool repaired;
+    std::vector<std::string> errors;
+} fsckReport;
+
+/**
+ * Offline consistency checker. It walks the directory tree from the root with a
+ * work-stealing thread pool, traces every block chain and block map, and compares
+ * the blocks and inodes it reached with the blocks table, the reference counts,
+ * the fragment map and the header. A repair rebuilds them from what was reached.
+ */
+class Checker
+{
+private:
+    Disk* m_disk;
+    struct afsHeader* m_header;
+    ThreadPool m_pool;
+
+    uint32_t m_tableBlocks;
+    uint32_t m_inodesCapacity;
+    std::vector<address> m_inodeTable; // blocks of the inode table, from its block map
+    std::unique_ptr<std::atomic<uint32_t>[]> m_blockRefs;
+    std::vector<bool> m_metadata;
+    std::unique_ptr<std::atomic<uint8_t>[]> m_inodeLinks;
+
+    // fragment blocks of the fragment map and the fragments the files use in them
+    std::vector<fragMapEntry> m_fragEntries;
+    std::vector<address> m_fragMapBlocks;
+    std::unordered_map<address, size_t> m_fragIndex;
+    std::unique_ptr<std::atomic<uint16_t>[]> m_fragUsed;
+
+    // name fingerprints of directory entries that do not match their names, with the right value
+    std::vector<std::pair<address, uint8_t>> m_badFingerprints;
+
+    std::atomic<uint32_t> m_directories;
+    std::atomic<uint32_t> m_files;
+    std::mutex m_reportLock;
+    fsckReport m_report;
+
+    void addError(const std::string& error, const bool repairable);
+
+    address inodeIndexToAddr(const uint32_t inodeIndex) const;
+    inode readInode(const uint32_t inodeIndex) const;
+    bool isBlockAddr(const address addr) const;
+
+    void markBlock(const address addr, const std::string& owner);
+    void markRegion(const address firstAddr, const uint32_t blocksAmount, const std::string& owner);
+    std::vector<address> readChain(const address firstAddr, const std::string& owner);
+
+    void loadInodeTable();
+    void loadFragmentMap();
+    void checkSnapshots();
+    void checkOrphans();
+    void checkDirectory(const uint32_t inodeIndex, const uint32_t parentIndex);
+    void checkFile(const uint32_t inodeIndex, const inode& fileInode);
+    void checkTail(const uint32_t inodeIndex, const inode& fileInode);
+    void checkChecksums();
+
+    void compareFingerprints(const bool repair);
+    void compareFragments(const bool repair);
+    void compareDedupIndex(const bool repair);
+    void compareBlocks(const bool repair);
+    void compareInodes(const bool repair);
+
+public:
+    Checker(const char* filePath, const unsigned int threads = 0);
+    ~Checker();
+
+    fsckReport check(const bool repair, const bool verifyChecksums = false);
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+
+class Compressor
+{
+public:
+    static size_t compress(const char* src, const size_t srcSize, char* dst, const size_t dstCapacity);
+    static bool decompress(const char* src, const size_t srcSize, char* dst, const size_t dstSize);
+};
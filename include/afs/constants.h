@@ -8,34 +8,91 @@
 
 typedef std::vector<std::string> afsPath;
 
-typedef uint16_t directoryData;
-typedef uint32_t address;
+typedef uint32_t directoryData; // amount of entries at the start of a directory
+typedef uint64_t address; // byte offset on the disk
 constexpr char MAGIC[] = "AFS";
-constexpr uint8_t CURR_VERSION = 0x01;
+constexpr uint8_t CURR_VERSION = 0x0D;
 
 constexpr uint32_t MIN_SIZE = 512;
 constexpr uint32_t MIN_BLOCKS_AMOUNT = 512;
 constexpr int NAME_MAX_LEN = 28;
+constexpr uint32_t FRAGMENTS_PER_BLOCK = 16; // sub-block fragments in a tail-packing block
+constexpr uint32_t TAIL_MAX_FRAGMENTS = 12;  // bigger tails get a block of their own
+constexpr uint32_t COMPRESSION_CHUNK_BLOCKS = 8; // blocks of content compressed together
+constexpr uint32_t DEFRAG_STEP_BLOCKS = 256; // blocks of a file the defragmenter moves to one run at a time
+
+enum FeatureFlags
+{
+    FEATURE_DEDUP = 1 << 0
+};
 typedef struct dirListEntry
 {
-    dirListEntry(char* fileName, uint32_t size, bool isDir):
+    dirListEntry(char* fileName, uint64_t size, bool isDir):
         fileSize(size), isDirectory(isDir)
     {
         strncpy(name, fileName, NAME_MAX_LEN);
     }
     char name[NAME_MAX_LEN];
-    uint32_t fileSize;
+    uint64_t fileSize;
     bool isDirectory;
 } dirListEntry;
 
 typedef std::vector<dirListEntry> dirList;
 
+typedef struct fsStats
+{
+    uint32_t blockSize;
+    uint32_t totalBlocks; // blocks the blocks table can allocate
+    uint32_t freeBlocks;
+    uint32_t totalInodes; // inodes of the inode table, it grows when all of them are used
+    uint32_t freeInodes;
+} fsStats;
+
+typedef struct fragmentationInfo
+{
+    uint32_t blocks; // data blocks of the file, shared blocks and holes are not counted
+    uint32_t runs;   // runs of contiguous blocks they are stored in
+} fragmentationInfo;
+
+typedef struct snapshotInfo
+{
+    std::string name;
+    uint32_t generation;
+    int64_t createdAt;
+    uint32_t blocks;  // blocks holding content the live disk overwrote since the snapshot
+    bool deleted;     // waiting to be reclaimed
+} snapshotInfo;
+
 struct __attribute__((__packed__)) afsHeader
 {
     char magic[3];
     uint8_t version;
     uint32_t blockSize;
     uint32_t nblocks;
-    uint16_t inodes;
-    uint16_t inodeBlocks;
+    uint32_t inodes; // inodes in use
+    uint32_t inodeBlocks; // blocks of the inode table, it grows by one when no inode is free
+    address inodeMapAddr; // block map of the inode table (0 until the first inode is created)
+    address fragMapAddr; // first block of the fragment map (0 if not created yet)
+    uint32_t features; // FeatureFlags enabled on the disk
+    address refTableAddr; // block reference counts (0 if not created yet)
+    address dedupIndexAddr; // fingerprints of deduplicated blocks (0 if not created yet)
+    address checksumAddr; // CRC32C of every block
+    uint32_t freeBlocks; // blocks of the blocks table that are not reserved
+    uint32_t freeInodes; // inodes that can still be created
+    address summaryAddr; // free blocks of every block of the blocks table
+    uint32_t orphanHead; // first deleted inode whose blocks were not reclaimed yet (NO_ORPHAN if none)
+    address generationsAddr; // snapshot generation of every block (0 if no snapshot was taken yet)
+    address snapshotsAddr; // records of the snapshots (0 if no snapshot was taken yet)
+    uint32_t generation; // generation of the live disk, a snapshot starts a new one
 };
+
+// write sequence of the disk in the header block, odd while a write is in progress.
+// It is left out of the checksum of the block, read-only mounts retry the reads it changed under
+constexpr address SEQUENCE_ADDR = 256;
+static_assert(sizeof(struct afsHeader) <= SEQUENCE_ADDR && SEQUENCE_ADDR + sizeof(uint64_t) <= MIN_SIZE, "the sequence is in the header block");
+
+// blocks changed in the open write section, after the sequence: their amount, then their numbers.
+// They get their checksums when the section ends, the next writer after a crash calculates only theirs.
+// The list is left out of the checksum of the header block too
+constexpr address DIRTY_LIST_ADDR = SEQUENCE_ADDR + sizeof(uint64_t);
+static_assert(DIRTY_LIST_ADDR + 2 * sizeof(uint32_t) <= MIN_SIZE, "the dirty list is in the header block");
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class Crc32c
+{
+private:
+    static uint32_t computeTable(uint32_t crc, const char* data, size_t size);
+    static uint32_t computeHardware(uint32_t crc, const char* data, size_t size);
+
+public:
+    static uint32_t compute(const char* data, const size_t size, const uint32_t crc = 0);
+    static bool isHardwareAccelerated();
+};
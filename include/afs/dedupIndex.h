@@ -0,0 +1,34 @@
+#pragma once
+
+#include <afs/disk.h>
+#include <afs/constants.h>
+#include <afs/fsStructs.h>
+
+#include <cstdint>
+
+/**
+ * Persistent hash table from the fingerprint of a full data block to the block
+ * holding that content, used to share identical blocks between files.
+ * The table uses linear probing and its capacity is twice the amount of blocks.
+ */
+class DedupIndex
+{
+private:
+    Disk* m_disk;
+    address m_indexAddr;
+    uint32_t m_capacity;
+
+    dedupEntry readEntry(const uint32_t slot) const;
+    void writeEntry(const uint32_t slot, const dedupEntry& entry);
+
+public:
+    DedupIndex(Disk* disk, const address indexAddr);
+
+    static uint32_t getCapacity(const Disk* disk);
+    static uint32_t getIndexBlocksAmount(const Disk* disk);
+    static uint64_t fingerprint(const char* data, const size_t size);
+
+    address find(const char* data, const uint64_t fingerprint) const;
+    void insert(const uint64_t fingerprint, const address blockAddr);
+    void remove(const uint64_t fingerprint, const address blockAddr);
+};
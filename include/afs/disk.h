@@ -1,26 +1,128 @@
 #pragma once
 
+#include <afs/blockBitmap.h>
+
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <vector>
+
 #include <cstdlib>
 #include <cstdint>
 
+class SnapshotTable;
+class StripeSet;
+
+// how the disk is going to be read, passed to the kernel as a hint
+enum AccessPattern
+{
+    ACCESS_NORMAL,
+    ACCESS_SEQUENTIAL,
+    ACCESS_RANDOM
+};
+
+enum OpenMode
+{
+    OPEN_READ_WRITE, // one process at a time
+    OPEN_READ_ONLY   // any amount of processes, next to the one that writes
+};
+
 class Disk
 {
 private:
     int fd;
     unsigned char* m_fileMap;
+    bool m_ownsMap;
     uint32_t m_blockSize;
     uint32_t m_nblocks;
+    StripeSet* m_stripes; // the backing files of a striped volume (nullptr for a single file)
+
+    // CRC32C of every block, stored in the checksum area of the disk
+    uint32_t* m_checksums;
+    uint32_t m_checksumFirstBlock;
+    uint32_t m_checksumBlocks;
+    std::unique_ptr<BlockBitmap> m_verified;
+    BlockBitmap* m_pending; // written in the open section, the checksum is updated when it ends (shared with views)
+    uint32_t* m_dirtyList; // in the header block, see DIRTY_LIST_ADDR (nullptr for a view)
+    uint32_t m_dirtyCapacity;
+    bool m_verifyChecksums;
+    mutable std::mutex m_checksumLock;
+    bool m_discardSupported; // turned off when the host file system can not punch holes
+
+    // the writes of a section are seen at once by read-only mounts, the sequence is odd while one is open
+    bool m_readOnly;
+    std::atomic<uint64_t>* m_sequence;
+    uint32_t m_sectionDepth;
+    bool m_sectionWritten;
+    std::mutex m_sectionLock;
+    mutable std::atomic<uint64_t> m_readSequence; // the latest sequence a read of a read-only disk started at
+
+    // writes copy out the content snapshots still need, a snapshot view reads through them
+    SnapshotTable* m_snapshots;
+    const SnapshotTable* m_view;
+    size_t m_viewSlot;
 
     void createDiskFile(const char* filePath);
+    void lockWriter();
+    bool hasWriter() const;
+    void markWritten();
+    void updatePendingChecksums();
+    uint32_t computeChecksum(const uint32_t blockNum) const;
+    void locate(const unsigned long addr, int& fileFd, unsigned long& offset, unsigned long& length) const;
+    bool hasChecksum(const uint32_t blockNum) const;
+    void findData(const unsigned long from, unsigned long& dataStart, unsigned long& dataEnd) const;
+    void verifyRange(const unsigned long addr, const int size) const;
+    void readRange(unsigned long addr, int size, char* ans) const;
+    void writeRange(unsigned long addr, int size, const char* data);
 
 public:
-    Disk(const char* filePath, const uint32_t blockSize = 4096, const uint32_t nblocks = 4096);
+    Disk(const char* filePath, const uint32_t blockSize = 4096, const uint32_t nblocks = 4096, const OpenMode mode = OPEN_READ_WRITE);
+    Disk(const Disk& live, const SnapshotTable* snapshots, const size_t slot);
     ~Disk();
 
     uint32_t getBlockSize() const { return m_blockSize; }
     uint32_t getBlocksAmount() const { return m_nblocks; }
-    size_t getDiskSize() const { return m_blockSize * m_nblocks; }
+    size_t getDiskSize() const { return (size_t)m_blockSize * m_nblocks; }
+    bool isStriped() const { return m_stripes != nullptr; }
+    bool isReadOnly() const { return m_readOnly; }
+
+    static uint32_t getChecksumBlocksAmount(const uint32_t blockSize, const uint32_t nblocks);
+    void enableChecksums(const unsigned long checksumAddr, bool initialize);
+    bool hasChecksums() const { return m_checksums != nullptr; }
+    void setVerifyChecksums(const bool verify) { m_verifyChecksums = verify; }
+    bool verifyBlock(const uint32_t blockNum) const;
+    void setSnapshots(SnapshotTable* snapshots) { m_snapshots = snapshots; }
+
+    /**
+     * @brief Read-only view of the mapped disk, valid while the disk is open.
+     *        Reads through it skip the checksum verification, changes must go through write.
+     */
+    const unsigned char* view(const unsigned long addr) const { return m_fileMap + addr; }
 
     void read(unsigned long addr, int size, char* ans) const ;
     void write(unsigned long addr, int size, const char* data);
-};
\ No newline at end of file
+    void discard(unsigned long addr, unsigned long size);
+    void prefetch(unsigned long addr, unsigned long size) const;
+    void adviseAccess(const AccessPattern pattern, unsigned long addr = 0, unsigned long size = 0) const;
+
+    void enterWriteSection();
+    void leaveWriteSection();
+    uint64_t beginRead() const;
+    bool endRead(const uint64_t sequence) const;
+};
+
+/**
+ * @brief keeps a write section of a disk open while it is in scope.
+ */
+class DiskWriteSection
+{
+private:
+    Disk* m_disk;
+
+public:
+    explicit DiskWriteSection(Disk* disk): m_disk(disk) { m_disk->enterWriteSection(); }
+    ~DiskWriteSection() { m_disk->leaveWriteSection(); }
+
+    DiskWriteSection(const DiskWriteSection&) = delete;
+    DiskWriteSection& operator=(const DiskWriteSection&) = delete;
+};
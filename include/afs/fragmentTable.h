@@ -0,0 +1,34 @@
+#pragma once
+
+#include <afs/disk.h>
+#include <afs/blocksTable.h>
+#include <afs/constants.h>
+#include <afs/fsStructs.h>
+
+#include <vector>
+#include <unordered_map>
+
+class FragmentTable
+{
+private:
+    Disk* m_disk;
+    BlocksTable* m_dblocksTable;
+    struct afsHeader* m_header;
+
+    std::vector<fragMapEntry> m_entries;
+    std::vector<address> m_mapBlocks;
+    std::unordered_map<address, size_t> m_entryIndex;
+
+    uint32_t getEntriesPerBlock() const;
+    size_t addFragmentBlock();
+    void writeEntry(const size_t index);
+
+public:
+    FragmentTable(Disk* disk, BlocksTable* dblocksTable, struct afsHeader* header);
+
+    uint32_t getFragmentSize() const;
+    uint32_t getMaxTailSize() const;
+
+    address allocate(const uint32_t size);
+    void release(const address fragAddr, const uint32_t size);
+};
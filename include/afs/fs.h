@@ -2,11 +2,25 @@
 
 #include <afs/disk.h>
 #include <afs/blocksTable.h>
+#include <afs/fragmentTable.h>
+#include <afs/blockMap.h>
+#include <afs/refCountTable.h>
+#include <afs/dedupIndex.h>
+#include <afs/scrubber.h>
+#include <afs/snapshotTable.h>
+#include <afs/threadPool.h>
+#include <afs/readAhead.h>
+#include <afs/sharedMutex.h>
 #include <afs/constants.h>
 #include <afs/fsStructs.h>
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 #include <cstdint>
 
@@ -16,31 +30,128 @@ private:
     Disk* m_disk;
     struct afsHeader* m_header;
     BlocksTable* m_dblocksTable;
+    mutable FragmentTable* m_fragments;
+    RefCountTable* m_refCounts;
+    DedupIndex* m_dedupIndex;
+    Scrubber* m_scrubber;
+    SnapshotTable* m_snapshots;
+    uint32_t m_inodeCursor; // the next search for a free inode starts here
+    mutable std::vector<address> m_inodeTable; // blocks of the inode table, in the order of its block map
+
+    mutable std::unordered_map<uint32_t, ReadAhead> m_readAheads; // read-ahead of the files read by readContent
+    mutable std::mutex m_readAheadLock;
+
+    // a file system opened on a snapshot reads it through the snapshots of the live one
+    bool m_readOnly;
+    size_t m_viewSlot;
+
+    // a read-only mount reloads the header and the tables it keeps once another process wrote the disk,
+    // the sequence they were loaded at is odd until the first read
+    mutable uint64_t m_loadedSequence;
+
+    // reads share the lock and run together, writes and the steps of the reclaimer take it alone
+    mutable SharedMutex m_lock;
+    std::thread m_reclaimer;
+    std::condition_variable_any m_orphanAdded;
+    std::condition_variable_any m_reclaimIdle;
+    bool m_stopReclaimer;
+    reclaimStatus m_reclaimStatus; // the steps that failed, their orphans and snapshots are skipped
+
+    FileSystem(FileSystem& live, const std::string& snapshotName);
+    FileSystem(const char* filePath, uint32_t blockSize, uint32_t nblocks, const OpenMode mode);
     
-    address inodeIndexToAddr(const int inodeIndex) const;
+    address inodeIndexToAddr(const uint32_t inodeIndex) const;
     address pathToAddr(const afsPath path) const;
     address getFreeDirChunkAddr(const address dirAddr);
+    address reserveClearedBlock();
+    address reserveRegion(const uint32_t blocksAmount);
     inode getRoot() const;
     inode pathToInode(afsPath path) const;
-    dirSibling getSiblingData(const address dirAddr, const int indx) const;
+    uint32_t pathToInodeIndex(afsPath path) const;
+    address getDirBlock(const address dirAddr, const uint32_t blockIndex) const;
+    address getSiblingAddr(const address dirAddr, const directoryData indx) const;
+    address getFingerprintAddr(const address dirAddr, const directoryData indx) const;
+    dirSibling getSiblingData(const address dirAddr, const directoryData indx) const;
     dirSibling getSiblingData(const address dirAddr, const std::string& siblingName) const;
+    std::vector<dirSibling> readDirEntries(const inode& dirInode) const;
+    walkEntry makeWalkEntry(const std::string& path, const uint32_t inodeIndex, const uint32_t parentIndex,
+                            const uint32_t depth, const walkOptions& options) const;
+    void walkDirectory(ThreadPool& pool, const walkEntry& dir, const walkVisitor& visitor, const walkOptions& options) const;
 
     void setHeader();
+    void checkWritable() const;
+    template <typename Operation>
+    auto readConsistent(Operation operation) const -> decltype(operation());
+    void reloadShared(const uint64_t sequence) const;
 
+    void addFile(const std::string& path, const bool isDir);
     void createCurrAndPrevDir(const unsigned int currentDirInode, const unsigned int prevDirInode);
+    void loadInodeTable() const;
+    void growInodeTable();
     uint32_t createInode(const inode node);
+    void freeInode(const uint32_t inodeIndex, inode& node);
+    uint32_t getInodesCapacity() const;
+    uint32_t getMappedBlocks(const inode& fileInode) const;
+    fragmentationInfo measureFragmentation(const inode& fileInode) const;
+    uint32_t defragmentStep(const inode& fileInode, uint32_t& nextIndex, unsigned int& nextBlock);
+    void appendData(inode& fileInode, std::string content);
+    void appendToBlocks(inode& fileInode, const char* content, const uint64_t size);
+    void zeroBlockRange(BlockMap& blockMap, const uint64_t start, const uint64_t end);
+    void unpackFile(inode& fileInode);
+    void resizeCompressed(BlockMap& blockMap, inode& fileInode, const uint64_t size);
+    address copyBlock(BlockMap& blockMap, const uint32_t blockIndex, const address sharedAddr);
+    bool shareBlock(BlockMap& blockMap, const uint32_t blockIndex, const char* data);
+    void appendCompressed(inode& fileInode, std::string content);
+    std::string readChunk(BlockMap& blockMap, const uint32_t chunkIndex, const uint32_t rawSize) const;
+    void writeChunk(BlockMap& blockMap, const uint32_t chunkIndex, const char* content, const uint32_t size);
+    void releaseChunk(BlockMap& blockMap, const uint32_t chunkIndex);
+    void readFileData(const inode& fileInode, const uint64_t offset, const uint64_t size, char* buffer, ReadAhead* readAhead = nullptr) const;
+    uint32_t getPackableTailSize(const inode& fileInode, const uint64_t contentSize) const;
+    void freeFileData(const inode& fileInode);
+    void createRefCounts();
     void addSibling(const address dirAddr, const dirSibling sibling);
+    void removeSibling(const address dirAddr, const std::string& siblingName);
+    int64_t getSiblingIndex(const address dirAddr, const std::string& siblingName) const;
     uint32_t createDirectory(std::string path, inode fileInode);
-    void recursiveRemove(inode dirInode);
+    void addOrphan(const uint32_t inodeIndex, inode& node);
+    bool hasReclaimWork() const;
+    void runReclaimer();
+    void skipOrphan(const uint32_t inodeIndex);
+    void reclaimStep();
 
 public:
     FileSystem(const char* filePath, uint32_t blockSize = 4096, uint32_t nblocks = 4096);
+    FileSystem(const char* filePath, const OpenMode mode);
     ~FileSystem();
 
     void format();
     void createFile(const std::string& path, const bool isDir = false);
     void appendContent(const std::string& filePath, std::string content);
     void deleteFile(const std::string& filePath);
+    void waitForReclaim();
+    reclaimStatus getReclaimStatus() const;
+    void rename(const std::string& srcPath, const std::string& dstPath);
+    void clone(const std::string& srcPath, const std::string& dstPath);
+    void truncate(const std::string& filePath, const uint64_t size);
+    void punchHole(const std::string& filePath, const uint64_t offset, const uint64_t length);
+    fragmentationInfo getFragmentation(const std::string& filePath) const;
+    fragmentationInfo defragment(const std::string& filePath, const uint64_t bytesPerSecond = 0);
+    void setCompression(const std::string& path, const bool enable);
+    void setDedup(const bool enable);
+    void setVerifyChecksums(const bool verify);
+    void createSnapshot(const std::string& name);
+    void deleteSnapshot(const std::string& name);
+    std::vector<snapshotInfo> listSnapshots() const;
+    std::unique_ptr<FileSystem> openSnapshot(const std::string& name);
+    void beginWriteBatch();
+    void endWriteBatch();
+    void startScrubber(const uint64_t bytesPerSecond);
+    void stopScrubber();
+    scrubStatus getScrubStatus() const;
     std::string getContent(const std::string& filePath) const;
+    std::string readContent(const std::string& filePath, const uint64_t offset, uint32_t size) const;
     dirList listDir(const std::string& dirPath) const;
+    uint32_t getInodeIndex(const std::string& path) const;
+    void walk(const std::string& rootPath, const walkVisitor& visitor, const walkOptions& options = walkOptions()) const;
+    fsStats statfs() const;
 };
\ No newline at end of file
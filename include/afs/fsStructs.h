@@ -2,26 +2,59 @@
 
 #include <afs/constants.h>
 
+#include <string>
+#include <vector>
+#include <functional>
+
 #include <cstring>
 
 enum InodeFlags
 {
     DELETED = 1 << 0,
     FILETYPE = 1 << 1,
-    DIRTYPE = 1 << 2
+    DIRTYPE = 1 << 2,
+    INLINEDATA = 1 << 3,
+    TAILPACKED = 1 << 4,
+    COMPRESSED = 1 << 5,
+    ORPHAN = 1 << 6 // deleted, waiting in the orphan list for its blocks to be reclaimed
 };
 
-typedef struct inode
+constexpr uint32_t INODE_SIZE = 128;
+constexpr uint32_t NO_ORPHAN = (uint32_t)-1; // end of the orphan list
+constexpr uint32_t INLINE_DATA_MAX = INODE_SIZE - sizeof(int) - sizeof(uint64_t) - 2 * sizeof(address) - sizeof(uint32_t);
+
+typedef struct __attribute__((__packed__)) inode
 {
     inode() {}
     inode(bool isDir):
-        flags(isDir ? DIRTYPE : FILETYPE), fileSize(0), firstAddr((address)-1) {}
+        flags(isDir ? DIRTYPE : FILETYPE), fileSize(0), firstAddr((address)-1), tailAddr(0), nextOrphan(NO_ORPHAN)
+    {
+        memset(inlineData, 0, sizeof(inlineData));
+    }
     
     int flags;
-    uint32_t fileSize;
+    uint64_t fileSize;
     address firstAddr;
+    address tailAddr; // fragment holding the end of the file (valid when TAILPACKED is set)
+    uint32_t nextOrphan; // next inode in the orphan list (valid when ORPHAN is set)
+    char inlineData[INLINE_DATA_MAX]; // content of small files (valid when INLINEDATA is set)
 } inode;
 
+static_assert(sizeof(inode) == INODE_SIZE, "on-disk inode size mismatch");
+
+typedef struct fragMapEntry
+{
+    address blockAddr; // block split into fragments (0 if the entry is unused)
+    uint16_t usedMask; // bit for every used fragment in the block
+    uint16_t reserved[3];
+} fragMapEntry;
+
+typedef struct dedupEntry
+{
+    uint64_t fingerprint;
+    address blockAddr; // 0 if the slot is empty
+} dedupEntry;
+
 typedef struct directorySibling
 {
     directorySibling(const char* fileName, uint32_t inodeIndex):
@@ -32,4 +65,32 @@ typedef struct directorySibling
     directorySibling() = default;
     char name[NAME_MAX_LEN]; 
     uint32_t indodeTableIndex;
-} dirSibling;
\ No newline at end of file
+} dirSibling;
+
+typedef struct walkEntry
+{
+    std::string path;
+    uint32_t inodeIndex;
+    uint32_t parentIndex;
+    uint32_t depth;          // 0 for the directory the walk starts at
+    inode node;
+    uint64_t allocatedBytes; // blocks and tail of the entry (only with walkOptions::countBlocks)
+} walkEntry;
+
+typedef struct walkOptions
+{
+    unsigned int threads = 0;         // walking threads, 0 for one per CPU
+    uint32_t maxDepth = (uint32_t)-1; // directories deeper than this are not opened
+    bool countBlocks = false;         // fill walkEntry::allocatedBytes, reads the block map of every file
+} walkOptions;
+
+typedef struct reclaimStatus
+{
+    std::vector<uint32_t> failedOrphans; // deleted files the reclaimer could not release, left for afs-fsck
+    bool snapshotsFailed = false;        // a deleted snapshot could not be released, the deleted snapshots are left for afs-fsck
+    std::string lastError;               // what the last failed step threw
+} reclaimStatus;
+
+// called concurrently from the walking threads, it must not use the file system.
+// Returning false for a directory skips its content.
+typedef std::function<bool(const walkEntry&)> walkVisitor;
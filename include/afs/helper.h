@@ -16,7 +16,10 @@ public:
 
     static address blockToAddr(uint32_t blockSize, unsigned int blockNum, unsigned int offset = 0);
     static unsigned int addrToBlock(uint32_t blockSize, address addr);
-    static address getSiblingAddr(address parentAddr, unsigned int index);
+    static uint32_t getSiblingsPerBlock(uint32_t blockSize);
+    static address getSiblingAddr(address blockAddr, uint32_t blockSize, unsigned int index);
+    static address getFingerprintAddr(address blockAddr, unsigned int index);
+    static address getNextBlock(const Disk* disk, address blockAddr);
     static address getLastFileBlock(const Disk* disk, address fileAddr);
 
     static bool isFileExist(const char* filePath);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <afs/threadPool.h>
+#include <afs/stripeSet.h>
+#include <afs/constants.h>
+
+#include <vector>
+#include <atomic>
+#include <memory>
+
+#include <cstdint>
+
+constexpr uint32_t CLONE_CHUNK_BYTES = 64 << 20; // bytes a worker copies at once
+
+typedef struct cloneReport
+{
+    uint64_t blocksCopied;
+    uint64_t bytesCopied;
+    uint64_t blocksDiscarded; // free blocks released in the copy
+} cloneReport;
+
+/**
+ * Copies a disk image to a sparse file, reading only the blocks that are in use.
+ * The blocks table decides what is copied, together with the snapshot generations
+ * when the image has them (free blocks a snapshot still reads are copied too).
+ * The runs of blocks are copied in parallel with copy_file_range, so the host can
+ * share the extents instead of copying them.
+ * An existing copy is updated with the blocks written since the generation it was
+ * taken at, which needs the generations a snapshot starts keeping.
+ * A striped volume is copied to a single image.
+ * The image must not be open for writing while it is copied, the cloner refuses
+ * to open it while a writer has it and keeps writers out until it is destroyed.
+ */
+class ImageCloner
+{
+private:
+    int m_fd;
+    std::unique_ptr<StripeSet> m_stripes; // the members of a striped image (nullptr for a single file)
+    struct afsHeader* m_header;
+    ThreadPool m_pool;
+    std::atomic<uint64_t> m_bytesCopied;
+
+    typedef struct blockRun
+    {
+        uint32_t first;
+        uint32_t amount;
+    } blockRun;
+
+    std::vector<unsigned char> readBlocksTable() const;
+    std::vector<uint32_t> readGenerations() const;
+    void readImage(const uint64_t addr, const uint64_t size, char* data) const;
+    void copyRange(const int dstFd, const uint64_t offset, const uint64_t length);
+    void copyFile(const int srcFd, const uint64_t srcAddr, const int dstFd, const uint64_t dstAddr, const uint64_t length);
+    cloneReport copyRuns(const char* dstPath, const int openFlags, const std::vector<blockRun>& copied, const std::vector<blockRun>& discarded);
+
+public:
+    ImageCloner(const char* filePath, const unsigned int threads = 0);
+    ~ImageCloner();
+
+    cloneReport clone(const char* dstPath);
+    cloneReport update(const char* dstPath);
+};
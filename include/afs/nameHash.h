@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * One byte fingerprints of the names of directory entries. Every directory block
+ * keeps the fingerprints of its entries next to them, a lookup compares the
+ * fingerprints 16 or 32 at a time and reads only the entries that match.
+ */
+class NameHash
+{
+private:
+    static uint32_t findScalar(const uint8_t* fingerprints, const uint32_t amount, const uint8_t fingerprint, uint32_t from);
+    static uint32_t findSse2(const uint8_t* fingerprints, const uint32_t amount, const uint8_t fingerprint, uint32_t from);
+    static uint32_t findAvx2(const uint8_t* fingerprints, const uint32_t amount, const uint8_t fingerprint, uint32_t from);
+
+public:
+    static uint8_t fingerprint(const char* name);
+    static uint32_t find(const uint8_t* fingerprints, const uint32_t amount, const uint8_t fingerprint, const uint32_t from = 0);
+};
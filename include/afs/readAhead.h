@@ -0,0 +1,35 @@
+#pragma once
+
+#include <afs/disk.h>
+#include <afs/blockMap.h>
+
+#include <cstdint>
+
+constexpr uint32_t READAHEAD_MIN_BLOCKS = 4;
+constexpr uint32_t READAHEAD_MAX_BYTES = 2 << 20; // the window stops growing here
+constexpr uint32_t READAHEAD_TRIGGER = 2;          // sequential blocks in a row before prefetching starts
+constexpr size_t MAX_READ_STREAMS = 64;            // files a file system keeps the read-ahead of
+
+/**
+ * Read-ahead of one stream of reads of a file. Once the reads are sequential the
+ * next blocks of the file are prefetched from the disk mapping ahead of the reader,
+ * in a window that doubles every time it is refilled. A jump stops the prefetching
+ * until the reads are sequential again.
+ */
+class ReadAhead
+{
+private:
+    Disk* m_disk;
+    uint32_t m_maxWindow;
+    uint32_t m_window;          // blocks prefetched by the last refill, 0 when not sequential
+    uint32_t m_run;             // sequential blocks read in a row
+    uint32_t m_nextBlock;       // the block a sequential read continues at
+    uint32_t m_prefetchedUntil; // the blocks before it were prefetched
+
+    void prefetch(BlockMap& blockMap, const uint32_t firstBlock, const uint32_t lastBlock) const;
+
+public:
+    explicit ReadAhead(Disk* disk);
+
+    void access(BlockMap& blockMap, const uint32_t blockIndex, const uint32_t fileBlocks);
+};
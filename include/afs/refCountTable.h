@@ -0,0 +1,44 @@
+#pragma once
+
+#include <afs/disk.h>
+#include <afs/constants.h>
+
+#include <vector>
+
+#include <cstdint>
+
+class DedupIndex;
+
+constexpr uint32_t REF_INDEXED = 1u << 31; // the block is registered in the dedup index
+constexpr uint32_t REF_COUNT_MASK = REF_INDEXED - 1;
+
+/**
+ * Counts the owners of data blocks that are shared between files (by dedup or clones).
+ * The table holds a uint32_t for every block of the disk, a count of 0 means
+ * the block has a single owner (or none).
+ */
+class RefCountTable
+{
+private:
+    Disk* m_disk;
+    address m_tableAddr;
+    DedupIndex* m_dedupIndex;
+
+    uint32_t getEntry(const unsigned int blockNum) const;
+    void setEntry(const unsigned int blockNum, const uint32_t entry);
+
+public:
+    RefCountTable(Disk* disk, const address tableAddr);
+
+    static uint32_t getTableBlocksAmount(const Disk* disk);
+
+    void setDedupIndex(DedupIndex* dedupIndex) { m_dedupIndex = dedupIndex; }
+
+    uint32_t getRefCount(const unsigned int blockNum) const;
+    bool isIndexed(const unsigned int blockNum) const;
+
+    void addRef(const unsigned int blockNum);
+    void addRefs(std::vector<unsigned int> blocks);
+    void setIndexed(const unsigned int blockNum);
+    bool release(const unsigned int blockNum);
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <afs/disk.h>
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include <cstdint>
+
+constexpr uint32_t SCRUB_PREFETCH_BLOCKS = 256; // blocks read ahead of the verification
+
+typedef struct scrubStatus
+{
+    uint64_t passes;        // full passes over the disk
+    uint64_t blocksChecked; // blocks verified since the scrubber started
+    std::vector<uint32_t> badBlocks; // blocks that did not match their checksum
+} scrubStatus;
+
+/**
+ * Background thread that verifies the checksums of all the blocks of a disk
+ * over and over, reading at most a configured amount of bytes per second.
+ */
+class Scrubber
+{
+private:
+    Disk* m_disk;
+    uint64_t m_bytesPerSecond;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    mutable std::mutex m_lock;
+    std::condition_variable m_stopped;
+    scrubStatus m_status;
+
+    void run();
+
+public:
+    Scrubber(Disk* disk, const uint64_t bytesPerSecond);
+    ~Scrubber();
+
+    void start();
+    void stop();
+    scrubStatus getStatus() const;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <mutex>
+#include <shared_mutex>
+
+/**
+ * Mutex that readers hold together and writers alone. A writer that waits for the
+ * readers goes before the readers that come after it, so a steady stream of reads
+ * does not keep the writes out. Neither mode may be taken again by its holder.
+ */
+class SharedMutex
+{
+private:
+    std::shared_mutex m_lock;
+    std::mutex m_writerTurn; // held by a writer until it has the lock, the readers pass through it
+
+public:
+    void lock();
+    void unlock();
+    void lock_shared();
+    void unlock_shared();
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <afs/disk.h>
+#include <afs/blocksTable.h>
+#include <afs/constants.h>
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <unordered_map>
+
+#include <cstdint>
+
+constexpr uint32_t GEN_FREE = 1u << 31;     // the block was free when its generation was set
+constexpr uint32_t GEN_UNTRACKED = (uint32_t)-1; // metadata and snapshot blocks, never copied out
+constexpr uint32_t SNAPSHOT_DELETED = 1;
+constexpr uint32_t EXCEPTION_PROCESSED = (uint32_t)-1; // an exception the reclaimer already handled
+
+struct __attribute__((__packed__)) snapshotRecord
+{
+    char name[NAME_MAX_LEN];
+    uint32_t generation;     // 0 for an unused slot
+    uint32_t flags;
+    int64_t createdAt;
+    address exceptionsAddr;  // first block of the exceptions chain (0 if none)
+    uint32_t exceptionsAmount;
+    struct afsHeader header; // the header when the snapshot was taken
+};
+
+// the content a block had in a snapshot, saved before the block was overwritten
+struct __attribute__((__packed__)) exceptionEntry
+{
+    uint32_t blockNum;
+    address copyAddr;
+};
+
+/**
+ * Point in time snapshots of the whole disk. Every block has a generation in
+ * the generation table, taking a snapshot only starts a new generation. The first
+ * write to a block after a snapshot copies the old content to a new block and
+ * records it in the exceptions of the snapshot, so the live disk keeps its layout.
+ * A snapshot reads a block from the first exception for it in itself or a newer
+ * snapshot, and from the live disk if there is none.
+ * Deleted snapshots are reclaimed in steps: an exception an older snapshot still
+ * reads is handed to it, the others are freed.
+ */
+class SnapshotTable
+{
+private:
+    Disk* m_disk;
+    BlocksTable* m_dblocksTable;
+    struct afsHeader* m_header;
+    std::vector<snapshotRecord> m_records;
+    std::vector<std::unordered_map<uint32_t, address>> m_exceptions;
+    std::vector<address> m_chainTails;
+    std::vector<uint32_t> m_openViews;
+    std::vector<size_t> m_order; // the used slots, oldest first
+    std::vector<unsigned int> m_keptBlocks;
+
+    // copy outs and the writes that cause them are atomic for the readers of the snapshots
+    mutable std::recursive_mutex m_lock;
+
+    uint32_t getEntriesPerBlock() const;
+    uint32_t getGeneration(const unsigned int blockNum) const;
+    void setGeneration(const unsigned int blockNum, const uint32_t generation);
+    void writeRecord(const size_t slot);
+    void loadExceptions(const size_t slot);
+    void sortSlots();
+    int getNewestLive() const;
+    int findSlot(const std::string& name) const;
+    unsigned int allocateBlock();
+    void flushKeptBlocks();
+    bool needsCopy(const unsigned int blockNum) const;
+    void addException(const size_t slot, const unsigned int blockNum, const address copyAddr);
+    void copyOut(const unsigned int blockNum, const size_t slot);
+
+public:
+    SnapshotTable(Disk* disk, BlocksTable* dblocksTable, struct afsHeader* header);
+
+    static uint32_t getGenerationBlocksAmount(const Disk* disk);
+    void formatGenerations();
+    void setUntracked(const address firstAddr, const uint32_t blocksAmount);
+
+    std::recursive_mutex& getLock() const { return m_lock; }
+
+    void create(const std::string& name);
+    void remove(const std::string& name);
+    std::vector<snapshotInfo> list() const;
+
+    size_t openView(const std::string& name, struct afsHeader& header);
+    void closeView(const size_t slot);
+    unsigned int translate(const size_t slot, const unsigned int blockNum) const;
+
+    void beforeWrite(const unsigned long addr, const int size);
+    bool blockFreed(const unsigned int blockNum);
+
+    bool hasDeleted() const;
+    void reclaimStep();
+};
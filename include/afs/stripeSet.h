@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include <cstdint>
+
+constexpr char STRIPE_MAGIC[] = "AFSSTRP";
+constexpr uint8_t STRIPE_VERSION = 1;
+constexpr uint32_t STRIPE_HEADER_SIZE = 64 << 10; // bytes before the stripes of every member, a multiple of the page size
+constexpr uint32_t STRIPE_MAX_MEMBERS = 16;
+constexpr uint32_t STRIPE_PATH_LEN = 1024;
+constexpr uint32_t STRIPE_MAX_UNITS = 32768;      // stripe units of a volume, every one of them is a mapping of its own
+
+// the start of every member, all the members record the whole layout
+struct __attribute__((__packed__)) stripeHeader
+{
+    char magic[8];
+    uint8_t version;
+    uint8_t members;
+    uint8_t index;       // the member this header is the start of
+    uint32_t stripeUnit; // bytes of the volume on one member before the next member
+    uint64_t volumeSize;
+    uint64_t volumeId;   // the same on all the members of a volume
+    char paths[STRIPE_MAX_MEMBERS][STRIPE_PATH_LEN];
+};
+
+/**
+ * A volume striped over several backing files, usually on different devices.
+ * Stripe unit k of the volume is unit k / members of member k % members, so
+ * a sequential pass keeps all the devices busy. The stripes of all the members
+ * are mapped one after the other into a single mapping, so the volume is used
+ * like a disk file that is mapped once.
+ * The volume is opened by the path of any of its members.
+ */
+class StripeSet
+{
+private:
+    std::vector<int> m_fds;
+    struct stripeHeader m_header;
+
+    static uint64_t getMemberSize(const uint32_t stripeUnit, const uint64_t volumeSize, const size_t members);
+
+public:
+    explicit StripeSet(const char* filePath, const bool readOnly = false);
+    ~StripeSet();
+
+    static bool isStripeSet(const char* filePath);
+    static void create(const std::vector<std::string>& paths, const uint32_t stripeUnit, const uint64_t volumeSize);
+
+    uint32_t getStripeUnit() const { return m_header.stripeUnit; }
+    uint64_t getVolumeSize() const { return m_header.volumeSize; }
+    size_t getMembersAmount() const { return m_fds.size(); }
+
+    void locate(const uint64_t addr, int& fd, uint64_t& offset, uint64_t& length) const;
+    unsigned char* map(const uint64_t size, const bool readOnly = false) const;
+    void read(uint64_t addr, uint64_t size, char* data) const;
+};
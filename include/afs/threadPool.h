@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <condition_variable>
+
+/**
+ * Fixed set of worker threads, each with its own task queue. A worker runs the
+ * newest task of its own queue first and steals the oldest task of another
+ * worker when its queue is empty. Tasks submitted from a worker go to its own queue.
+ */
+class ThreadPool
+{
+private:
+    struct workerQueue
+    {
+        std::deque<std::function<void()>> tasks;
+        std::mutex lock;
+    };
+
+    std::vector<std::unique_ptr<workerQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_lock;
+    std::condition_variable m_taskAdded;
+    std::condition_variable m_allDone;
+    std::atomic<size_t> m_queued;
+    std::atomic<size_t> m_pending;
+    std::atomic<unsigned int> m_nextQueue;
+    std::exception_ptr m_error;
+    bool m_stopping;
+
+    bool popTask(const unsigned int index, std::function<void()>& task);
+    void run(const unsigned int index);
+
+public:
+    explicit ThreadPool(unsigned int threads = 0);
+    ~ThreadPool();
+
+    unsigned int getThreadsAmount() const { return m_threads.size(); }
+
+    void submit(std::function<void()> task);
+    void wait();
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <afsd/protocol.h>
+#include <afs/constants.h>
+
+#include <string>
+#include <deque>
+
+#include <cstdint>
+
+typedef struct afsdReply
+{
+    uint32_t id;
+    uint8_t status;
+    std::string payload;
+} afsdReply;
+
+/**
+ * Connection to an afsd server. The blocking calls send one request and wait
+ * for its reply. Pipelined use queues requests with submit, sends them together
+ * with flush and takes the replies in order with receive.
+ */
+class AfsdClient
+{
+private:
+    int m_fd;
+    uint32_t m_nextId;
+    std::string m_out;
+    std::string m_in;
+    size_t m_inOffset;
+    std::deque<uint32_t> m_inFlight;
+
+    void fill(const size_t size);
+    std::string call(const uint8_t opcode, const std::string& payload);
+
+public:
+    explicit AfsdClient(const std::string& socketPath);
+    ~AfsdClient();
+
+    AfsdClient(const AfsdClient&) = delete;
+    AfsdClient& operator=(const AfsdClient&) = delete;
+
+    uint32_t submit(const uint8_t opcode, const std::string& payload = "");
+    void flush();
+    afsdReply receive();
+    size_t getInFlight() const { return m_inFlight.size(); }
+
+    void ping();
+    void createFile(const std::string& path, const bool isDir = false);
+    void deleteFile(const std::string& path);
+    void appendContent(const std::string& path, const std::string& content);
+    std::string getContent(const std::string& path);
+    std::string readContent(const std::string& path, const uint64_t offset, const uint32_t size);
+    dirList listDir(const std::string& path);
+    void rename(const std::string& srcPath, const std::string& dstPath);
+    void clone(const std::string& srcPath, const std::string& dstPath);
+    void truncate(const std::string& path, const uint64_t size);
+    void punchHole(const std::string& path, const uint64_t offset, const uint64_t length);
+    fsStats statfs();
+};
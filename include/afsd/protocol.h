@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+
+#include <cstdint>
+
+/*
+ * The afsd wire protocol. Every message is a header followed by a payload of
+ * header.length bytes, numbers are in host order (the socket is local). A client
+ * may send many requests without waiting, the replies of a connection come back
+ * in the order of its requests, several of them in one write when they are ready together.
+ * Paths are a 16 bit length and the bytes, contents a 32 bit length and the bytes.
+ */
+
+constexpr uint32_t AFSD_MAX_MESSAGE = 64 << 20; // bigger messages close the connection
+
+enum AfsdOpcode : uint8_t
+{
+    OP_PING = 0,     // -
+    OP_CREATE = 1,   // path, is directory (u8)
+    OP_DELETE = 2,   // path
+    OP_APPEND = 3,   // path, content
+    OP_GET = 4,      // path -> content
+    OP_READ = 5,     // path, offset (u64), size (u32) -> content
+    OP_LIST = 6,     // path -> amount (u32), {name, size (u64), is directory (u8)}...
+    OP_RENAME = 7,   // source path, target path
+    OP_CLONE = 8,    // source path, target path
+    OP_TRUNCATE = 9, // path, size (u64)
+    OP_PUNCH = 10,   // path, offset (u64), length (u64)
+    OP_STATFS = 11   // -> block size, total blocks, free blocks, total inodes, free inodes (u32)
+};
+
+enum AfsdStatus : uint8_t
+{
+    STATUS_OK = 0,
+    STATUS_ERROR = 1,      // the operation failed, the payload is the error message
+    STATUS_BAD_REQUEST = 2 // unknown opcode or a payload that does not parse
+};
+
+struct __attribute__((__packed__)) requestHeader
+{
+    uint32_t length; // payload bytes after the header
+    uint32_t id;     // echoed in the reply
+    uint8_t opcode;
+};
+
+struct __attribute__((__packed__)) replyHeader
+{
+    uint32_t length;
+    uint32_t id;
+    uint8_t status;
+};
+
+/**
+ * Builds a message payload.
+ */
+class MessageWriter
+{
+private:
+    std::string m_data;
+
+public:
+    MessageWriter& putUint8(const uint8_t value);
+    MessageWriter& putUint32(const uint32_t value);
+    MessageWriter& putUint64(const uint64_t value);
+    MessageWriter& putPath(const std::string& path);
+    MessageWriter& putContent(const std::string& content);
+
+    const std::string& getData() const { return m_data; }
+};
+
+/**
+ * Parses a message payload, reading past its end throws std::out_of_range.
+ */
+class MessageReader
+{
+private:
+    const char* m_data;
+    size_t m_size;
+    size_t m_offset;
+
+    const char* take(const size_t size);
+
+public:
+    MessageReader(const char* data, const size_t size);
+
+    uint8_t getUint8();
+    uint32_t getUint32();
+    uint64_t getUint64();
+    std::string getPath();
+    std::string getContent();
+};
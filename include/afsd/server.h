@@ -0,0 +1,72 @@
+#pragma once
+
+#include <afs/fs.h>
+#include <afs/threadPool.h>
+#include <afsd/protocol.h>
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+#include <cstdint>
+
+constexpr size_t MAX_QUEUED_OUTPUT = 16 << 20; // a connection is not read or run while this much is waiting to be sent
+
+/**
+ * Serves one file system to many clients over a unix socket. One thread runs an
+ * epoll loop that accepts connections, reads requests and writes replies. The
+ * requests of a connection run in order on the worker pool, one batch at a time,
+ * and the replies are handed to the loop in pieces while the batch runs. Different
+ * connections run in parallel.
+ */
+class Server
+{
+private:
+    struct connection
+    {
+        int fd;
+        std::string in;                 // received bytes that are not a whole request yet
+        std::deque<std::string> queued; // whole requests waiting for a worker (loop and workers)
+        std::string out;                // replies waiting to be sent (loop and workers)
+        size_t outOffset;
+        uint32_t events;
+        bool busy;                      // a worker runs the requests of the connection
+        bool closing;                   // the client is gone, delete once no worker uses it
+    };
+
+    FileSystem* m_fs;
+    std::string m_socketPath;
+    int m_listenFd;
+    int m_epollFd;
+    int m_wakeFd;
+    ThreadPool m_pool;
+
+    std::unordered_map<int, connection*> m_connections;
+    std::mutex m_lock; // the queued requests, the output and the busy flags of the connections
+    std::vector<connection*> m_replied;  // connections a worker added replies to
+    std::vector<connection*> m_finished; // connections a worker finished a batch of
+    std::vector<connection*> m_closed;   // connections waiting to be deleted (loop only)
+    std::atomic<bool> m_stopping;
+
+    void closeSockets();
+    void acceptClients();
+    void readRequests(connection* conn);
+    void writeReplies(connection* conn);
+    void updateEvents(connection* conn);
+    void closeConnection(connection* conn);
+    void handleFinished();
+    void startBatch(connection* conn);
+    void runBatch(connection* conn);
+    void addReplies(connection* conn, std::string& replies);
+    std::string execute(const char* request, const size_t size);
+
+public:
+    Server(FileSystem* fs, const std::string& socketPath, const unsigned int workers = 0);
+    ~Server();
+
+    void run();
+    void stop();
+};
@@ -17,11 +17,24 @@ private:
 
     static void createFile(FileSystem* fs, args argv);
     static void removeFile(FileSystem* fs, args argv);
+    static void moveFile(FileSystem* fs, args argv);
+    static void copyFile(FileSystem* fs, args argv);
+    static void truncateFile(FileSystem* fs, args argv);
+    static void punchHole(FileSystem* fs, args argv);
     static void createDirectory(FileSystem* fs, args argv);
     static void listFiles(FileSystem* fs, args argv);
     static void addContent(FileSystem* fs, args argv);
     static void showContent(FileSystem* fs, args argv);
+    static void importFile(FileSystem* fs, args argv);
+    static void exportFile(FileSystem* fs, args argv);
     static void changeDirectory(FileSystem* fs, args argv);
+    static void setCompression(FileSystem* fs, args argv);
+    static void setDedup(FileSystem* fs, args argv);
+    static void scrub(FileSystem* fs, args argv);
+    static void showFreeSpace(FileSystem* fs, args argv);
+    static void findFiles(FileSystem* fs, args argv);
+    static void showUsage(FileSystem* fs, args argv);
+    static void snapshot(FileSystem* fs, args argv);
 
 public:
     static void handleCommand(FileSystem* fs, const std::string& cmd, args argv);
@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <string>
+#include <istream>
 
 typedef std::vector<std::string> command;
 
@@ -11,14 +12,18 @@ class Shell
 {
 private:
     FileSystem* m_fs = nullptr;
+    std::string m_commands;   // commands given with -c
+    std::string m_scriptPath; // script given with -f ("-" for the standard input)
+
     command parseCommand(const std::string& cmd);
     void handleCommand(command cmd);
+    int runScript(std::istream& input, const std::string& source);
 
 public:
     Shell(int argc, char* argv[]);
     ~Shell();
 
-
+    int run();
     void interactiveShell();
     
-};
\ No newline at end of file
+};
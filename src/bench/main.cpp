@@ -0,0 +1,221 @@
+#include <afs/fs.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+#include <cstdio>
+
+#include <unistd.h>
+
+constexpr uint64_t GB = 1ull << 30;
+constexpr uint32_t CHUNK_SIZE = 1 << 20; // bytes of every append and sequential read
+
+typedef struct benchOptions
+{
+    std::string diskPath;
+    uint64_t diskSize;     // bytes of the image
+    uint32_t blockSize;
+    uint64_t writeSize;    // bytes written over all the files
+    unsigned int files;
+    unsigned int randomReads;
+    bool keep;             // leave the image on the host when done
+} benchOptions;
+
+typedef std::chrono::steady_clock benchClock;
+
+static void usage(const char* program)
+{
+    std::cerr << "usage: " << program << " [-s GB] [-b bytes] [-w GB] [-f files] [-r reads] [-k] <disk file>" << std::endl
+              << "  -s  size of the image to create (default: 64)" << std::endl
+              << "  -b  block size (default: 4096)" << std::endl
+              << "  -w  content written over all the files (default: 8)" << std::endl
+              << "  -f  amount of files the content is spread over (default: 4)" << std::endl
+              << "  -r  random block reads after the sequential pass (default: 20000)" << std::endl
+              << "  -k  keep the image instead of removing it" << std::endl;
+}
+
+static double secondsSince(const benchClock::time_point start)
+{
+    return std::chrono::duration<double>(benchClock::now() - start).count();
+}
+
+/**
+ * @brief print the throughput of every GB of a sequential pass, and the slowest and fastest of them.
+ */
+static void reportPass(const std::string& name, const std::vector<double>& gbSeconds, const double seconds, const uint64_t bytes)
+{
+    for (size_t i = 0; i < gbSeconds.size(); i++)
+        std::cout << "  " << name << " GB " << std::setw(4) << i + 1 << ": " << std::setw(8) << 1024 / gbSeconds[i] << " MB/s" << std::endl;
+
+    if (!gbSeconds.empty())
+        std::cout << name << ": " << bytes / seconds / (1 << 20) << " MB/s (GB min " << 1024 / *std::max_element(gbSeconds.begin(), gbSeconds.end())
+                  << ", max " << 1024 / *std::min_element(gbSeconds.begin(), gbSeconds.end()) << ")" << std::endl;
+}
+
+static std::string filePath(const unsigned int index)
+{
+    return "/bench" + std::to_string(index);
+}
+
+static void runBench(const benchOptions& options)
+{
+    uint64_t ram = (uint64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    uint64_t perFile = options.writeSize / options.files / CHUNK_SIZE * CHUNK_SIZE;
+    std::string chunk(CHUNK_SIZE, '\0');
+    std::vector<double> gbSeconds;
+    std::mt19937_64 rng(1);
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "image " << options.diskSize / (double)GB << " GB, writing " << perFile * options.files / (double)GB << " GB in "
+              << options.files << " files, memory " << ram / (double)GB << " GB" << std::endl;
+
+    auto start = benchClock::now();
+    FileSystem fs(options.diskPath.c_str(), options.blockSize, options.diskSize / options.blockSize);
+
+    std::cout << "create: " << std::setprecision(2) << secondsSince(start) << "s" << std::setprecision(1) << std::endl;
+
+    // the files are written one after the other, every chunk with different content
+    auto passStart = benchClock::now(), gbStart = passStart;
+    uint64_t written = 0;
+
+    for (unsigned int i = 0; i < options.files; i++)
+    {
+        fs.createFile(filePath(i));
+
+        for (uint64_t offset = 0; offset < perFile; offset += CHUNK_SIZE)
+        {
+            for (size_t j = 0; j < chunk.size(); j += sizeof(uint64_t))
+                *(uint64_t*)&chunk[j] = rng();
+
+            fs.appendContent(filePath(i), chunk);
+            written += CHUNK_SIZE;
+
+            if (written % GB == 0)
+            {
+                gbSeconds.push_back(secondsSince(gbStart));
+                gbStart = benchClock::now();
+            }
+        }
+    }
+
+    reportPass("write", gbSeconds, secondsSince(passStart), written);
+
+    // read back in the order of the writes, the first files left the page cache long ago
+    uint64_t readBytes = 0;
+
+    gbSeconds.clear();
+    passStart = gbStart = benchClock::now();
+
+    for (unsigned int i = 0; i < options.files; i++)
+    {
+        for (uint64_t offset = 0; offset < perFile; offset += CHUNK_SIZE)
+        {
+            if (fs.readContent(filePath(i), offset, CHUNK_SIZE).size() != CHUNK_SIZE)
+                throw std::runtime_error("short read of " + filePath(i));
+
+            readBytes += CHUNK_SIZE;
+
+            if (readBytes % GB == 0)
+            {
+                gbSeconds.push_back(secondsSince(gbStart));
+                gbStart = benchClock::now();
+            }
+        }
+    }
+
+    reportPass("read", gbSeconds, secondsSince(passStart), readBytes);
+
+    // single blocks all over the written content
+    std::vector<double> latencies;
+
+    passStart = benchClock::now();
+
+    for (unsigned int i = 0; i < options.randomReads && perFile > 0; i++)
+    {
+        uint64_t offset = rng() % (perFile / options.blockSize) * options.blockSize;
+        auto readStart = benchClock::now();
+
+        fs.readContent(filePath(rng() % options.files), offset, options.blockSize);
+        latencies.push_back(secondsSince(readStart) * 1e6);
+    }
+
+    if (!latencies.empty())
+    {
+        double seconds = secondsSince(passStart);
+
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << "random read: " << latencies.size() / seconds << " reads/s, latency p50 " << latencies[latencies.size() / 2]
+                  << "us, p99 " << latencies[latencies.size() * 99 / 100] << "us" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    benchOptions options = {"", 64 * GB, 4096, 8 * GB, 4, 20000, false};
+    int option;
+
+    while ((option = getopt(argc, argv, "s:b:w:f:r:kh")) != -1)
+    {
+        switch (option)
+        {
+        case 's':
+            options.diskSize = std::stoull(optarg) * GB;
+            break;
+        case 'b':
+            options.blockSize = std::stoul(optarg);
+            break;
+        case 'w':
+            options.writeSize = std::stoull(optarg) * GB;
+            break;
+        case 'f':
+            options.files = std::max(1ul, std::stoul(optarg));
+            break;
+        case 'r':
+            options.randomReads = std::stoul(optarg);
+            break;
+        case 'k':
+            options.keep = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    options.diskPath = argv[optind];
+
+    if (access(options.diskPath.c_str(), F_OK) == 0)
+    {
+        std::cerr << argv[0] << ": " << options.diskPath << " exists, the benchmark creates a new image" << std::endl;
+        return 1;
+    }
+
+    int result = 0;
+
+    try
+    {
+        runBench(options);
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        result = 1;
+    }
+
+    if (!options.keep)
+        remove(options.diskPath.c_str());
+
+    return result;
+}
@@ -0,0 +1,268 @@
+#include <afsd/client.h>
+
+#include <stdexcept>
+#include <algorithm>
+#include <system_error>
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+constexpr size_t RECEIVE_CHUNK = 64 * 1024;
+
+/**
+ * @brief connect to a server.
+ *
+ * @param socketPath the unix socket the server listens on.
+ */
+AfsdClient::AfsdClient(const std::string& socketPath):
+    m_fd(-1), m_nextId(0), m_inOffset(0)
+{
+    struct sockaddr_un addr = {};
+
+    if (socketPath.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("socket path too long");
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath.c_str());
+
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd == -1)
+        throw std::system_error(errno, std::generic_category(), "socket");
+
+    if (connect(m_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+    {
+        int error = errno;
+
+        close(m_fd);
+        throw std::system_error(error, std::generic_category(), "connect to " + socketPath);
+    }
+}
+
+AfsdClient::~AfsdClient()
+{
+    close(m_fd);
+}
+
+/**
+ * @brief queue a request, it is sent by the next flush.
+ *
+ * @return uint32_t the id of the request.
+ */
+uint32_t AfsdClient::submit(const uint8_t opcode, const std::string& payload)
+{
+    requestHeader header = {(uint32_t)payload.size(), m_nextId++, opcode};
+
+    if (payload.size() > AFSD_MAX_MESSAGE)
+        throw std::runtime_error("request too big");
+
+    m_out.append((const char*)&header, sizeof(header));
+    m_out.append(payload);
+    m_inFlight.push_back(header.id);
+
+    return header.id;
+}
+
+/**
+ * @brief send the queued requests.
+ */
+void AfsdClient::flush()
+{
+    size_t sent = 0;
+
+    while (sent < m_out.size())
+    {
+        ssize_t res = send(m_fd, m_out.data() + sent, m_out.size() - sent, MSG_NOSIGNAL);
+
+        if (res == -1 && errno == EINTR)
+            continue;
+
+        if (res == -1)
+            throw std::system_error(errno, std::generic_category(), "send");
+
+        sent += res;
+    }
+
+    m_out.clear();
+}
+
+/**
+ * @brief receive until at least size bytes that were not consumed are buffered.
+ */
+void AfsdClient::fill(const size_t size)
+{
+    // drop consumed replies once they are most of the buffer, pipelined replies may never leave it empty
+    if (m_inOffset > 0 && m_inOffset >= m_in.size() / 2)
+    {
+        m_in.erase(0, m_inOffset);
+        m_inOffset = 0;
+    }
+
+    while (m_in.size() - m_inOffset < size)
+    {
+        size_t used = m_in.size();
+
+        // queued requests go out before waiting for their replies
+        if (!m_out.empty())
+            flush();
+
+        m_in.resize(used + RECEIVE_CHUNK);
+        ssize_t res = recv(m_fd, &m_in[used], RECEIVE_CHUNK, 0);
+        m_in.resize(used + std::max<ssize_t>(res, 0));
+
+        if (res == -1 && errno == EINTR)
+            continue;
+
+        if (res == -1)
+            throw std::system_error(errno, std::generic_category(), "recv");
+
+        if (res == 0)
+            throw std::runtime_error("the server closed the connection");
+    }
+}
+
+/**
+ * @brief wait for the reply of the oldest request in flight, the queued
+ *        requests are sent first if it has not arrived yet.
+ */
+afsdReply AfsdClient::receive()
+{
+    replyHeader header;
+    afsdReply reply;
+
+    if (m_inFlight.empty())
+        throw std::runtime_error("no request in flight");
+
+    fill(sizeof(header));
+    memcpy(&header, m_in.data() + m_inOffset, sizeof(header));
+
+    if (header.length > AFSD_MAX_MESSAGE || header.id != m_inFlight.front())
+        throw std::runtime_error("bad reply from the server");
+
+    fill(sizeof(header) + header.length);
+
+    reply.id = header.id;
+    reply.status = header.status;
+    reply.payload = m_in.substr(m_inOffset + sizeof(header), header.length);
+
+    m_inOffset += sizeof(header) + header.length;
+    m_inFlight.pop_front();
+
+    return reply;
+}
+
+/**
+ * @brief send a request and wait for its reply, a failed request throws.
+ *
+ * @return std::string the payload of the reply.
+ */
+std::string AfsdClient::call(const uint8_t opcode, const std::string& payload)
+{
+    // replies come in order, the ones of earlier pipelined requests are dropped
+    uint32_t id = submit(opcode, payload);
+    afsdReply reply;
+
+    do
+        reply = receive();
+    while (reply.id != id);
+
+    if (reply.status == STATUS_BAD_REQUEST)
+        throw std::runtime_error("bad request: " + reply.payload);
+
+    if (reply.status != STATUS_OK)
+        throw std::runtime_error(reply.payload);
+
+    return reply.payload;
+}
+
+void AfsdClient::ping()
+{
+    call(OP_PING, "");
+}
+
+void AfsdClient::createFile(const std::string& path, const bool isDir)
+{
+    call(OP_CREATE, MessageWriter().putPath(path).putUint8(isDir).getData());
+}
+
+void AfsdClient::deleteFile(const std::string& path)
+{
+    call(OP_DELETE, MessageWriter().putPath(path).getData());
+}
+
+void AfsdClient::appendContent(const std::string& path, const std::string& content)
+{
+    call(OP_APPEND, MessageWriter().putPath(path).putContent(content).getData());
+}
+
+std::string AfsdClient::getContent(const std::string& path)
+{
+    std::string payload = call(OP_GET, MessageWriter().putPath(path).getData());
+
+    return MessageReader(payload.data(), payload.size()).getContent();
+}
+
+std::string AfsdClient::readContent(const std::string& path, const uint64_t offset, const uint32_t size)
+{
+    std::string payload = call(OP_READ, MessageWriter().putPath(path).putUint64(offset).putUint32(size).getData());
+
+    return MessageReader(payload.data(), payload.size()).getContent();
+}
+
+dirList AfsdClient::listDir(const std::string& path)
+{
+    std::string payload = call(OP_LIST, MessageWriter().putPath(path).getData());
+    MessageReader reader(payload.data(), payload.size());
+    uint32_t amount = reader.getUint32();
+    dirList list;
+
+    for (uint32_t i = 0; i < amount; i++)
+    {
+        std::string name = reader.getPath();
+        uint64_t size = reader.getUint64();
+        bool isDir = reader.getUint8();
+
+        name.resize(NAME_MAX_LEN, '\0');
+        list.emplace_back(&name[0], size, isDir);
+    }
+
+    return list;
+}
+
+void AfsdClient::rename(const std::string& srcPath, const std::string& dstPath)
+{
+    call(OP_RENAME, MessageWriter().putPath(srcPath).putPath(dstPath).getData());
+}
+
+void AfsdClient::clone(const std::string& srcPath, const std::string& dstPath)
+{
+    call(OP_CLONE, MessageWriter().putPath(srcPath).putPath(dstPath).getData());
+}
+
+void AfsdClient::truncate(const std::string& path, const uint64_t size)
+{
+    call(OP_TRUNCATE, MessageWriter().putPath(path).putUint64(size).getData());
+}
+
+void AfsdClient::punchHole(const std::string& path, const uint64_t offset, const uint64_t length)
+{
+    call(OP_PUNCH, MessageWriter().putPath(path).putUint64(offset).putUint64(length).getData());
+}
+
+fsStats AfsdClient::statfs()
+{
+    std::string payload = call(OP_STATFS, "");
+    MessageReader reader(payload.data(), payload.size());
+    fsStats stats;
+
+    stats.blockSize = reader.getUint32();
+    stats.totalBlocks = reader.getUint32();
+    stats.freeBlocks = reader.getUint32();
+    stats.totalInodes = reader.getUint32();
+    stats.freeInodes = reader.getUint32();
+
+    return stats;
+}
@@ -0,0 +1,99 @@
+#include <afsd/protocol.h>
+
+#include <stdexcept>
+
+#include <cstring>
+
+MessageWriter& MessageWriter::putUint8(const uint8_t value)
+{
+    m_data.push_back((char)value);
+    return *this;
+}
+
+MessageWriter& MessageWriter::putUint32(const uint32_t value)
+{
+    m_data.append((const char*)&value, sizeof(value));
+    return *this;
+}
+
+MessageWriter& MessageWriter::putUint64(const uint64_t value)
+{
+    m_data.append((const char*)&value, sizeof(value));
+    return *this;
+}
+
+MessageWriter& MessageWriter::putPath(const std::string& path)
+{
+    if (path.size() > UINT16_MAX)
+        throw std::runtime_error("path too long");
+
+    uint16_t length = path.size();
+
+    m_data.append((const char*)&length, sizeof(length));
+    m_data.append(path);
+    return *this;
+}
+
+MessageWriter& MessageWriter::putContent(const std::string& content)
+{
+    putUint32(content.size());
+    m_data.append(content);
+    return *this;
+}
+
+MessageReader::MessageReader(const char* data, const size_t size):
+    m_data(data), m_size(size), m_offset(0)
+{
+}
+
+/**
+ * @brief consume bytes of the payload.
+ *
+ * @return const char* the first consumed byte.
+ */
+const char* MessageReader::take(const size_t size)
+{
+    if (size > m_size - m_offset)
+        throw std::out_of_range("truncated message");
+
+    const char* data = m_data + m_offset;
+
+    m_offset += size;
+    return data;
+}
+
+uint8_t MessageReader::getUint8()
+{
+    return *take(1);
+}
+
+uint32_t MessageReader::getUint32()
+{
+    uint32_t value;
+
+    memcpy(&value, take(sizeof(value)), sizeof(value));
+    return value;
+}
+
+uint64_t MessageReader::getUint64()
+{
+    uint64_t value;
+
+    memcpy(&value, take(sizeof(value)), sizeof(value));
+    return value;
+}
+
+std::string MessageReader::getPath()
+{
+    uint16_t length;
+
+    memcpy(&length, take(sizeof(length)), sizeof(length));
+    return std::string(take(length), length);
+}
+
+std::string MessageReader::getContent()
+{
+    uint32_t length = getUint32();
+
+    return std::string(take(length), length);
+}
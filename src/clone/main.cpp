@@ -0,0 +1,65 @@
+#include <afs/imageCloner.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <stdexcept>
+
+#include <unistd.h>
+
+static void usage(const char* program)
+{
+    std::cerr << "usage: " << program << " [-i] [-j threads] <disk file> <copy>" << std::endl
+              << "  -i  update an existing copy with the blocks written since it was made" << std::endl
+              << "  -j  amount of copying threads (default: one per CPU)" << std::endl
+              << "  only the blocks in use are copied, the copy is a sparse file" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    bool incremental = false;
+    unsigned int threads = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "ij:h")) != -1)
+    {
+        switch (option)
+        {
+        case 'i':
+            incremental = true;
+            break;
+        case 'j':
+            threads = std::stoul(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        auto start = std::chrono::steady_clock::now();
+        ImageCloner cloner(argv[optind], threads);
+        cloneReport report = incremental ? cloner.update(argv[optind + 1]) : cloner.clone(argv[optind + 1]);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << std::fixed << std::setprecision(1) << report.blocksCopied << " blocks copied ("
+                  << report.bytesCopied / (double)(1 << 20) << " MB), " << report.blocksDiscarded << " free blocks released, "
+                  << std::setprecision(2) << elapsed.count() << "s" << std::endl;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <afsd/server.h>
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <stdexcept>
+
+#include <csignal>
+
+#include <unistd.h>
+
+static Server* g_server = nullptr;
+
+static void usage(const char* program)
+{
+    std::cerr << "usage: " << program << " [-s socket] [-j workers] <disk file> [<block size> <blocks amount>]" << std::endl
+              << "  -s  unix socket to listen on (default: <disk file>.sock)" << std::endl
+              << "  -j  amount of workers running requests (default: one per CPU)" << std::endl;
+}
+
+static void onSignal(int)
+{
+    if (g_server)
+        g_server->stop();
+}
+
+int main(int argc, char* argv[])
+{
+    std::string socketPath;
+    unsigned int workers = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:j:h")) != -1)
+    {
+        switch (option)
+        {
+        case 's':
+            socketPath = optarg;
+            break;
+        case 'j':
+            workers = std::stoul(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    int positional = argc - optind;
+
+    if (positional != 1 && positional != 3)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (socketPath.empty())
+        socketPath = std::string(argv[optind]) + ".sock";
+
+    try
+    {
+        std::unique_ptr<FileSystem> fs(positional == 1 ? new FileSystem(argv[optind])
+                                                       : new FileSystem(argv[optind], std::stoi(argv[optind + 1]), std::stoi(argv[optind + 2])));
+
+        {
+            Server server(fs.get(), socketPath, workers);
+
+            g_server = &server;
+            signal(SIGINT, onSignal);
+            signal(SIGTERM, onSignal);
+            signal(SIGPIPE, SIG_IGN);
+
+            std::cout << "serving " << argv[optind] << " on " << socketPath << std::endl;
+            server.run();
+
+            g_server = nullptr;
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,585 @@
+#include <afsd/server.h>
+
+#include <stdexcept>
+#include <system_error>
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+constexpr int MAX_EVENTS = 64;
+constexpr size_t RECEIVE_CHUNK = 64 * 1024;
+constexpr size_t MAX_RECEIVE_PER_EVENT = 1 << 20;
+constexpr size_t MAX_QUEUED_REQUESTS = 4096; // a connection is not read while this many requests wait
+constexpr size_t REPLY_CHUNK = 64 * 1024; // replies a worker collects before it hands them to the loop
+
+/**
+ * @brief listen on a unix socket, a stale socket file is replaced.
+ *
+ * @param fs the file system to serve, it must outlive the server.
+ * @param socketPath the path of the socket.
+ * @param workers the amount of workers running requests, 0 for one per CPU.
+ */
+Server::Server(FileSystem* fs, const std::string& socketPath, const unsigned int workers):
+    m_fs(fs), m_socketPath(socketPath), m_listenFd(-1), m_epollFd(-1), m_wakeFd(-1), m_pool(workers), m_stopping(false)
+{
+    struct sockaddr_un addr = {};
+    struct stat st;
+    struct epoll_event event = {};
+
+    if (socketPath.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("socket path too long");
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath.c_str());
+
+    if (stat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(socketPath.c_str());
+
+    m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (m_listenFd == -1 || m_epollFd == -1 || m_wakeFd == -1)
+    {
+        int error = errno;
+
+        closeSockets();
+        throw std::system_error(error, std::generic_category(), "create the server");
+    }
+
+    if (bind(m_listenFd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(m_listenFd, SOMAXCONN) == -1)
+    {
+        int error = errno;
+
+        closeSockets();
+        throw std::system_error(error, std::generic_category(), "listen on " + socketPath);
+    }
+
+    // the listening socket and the wake up event are told apart from connections by their pointers
+    event.events = EPOLLIN;
+    event.data.ptr = &m_listenFd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &event);
+
+    event.data.ptr = &m_wakeFd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &event);
+}
+
+Server::~Server()
+{
+    m_pool.wait();
+
+    for (auto& entry : m_connections)
+    {
+        close(entry.second->fd);
+        delete entry.second;
+    }
+
+    m_connections.clear();
+    closeSockets();
+}
+
+void Server::closeSockets()
+{
+    if (m_listenFd != -1)
+    {
+        close(m_listenFd);
+        unlink(m_socketPath.c_str());
+    }
+
+    if (m_epollFd != -1)
+        close(m_epollFd);
+
+    if (m_wakeFd != -1)
+        close(m_wakeFd);
+
+    m_listenFd = m_epollFd = m_wakeFd = -1;
+}
+
+/**
+ * @brief serve clients until stop is called.
+ */
+void Server::run()
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!m_stopping)
+    {
+        int amount = epoll_wait(m_epollFd, events, MAX_EVENTS, -1);
+
+        if (amount == -1 && errno == EINTR)
+            continue;
+
+        if (amount == -1)
+            throw std::system_error(errno, std::generic_category(), "epoll_wait");
+
+        for (int i = 0; i < amount; i++)
+        {
+            if (events[i].data.ptr == &m_listenFd)
+                acceptClients();
+
+            else if (events[i].data.ptr == &m_wakeFd)
+                handleFinished();
+
+            else
+            {
+                connection* conn = (connection*)events[i].data.ptr;
+
+                if (conn->closing)
+                    continue;
+
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                    readRequests(conn);
+
+                if (!conn->closing && (events[i].events & EPOLLOUT))
+                    writeReplies(conn);
+
+                if (!conn->closing)
+                    updateEvents(conn);
+            }
+        }
+
+        // connections are deleted after the events that may still point to them
+        for (size_t i = 0; i < m_closed.size();)
+        {
+            connection* conn = m_closed[i];
+
+            if (conn->busy)
+            {
+                i++;
+                continue;
+            }
+
+            m_connections.erase(conn->fd);
+            close(conn->fd);
+            delete conn;
+
+            m_closed[i] = m_closed.back();
+            m_closed.pop_back();
+        }
+    }
+}
+
+/**
+ * @brief make run return, safe to call from a signal handler.
+ */
+void Server::stop()
+{
+    uint64_t one = 1;
+
+    m_stopping = true;
+    (void)!write(m_wakeFd, &one, sizeof(one));
+}
+
+void Server::acceptClients()
+{
+    int fd;
+
+    while ((fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        connection* conn = new connection{fd, "", {}, "", 0, EPOLLIN, false, false};
+        struct epoll_event event = {};
+
+        event.events = conn->events;
+        event.data.ptr = conn;
+
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) == -1)
+        {
+            close(fd);
+            delete conn;
+            continue;
+        }
+
+        m_connections[fd] = conn;
+    }
+}
+
+/**
+ * @brief receive what the client sent and queue its whole requests for a worker.
+ */
+void Server::readRequests(connection* conn)
+{
+    std::vector<std::string> requests;
+    size_t offset = 0, received = 0;
+    char buffer[RECEIVE_CHUNK];
+
+    // a client that keeps sending does not hold the loop, the rest is read on the next event
+    while (received < MAX_RECEIVE_PER_EVENT)
+    {
+        ssize_t res = recv(conn->fd, buffer, sizeof(buffer), 0);
+
+        if (res > 0)
+        {
+            conn->in.append(buffer, res);
+            received += res;
+            continue;
+        }
+
+        if (res == -1 && errno == EINTR)
+            continue;
+
+        if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        closeConnection(conn);
+        return;
+    }
+
+    while (conn->in.size() - offset >= sizeof(requestHeader))
+    {
+        requestHeader header;
+
+        memcpy(&header, conn->in.data() + offset, sizeof(header));
+
+        if (header.length > AFSD_MAX_MESSAGE)
+        {
+            closeConnection(conn);
+            return;
+        }
+
+        if (conn->in.size() - offset < sizeof(header) + header.length)
+            break;
+
+        requests.push_back(conn->in.substr(offset, sizeof(header) + header.length));
+        offset += sizeof(header) + header.length;
+    }
+
+    conn->in.erase(0, offset);
+
+    if (requests.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (std::string& request : requests)
+        conn->queued.push_back(std::move(request));
+
+    startBatch(conn);
+}
+
+/**
+ * @brief send as much of the waiting replies as the socket takes.
+ */
+void Server::writeReplies(connection* conn)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    while (conn->outOffset < conn->out.size())
+    {
+        ssize_t res = send(conn->fd, conn->out.data() + conn->outOffset, conn->out.size() - conn->outOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (res == -1 && errno == EINTR)
+            continue;
+
+        if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        if (res == -1)
+        {
+            lock.unlock();
+            closeConnection(conn);
+            return;
+        }
+
+        conn->outOffset += res;
+    }
+
+    if (conn->outOffset == conn->out.size())
+    {
+        conn->out.clear();
+        conn->outOffset = 0;
+    }
+
+    // a batch that stopped on the output limit goes on once the client took enough of it
+    startBatch(conn);
+}
+
+/**
+ * @brief wait for output only while replies are waiting and stop reading a
+ *        client that does not take its replies or sends too much.
+ */
+void Server::updateEvents(connection* conn)
+{
+    uint32_t events = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        if (conn->out.size() - conn->outOffset < MAX_QUEUED_OUTPUT && conn->queued.size() < MAX_QUEUED_REQUESTS)
+            events |= EPOLLIN;
+
+        if (conn->outOffset < conn->out.size())
+            events |= EPOLLOUT;
+    }
+
+    if (events != conn->events)
+    {
+        struct epoll_event event = {};
+
+        event.events = events;
+        event.data.ptr = conn;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->events = events;
+    }
+}
+
+/**
+ * @brief stop serving a connection, it is deleted once no worker uses it.
+ */
+void Server::closeConnection(connection* conn)
+{
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    conn->closing = true;
+    m_closed.push_back(conn);
+}
+
+/**
+ * @brief send the replies the workers added and start the requests that arrived
+ *        meanwhile on the connections whose batch finished.
+ */
+void Server::handleFinished()
+{
+    std::vector<connection*> replied, finished;
+    uint64_t value;
+
+    (void)!read(m_wakeFd, &value, sizeof(value));
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        replied.swap(m_replied);
+        finished.swap(m_finished);
+    }
+
+    // a connection is not deleted before its batch finished, so the replied ones are all still there
+    for (connection* conn : replied)
+    {
+        if (!conn->closing)
+            writeReplies(conn);
+
+        if (!conn->closing)
+            updateEvents(conn);
+    }
+
+    for (connection* conn : finished)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            conn->busy = false;
+        }
+
+        if (!conn->closing)
+            writeReplies(conn);
+
+        if (!conn->closing)
+            updateEvents(conn);
+    }
+}
+
+/**
+ * @brief run the queued requests of a connection on a worker, unless one runs
+ *        them already or the client has too many replies to take (m_lock held).
+ */
+void Server::startBatch(connection* conn)
+{
+    if (conn->busy || conn->closing || conn->queued.empty() || conn->out.size() - conn->outOffset >= MAX_QUEUED_OUTPUT)
+        return;
+
+    conn->busy = true;
+    m_pool.submit([this, conn]() { runBatch(conn); });
+}
+
+/**
+ * @brief run the queued requests of a connection in order (on a worker).
+ *
+ * The replies go to the loop every REPLY_CHUNK bytes, and the batch stops once
+ * MAX_QUEUED_OUTPUT bytes wait to be sent. The requests left are run when the
+ * client took its replies, so a client that reads slowly does not grow the output.
+ */
+void Server::runBatch(connection* conn)
+{
+    std::string replies;
+    uint64_t one = 1;
+
+    for (;;)
+    {
+        std::string request;
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+
+            if (conn->queued.empty() || conn->out.size() - conn->outOffset + replies.size() >= MAX_QUEUED_OUTPUT)
+                break;
+
+            request = std::move(conn->queued.front());
+            conn->queued.pop_front();
+        }
+
+        replies += execute(request.data(), request.size());
+
+        if (replies.size() >= REPLY_CHUNK)
+            addReplies(conn, replies);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        conn->out += replies;
+        m_finished.push_back(conn);
+    }
+
+    (void)!write(m_wakeFd, &one, sizeof(one));
+}
+
+/**
+ * @brief hand replies of a running batch to the loop to send.
+ */
+void Server::addReplies(connection* conn, std::string& replies)
+{
+    uint64_t one = 1;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        conn->out += replies;
+        m_replied.push_back(conn);
+    }
+
+    replies.clear();
+    (void)!write(m_wakeFd, &one, sizeof(one));
+}
+
+/**
+ * @brief run one request on the file system.
+ *
+ * @param request the header and the payload of the request.
+ * @param size the size of the request.
+ * @return std::string the header and the payload of the reply.
+ */
+std::string Server::execute(const char* request, const size_t size)
+{
+    requestHeader header;
+    replyHeader reply = {0, 0, STATUS_OK};
+    MessageWriter result;
+    std::string error;
+
+    memcpy(&header, request, sizeof(header));
+    reply.id = header.id;
+
+    try
+    {
+        MessageReader reader(request + sizeof(header), size - sizeof(header));
+
+        switch (header.opcode)
+        {
+        case OP_PING:
+            break;
+
+        case OP_CREATE:
+        {
+            std::string path = reader.getPath();
+            m_fs->createFile(path, reader.getUint8());
+            break;
+        }
+
+        case OP_DELETE:
+            m_fs->deleteFile(reader.getPath());
+            break;
+
+        case OP_APPEND:
+        {
+            std::string path = reader.getPath();
+            m_fs->appendContent(path, reader.getContent());
+            break;
+        }
+
+        case OP_GET:
+            result.putContent(m_fs->getContent(reader.getPath()));
+            break;
+
+        case OP_READ:
+        {
+            std::string path = reader.getPath();
+            uint64_t offset = reader.getUint64();
+            result.putContent(m_fs->readContent(path, offset, reader.getUint32()));
+            break;
+        }
+
+        case OP_LIST:
+        {
+            dirList list = m_fs->listDir(reader.getPath());
+
+            result.putUint32(list.size());
+            for (const dirListEntry& entry : list)
+                result.putPath(std::string(entry.name, strnlen(entry.name, NAME_MAX_LEN))).putUint64(entry.fileSize).putUint8(entry.isDirectory);
+            break;
+        }
+
+        case OP_RENAME:
+        {
+            std::string srcPath = reader.getPath();
+            m_fs->rename(srcPath, reader.getPath());
+            break;
+        }
+
+        case OP_CLONE:
+        {
+            std::string srcPath = reader.getPath();
+            m_fs->clone(srcPath, reader.getPath());
+            break;
+        }
+
+        case OP_TRUNCATE:
+        {
+            std::string path = reader.getPath();
+            m_fs->truncate(path, reader.getUint64());
+            break;
+        }
+
+        case OP_PUNCH:
+        {
+            std::string path = reader.getPath();
+            uint64_t offset = reader.getUint64();
+            m_fs->punchHole(path, offset, reader.getUint64());
+            break;
+        }
+
+        case OP_STATFS:
+        {
+            fsStats stats = m_fs->statfs();
+
+            result.putUint32(stats.blockSize).putUint32(stats.totalBlocks).putUint32(stats.freeBlocks)
+                  .putUint32(stats.totalInodes).putUint32(stats.freeInodes);
+            break;
+        }
+
+        default:
+            reply.status = STATUS_BAD_REQUEST;
+            error = "unknown opcode " + std::to_string(header.opcode);
+        }
+    }
+    catch (const std::out_of_range& e)
+    {
+        reply.status = STATUS_BAD_REQUEST;
+        error = e.what();
+    }
+    catch (const std::exception& e)
+    {
+        reply.status = STATUS_ERROR;
+        error = e.what();
+    }
+
+    const std::string& payload = reply.status == STATUS_OK ? result.getData() : error;
+    std::string message;
+
+    reply.length = payload.size();
+    message.reserve(sizeof(reply) + payload.size());
+    message.append((const char*)&reply, sizeof(reply));
+    message.append(payload);
+
+    return message;
+}
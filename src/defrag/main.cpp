@@ -0,0 +1,120 @@
+#include <afs/fs.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+
+static void usage(const char* program)
+{
+    std::cerr << "usage: " << program << " [-n] [-r MB] <disk file> [<path>...]" << std::endl
+              << "  -n  only report the fragmentation of the files" << std::endl
+              << "  -r  most MB moved per second (default: no limit)" << std::endl
+              << "  the files under every path are defragmented (default: /)" << std::endl;
+}
+
+/**
+ * @brief collect the files under a path, the path itself if it is a file.
+ */
+static std::vector<std::string> findFiles(FileSystem& fs, const std::string& path)
+{
+    std::vector<std::string> files;
+    std::mutex filesLock;
+
+    fs.walk(path, [&](const walkEntry& entry)
+    {
+        if (!(entry.node.flags & DIRTYPE))
+        {
+            std::lock_guard<std::mutex> lock(filesLock);
+            files.push_back(entry.path);
+        }
+
+        return true;
+    });
+
+    std::sort(files.begin(), files.end());
+
+    return files;
+}
+
+int main(int argc, char* argv[])
+{
+    bool reportOnly = false;
+    uint64_t bytesPerSecond = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "nr:h")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            reportOnly = true;
+            break;
+        case 'r':
+            bytesPerSecond = std::stoull(optarg) << 20;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> paths(argv + optind + 1, argv + argc);
+    uint64_t files = 0, fragmented = 0, blocks = 0, runsBefore = 0, runsAfter = 0;
+
+    if (paths.empty())
+        paths.push_back("/");
+
+    try
+    {
+        FileSystem fs(argv[optind]);
+
+        for (const std::string& path : paths)
+        {
+            for (const std::string& file : findFiles(fs, path))
+            {
+                fragmentationInfo before = fs.getFragmentation(file), after = before;
+
+                if (before.runs > 1 && !reportOnly)
+                    after = fs.defragment(file, bytesPerSecond);
+
+                if (before.runs > 1)
+                {
+                    std::cout << file << ": " << before.blocks << " blocks, " << before.runs << " runs";
+                    if (!reportOnly)
+                        std::cout << " -> " << after.runs;
+                    std::cout << std::endl;
+
+                    fragmented++;
+                }
+
+                files++;
+                blocks += before.blocks;
+                runsBefore += before.runs;
+                runsAfter += after.runs;
+            }
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << files << " files, " << fragmented << " fragmented, " << blocks << " blocks in " << runsBefore << " runs";
+    if (!reportOnly)
+        std::cout << ", " << runsAfter << " runs after";
+    std::cout << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <afs/checker.h>
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+
+#include <unistd.h>
+
+// exit codes, the same as e2fsck
+constexpr int FSCK_OK = 0;
+constexpr int FSCK_REPAIRED = 1;
+constexpr int FSCK_ERRORS_LEFT = 4;
+constexpr int FSCK_FAILED = 8;
+
+static void usage(const char* program)
+{
+    std::cerr << "usage: " << program << " [-r] [-c] [-j threads] <disk file>" << std::endl
+              << "  -r  rebuild the blocks table, free space counters, reference counts and inode state" << std::endl
+              << "  -c  verify the checksum of every block" << std::endl
+              << "  -j  amount of checking threads (default: one per CPU)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    bool repair = false, verifyChecksums = false;
+    unsigned int threads = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "rcj:h")) != -1)
+    {
+        switch (option)
+        {
+        case 'r':
+            repair = true;
+            break;
+        case 'c':
+            verifyChecksums = true;
+            break;
+        case 'j':
+            threads = std::stoul(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return FSCK_FAILED;
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return FSCK_FAILED;
+    }
+
+    try
+    {
+        auto start = std::chrono::steady_clock::now();
+        Checker checker(argv[optind], threads);
+        fsckReport report = checker.check(repair, verifyChecksums);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        for (const std::string& error : report.errors)
+            std::cout << error << std::endl;
+
+        if (report.errorsAmount > report.errors.size())
+            std::cout << "... and " << report.errorsAmount - report.errors.size() << " more errors" << std::endl;
+
+        std::cout << argv[optind] << ": " << report.directories << " directories, " << report.files << " files, " << report.orphans << " orphans, "
+                  << report.usedBlocks << " blocks used, " << report.leakedBlocks << " leaked";
+        if (verifyChecksums)
+            std::cout << ", " << report.badChecksums << " bad checksums";
+        std::cout << " (" << elapsed.count() << "s)" << std::endl;
+
+        if (report.errorsAmount == 0)
+            return FSCK_OK;
+
+        if (report.repaired)
+            std::cout << report.errorsAmount - report.unrepaired << " errors repaired" << std::endl;
+
+        if (!repair || report.unrepaired > 0)
+        {
+            std::cout << (repair ? report.unrepaired : report.errorsAmount) << " errors left" << std::endl;
+            return FSCK_ERRORS_LEFT;
+        }
+
+        return FSCK_REPAIRED;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return FSCK_FAILED;
+    }
+}
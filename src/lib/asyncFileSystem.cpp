@@ -0,0 +1,244 @@
+#include <afs/asyncFileSystem.h>
+#include <afs/helper.h>
+
+#include <memory>
+
+/**
+ * @brief write a path the way the queues know it, "/a//b/", "a/b" and "/a/b" are the same file.
+ */
+static std::string normalizePath(const std::string& path)
+{
+    std::string normalized;
+
+    for (const std::string& part : Helper::splitString(path))
+    {
+        if (part != "/")
+            normalized += "/" + part;
+    }
+
+    return normalized.empty() ? "/" : normalized;
+}
+
+/**
+ * @brief start the workers, the file system must stay open until the object is destroyed.
+ *
+ * @param fs The file system the operations run on.
+ * @param threads The amount of workers, 0 for one per hardware thread.
+ */
+AsyncFileSystem::AsyncFileSystem(FileSystem* fs, const unsigned int threads):
+    m_fs(fs), m_pool(threads), m_batchWrites(0), m_activeWrites(0)
+{
+}
+
+AsyncFileSystem::~AsyncFileSystem()
+{
+    m_pool.wait();
+}
+
+/**
+ * @brief queue an operation on a file.
+ *
+ * @param path The normalized path of the file.
+ * @return std::future<T> The result of the operation, or the exception it threw.
+ */
+template <typename T>
+std::future<T> AsyncFileSystem::submit(const std::string& path, std::function<T()> operation)
+{
+    std::shared_ptr<std::packaged_task<T()>> task = std::make_shared<std::packaged_task<T()>>(std::move(operation));
+    std::future<T> result = task->get_future();
+
+    enqueue(path, [task]() { (*task)(); });
+
+    return result;
+}
+
+void AsyncFileSystem::enqueue(const std::string& path, std::function<void()> operation)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    pathAlias& alias = m_aliases[path];
+
+    alias.operations++;
+
+    // the path keeps its queue while it has operations, even if the file is deleted or created in between
+    if (!alias.key.empty())
+    {
+        fileQueue& queue = m_queues[alias.key];
+
+        queue.operations.push_back({path, std::move(operation)});
+        scheduleQueue(alias.key, queue);
+        return;
+    }
+
+    alias.unresolved.push_back({path, std::move(operation)});
+
+    if (alias.unresolved.size() == 1)
+        m_pool.submit([this, path]() { resolvePath(path); });
+}
+
+/**
+ * @brief find the queue of a path on a worker, so the submitting thread does not wait for
+ *        the file system. The operations submitted meanwhile move to the queue in their order.
+ */
+void AsyncFileSystem::resolvePath(const std::string& path)
+{
+    std::string key = path;
+
+    try
+    {
+        key = "#" + std::to_string(m_fs->getInodeIndex(path));
+    }
+    catch (std::exception&) {}
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    pathAlias& alias = m_aliases[path];
+    fileQueue& queue = m_queues[key];
+
+    for (queuedOperation& operation : alias.unresolved)
+        queue.operations.push_back(std::move(operation));
+
+    alias.unresolved.clear();
+    alias.key = key;
+    scheduleQueue(key, queue);
+}
+
+/**
+ * @brief start a run of a queue unless a worker already runs it, m_lock must be held.
+ */
+void AsyncFileSystem::scheduleQueue(const std::string& key, fileQueue& queue)
+{
+    if (!queue.busy)
+    {
+        queue.busy = true;
+        m_pool.submit([this, key]() { runQueue(key); });
+    }
+}
+
+/**
+ * @brief run the operations queued on a file until none is left. The file is
+ *        forgotten once its queue is empty, the next operation queues a new run,
+ *        and a path once none of its operations is left.
+ */
+void AsyncFileSystem::runQueue(const std::string& key)
+{
+    std::deque<queuedOperation> operations;
+
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            std::unordered_map<std::string, fileQueue>::iterator queue = m_queues.find(key);
+
+            for (const queuedOperation& operation : operations)
+            {
+                std::unordered_map<std::string, pathAlias>::iterator alias = m_aliases.find(operation.path);
+
+                if (--alias->second.operations == 0)
+                    m_aliases.erase(alias);
+            }
+
+            operations.clear();
+
+            if (queue->second.operations.empty())
+            {
+                m_queues.erase(queue);
+                return;
+            }
+
+            operations.swap(queue->second.operations);
+        }
+
+        for (queuedOperation& operation : operations)
+            operation.run();
+    }
+}
+
+/**
+ * @brief run a write in the batch of the writes that run at the same time. The batch
+ *        ends with the last of them, or once it is full so the disk is not left in the
+ *        middle of a batch under a steady load of writes.
+ */
+void AsyncFileSystem::runBatched(const std::function<void()>& write)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_batchLock);
+
+        m_batchEnded.wait(lock, [this] { return m_batchWrites < MAX_BATCHED_WRITES; });
+
+        if (m_batchWrites == 0)
+            m_fs->beginWriteBatch();
+
+        m_batchWrites++;
+        m_activeWrites++;
+    }
+
+    try
+    {
+        write();
+    }
+    catch (std::exception&)
+    {
+        leaveBatch();
+        throw;
+    }
+
+    leaveBatch();
+}
+
+void AsyncFileSystem::leaveBatch()
+{
+    std::lock_guard<std::mutex> lock(m_batchLock);
+
+    if (--m_activeWrites == 0)
+    {
+        m_batchWrites = 0;
+        m_fs->endWriteBatch();
+        m_batchEnded.notify_all();
+    }
+}
+
+std::future<void> AsyncFileSystem::createFile(const std::string& path, const bool isDir)
+{
+    std::string normalized = normalizePath(path);
+
+    return submit<void>(normalized, [this, normalized, isDir]() { runBatched([&]() { m_fs->createFile(normalized, isDir); }); });
+}
+
+std::future<void> AsyncFileSystem::appendContent(const std::string& filePath, std::string content)
+{
+    std::string normalized = normalizePath(filePath);
+    std::shared_ptr<std::string> shared = std::make_shared<std::string>(std::move(content));
+
+    return submit<void>(normalized, [this, normalized, shared]()
+    {
+        runBatched([&]() { m_fs->appendContent(normalized, std::move(*shared)); });
+    });
+}
+
+std::future<void> AsyncFileSystem::deleteFile(const std::string& filePath)
+{
+    std::string normalized = normalizePath(filePath);
+
+    return submit<void>(normalized, [this, normalized]() { runBatched([&]() { m_fs->deleteFile(normalized); }); });
+}
+
+std::future<std::string> AsyncFileSystem::getContent(const std::string& filePath)
+{
+    std::string normalized = normalizePath(filePath);
+
+    return submit<std::string>(normalized, [this, normalized]() { return m_fs->getContent(normalized); });
+}
+
+std::future<dirList> AsyncFileSystem::listDir(const std::string& dirPath)
+{
+    std::string normalized = normalizePath(dirPath);
+
+    return submit<dirList>(normalized, [this, normalized]() { return m_fs->listDir(normalized); });
+}
+
+/**
+ * @brief wait until all the submitted operations are done.
+ */
+void AsyncFileSystem::wait()
+{
+    m_pool.wait();
+}
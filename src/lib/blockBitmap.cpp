@@ -0,0 +1,59 @@
+#include <afs/blockBitmap.h>
+
+constexpr uint32_t PAGE_WORDS = BITMAP_PAGE_BLOCKS / 64;
+
+BlockBitmap::BlockBitmap(const uint32_t nblocks):
+    m_pages((nblocks + BITMAP_PAGE_BLOCKS - 1) / BITMAP_PAGE_BLOCKS), m_map(new std::atomic<std::atomic<uint64_t>*>[m_pages]())
+{
+}
+
+BlockBitmap::~BlockBitmap()
+{
+    for (uint32_t i = 0; i < m_pages; i++)
+        delete[] m_map[i].load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Get the page of the bit of a block, it is allocated if it was not used yet.
+ */
+std::atomic<uint64_t>* BlockBitmap::getPage(const uint32_t blockNum)
+{
+    std::atomic<std::atomic<uint64_t>*>& entry = m_map[blockNum / BITMAP_PAGE_BLOCKS];
+    std::atomic<uint64_t>* page = entry.load(std::memory_order_acquire);
+
+    if (page)
+        return page;
+
+    // two threads may allocate the page at once, the second one uses the page of the first
+    std::atomic<uint64_t>* allocated = new std::atomic<uint64_t>[PAGE_WORDS]();
+
+    if (entry.compare_exchange_strong(page, allocated, std::memory_order_acq_rel))
+        return allocated;
+
+    delete[] allocated;
+    return page;
+}
+
+bool BlockBitmap::test(const uint32_t blockNum) const
+{
+    std::atomic<uint64_t>* page = m_map[blockNum / BITMAP_PAGE_BLOCKS].load(std::memory_order_acquire);
+
+    if (!page)
+        return false;
+
+    return page[blockNum % BITMAP_PAGE_BLOCKS / 64].load(std::memory_order_acquire) & ((uint64_t)1 << blockNum % 64);
+}
+
+void BlockBitmap::set(const uint32_t blockNum)
+{
+    getPage(blockNum)[blockNum % BITMAP_PAGE_BLOCKS / 64].fetch_or((uint64_t)1 << blockNum % 64, std::memory_order_acq_rel);
+}
+
+void BlockBitmap::reset(const uint32_t blockNum)
+{
+    std::atomic<uint64_t>* page = m_map[blockNum / BITMAP_PAGE_BLOCKS].load(std::memory_order_acquire);
+
+    // a bit of a page that was never allocated is clear already
+    if (page)
+        page[blockNum % BITMAP_PAGE_BLOCKS / 64].fetch_and(~((uint64_t)1 << blockNum % 64), std::memory_order_acq_rel);
+}
@@ -0,0 +1,277 @@
+#include <afs/blockMap.h>
+#include <afs/helper.h>
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <cstring>
+
+BlockMap::BlockMap(Disk* disk, BlocksTable* dblocksTable, const address firstAddr):
+    m_disk(disk), m_dblocksTable(dblocksTable), m_firstAddr(firstAddr), m_cursorIndex(0), m_cursorAddr(firstAddr)
+{
+}
+
+uint32_t BlockMap::getEntriesPerBlock() const
+{
+    return (m_disk->getBlockSize() - sizeof(address)) / sizeof(address);
+}
+
+/**
+ * @brief Get the address of a map block by its index in the chain.
+ * 
+ * @param mapIndex The index of the map block.
+ * @param create Whether to reserve the missing map blocks.
+ * 
+ * @return address The address of the map block, 0 if it does not exist.
+ */
+address BlockMap::getMapBlock(const uint32_t mapIndex, const bool create)
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+
+    if (m_firstAddr == (address)-1)
+    {
+        if (!create)
+            return 0;
+
+        unsigned int mapBlock = m_dblocksTable->getFreeBlock();
+        std::vector<char> reset(blockSize, 0);
+
+        m_dblocksTable->reserveDBlock(mapBlock);
+        m_firstAddr = Helper::blockToAddr(blockSize, mapBlock);
+        m_disk->write(m_firstAddr, blockSize, reset.data());
+    }
+
+    if (m_cursorAddr == (address)-1 || mapIndex < m_cursorIndex)
+    {
+        m_cursorIndex = 0;
+        m_cursorAddr = m_firstAddr;
+    }
+
+    while (m_cursorIndex < mapIndex)
+    {
+        address nextAddr = Helper::getNextBlock(m_disk, m_cursorAddr);
+
+        if (nextAddr == 0)
+        {
+            if (!create)
+                return 0;
+
+            unsigned int mapBlock = m_dblocksTable->getFreeBlock();
+            std::vector<char> reset(blockSize, 0);
+
+            m_dblocksTable->reserveDBlock(mapBlock);
+            nextAddr = Helper::blockToAddr(blockSize, mapBlock);
+            m_disk->write(nextAddr, blockSize, reset.data());
+            m_disk->write(m_cursorAddr + blockSize - sizeof(address), sizeof(address), (const char*)&nextAddr);
+        }
+
+        m_cursorAddr = nextAddr;
+        m_cursorIndex++;
+    }
+
+    return m_cursorAddr;
+}
+
+/**
+ * @brief Get the data block of a logical block of the file.
+ * 
+ * @param blockIndex The index of the logical block.
+ * 
+ * @return address The address of the data block, 0 if there is none.
+ */
+address BlockMap::get(const uint32_t blockIndex)
+{
+    address mapAddr = getMapBlock(blockIndex / getEntriesPerBlock(), false), dataAddr = 0;
+
+    if (mapAddr != 0)
+        m_disk->read(mapAddr + (blockIndex % getEntriesPerBlock()) * sizeof(address), sizeof(address), (char*)&dataAddr);
+
+    return dataAddr;
+}
+
+/**
+ * @brief Set the data block of a logical block of the file, the map grows as needed.
+ * 
+ * @param blockIndex The index of the logical block.
+ * @param dataAddr The address of the data block (0 to unmap it).
+ */
+void BlockMap::set(const uint32_t blockIndex, const address dataAddr)
+{
+    address mapAddr = getMapBlock(blockIndex / getEntriesPerBlock(), true);
+
+    m_disk->write(mapAddr + (blockIndex % getEntriesPerBlock()) * sizeof(address), sizeof(address), (const char*)&dataAddr);
+}
+
+/**
+ * @brief count the blocks the file uses, its map blocks and the data blocks they map.
+ */
+uint32_t BlockMap::countBlocks() const
+{
+    uint32_t entriesPerBlock = getEntriesPerBlock(), hops = 0, blocks = 0;
+    std::vector<address> entries(entriesPerBlock);
+    address currentAddr = m_firstAddr;
+
+    while (currentAddr != 0 && currentAddr != (address)-1)
+    {
+        if (hops++ > m_disk->getBlocksAmount())
+            throw std::runtime_error("block chain has a loop");
+
+        m_disk->read(currentAddr, entriesPerBlock * sizeof(address), (char*)entries.data());
+        blocks += 1 + entriesPerBlock - std::count(entries.begin(), entries.end(), 0);
+
+        currentAddr = Helper::getNextBlock(m_disk, currentAddr);
+    }
+
+    return blocks;
+}
+
+/**
+ * @brief copy the map blocks to new blocks, the data blocks are not copied.
+ * 
+ * @param dataBlocks The data blocks the map points to are added here, so the
+ *                   caller can count the new owner.
+ * 
+ * @return address The first address of the copy, -1 if the map is empty.
+ */
+address BlockMap::clone(std::vector<unsigned int>& dataBlocks) const
+{
+    uint32_t blockSize = m_disk->getBlockSize(), entriesPerBlock = getEntriesPerBlock(), hops = 0;
+    std::vector<char> mapData(blockSize);
+    address* entries = (address*)mapData.data();
+    address currentAddr = m_firstAddr, cloneFirstAddr = (address)-1, clonePrevAddr = 0, noNext = 0;
+
+    while (currentAddr != 0 && currentAddr != (address)-1)
+    {
+        if (hops++ > m_disk->getBlocksAmount())
+            throw std::runtime_error("block chain has a loop");
+
+        m_disk->read(currentAddr, blockSize, mapData.data());
+
+        for (uint32_t i = 0; i < entriesPerBlock; i++)
+        {
+            if (entries[i] != 0)
+                dataBlocks.push_back(Helper::addrToBlock(blockSize, entries[i]));
+        }
+
+        unsigned int mapBlock = m_dblocksTable->getFreeBlock();
+        address cloneAddr = Helper::blockToAddr(blockSize, mapBlock);
+
+        m_dblocksTable->reserveDBlock(mapBlock);
+        memcpy(mapData.data() + blockSize - sizeof(address), &noNext, sizeof(address));
+        m_disk->write(cloneAddr, blockSize, mapData.data());
+
+        if (clonePrevAddr == 0)
+            cloneFirstAddr = cloneAddr;
+        else
+            m_disk->write(clonePrevAddr + blockSize - sizeof(address), sizeof(address), (const char*)&cloneAddr);
+
+        clonePrevAddr = cloneAddr;
+        currentAddr = Helper::getNextBlock(m_disk, currentAddr);
+    }
+
+    return cloneFirstAddr;
+}
+
+/**
+ * @brief free all the data blocks in the map and the map blocks themselves.
+ */
+void BlockMap::release()
+{
+    uint32_t blockSize = m_disk->getBlockSize(), entriesPerBlock = getEntriesPerBlock(), hops = 0;
+    std::vector<address> entries(entriesPerBlock);
+    std::vector<unsigned int> blocks;
+    address currentAddr = m_firstAddr;
+
+    while (currentAddr != 0 && currentAddr != (address)-1)
+    {
+        if (hops++ > m_disk->getBlocksAmount())
+            throw std::runtime_error("block chain has a loop");
+
+        m_disk->read(currentAddr, entriesPerBlock * sizeof(address), (char*)entries.data());
+
+        for (address dataAddr : entries)
+        {
+            if (dataAddr != 0)
+                blocks.push_back(Helper::addrToBlock(blockSize, dataAddr));
+        }
+
+        blocks.push_back(Helper::addrToBlock(blockSize, currentAddr));
+        currentAddr = Helper::getNextBlock(m_disk, currentAddr);
+    }
+
+    m_dblocksTable->freeDBlocks(blocks);
+
+    m_firstAddr = (address)-1;
+    m_cursorIndex = 0;
+    m_cursorAddr = (address)-1;
+}
+
+/**
+ * @brief unmap a range of logical blocks and free their data blocks, the range
+ *        becomes a hole that reads as zeros.
+ * 
+ * @param firstIndex The first logical block of the range.
+ * @param lastIndex The logical block after the range.
+ */
+void BlockMap::punch(const uint32_t firstIndex, const uint32_t lastIndex)
+{
+    uint32_t blockSize = m_disk->getBlockSize(), entriesPerBlock = getEntriesPerBlock();
+    std::vector<address> entries(entriesPerBlock);
+    std::vector<unsigned int> blocks;
+
+    for (uint32_t mapIndex = firstIndex / entriesPerBlock; (uint64_t)mapIndex * entriesPerBlock < lastIndex; mapIndex++)
+    {
+        address mapAddr = getMapBlock(mapIndex, false);
+        uint64_t mapStart = (uint64_t)mapIndex * entriesPerBlock;
+        uint32_t from = std::max<uint64_t>(firstIndex, mapStart) - mapStart;
+        uint32_t to = std::min<uint64_t>(lastIndex, mapStart + entriesPerBlock) - mapStart;
+        bool changed = false;
+
+        if (mapAddr == 0)
+            break;
+
+        m_disk->read(mapAddr + from * sizeof(address), (to - from) * sizeof(address), (char*)entries.data());
+
+        for (uint32_t i = 0; i < to - from; i++)
+        {
+            if (entries[i] != 0)
+            {
+                blocks.push_back(Helper::addrToBlock(blockSize, entries[i]));
+                entries[i] = 0;
+                changed = true;
+            }
+        }
+
+        if (changed)
+            m_disk->write(mapAddr + from * sizeof(address), (to - from) * sizeof(address), (const char*)entries.data());
+    }
+
+    m_dblocksTable->freeDBlocks(blocks);
+}
+
+/**
+ * @brief free the logical blocks from an index on, and the map blocks they need.
+ * 
+ * @param blocksAmount The amount of logical blocks to keep.
+ */
+void BlockMap::truncate(const uint32_t blocksAmount)
+{
+    if (blocksAmount == 0)
+        return release();
+
+    punch(blocksAmount, (uint32_t)-1);
+
+    address lastMapAddr = getMapBlock((blocksAmount - 1) / getEntriesPerBlock(), false), noNext = 0;
+    address nextAddr = lastMapAddr == 0 ? 0 : Helper::getNextBlock(m_disk, lastMapAddr);
+
+    if (nextAddr == 0)
+        return;
+
+    // the map blocks past the last kept block only hold empty entries now
+    m_disk->write(lastMapAddr + m_disk->getBlockSize() - sizeof(address), sizeof(address), (const char*)&noNext);
+    m_dblocksTable->freeAllFileBlocks(nextAddr);
+
+    m_cursorIndex = 0;
+    m_cursorAddr = m_firstAddr;
+}
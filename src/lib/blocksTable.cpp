@@ -1,45 +1,127 @@
 #include <afs/blocksTable.h>
+#include <afs/snapshotTable.h>
 #include <afs/helper.h>
 
-BlocksTable::BlocksTable(Disk* disk, const bool isNew):
-    m_disk(disk)
+#include <stdexcept>
+#include <algorithm>
+
+#include <cstring>
+#include <cstddef>
+
+BlocksTable::BlocksTable(Disk* disk, struct afsHeader* header):
+    m_disk(disk), m_header(header), m_refCounts(nullptr), m_snapshots(nullptr), m_cursor(0)
+{
+    m_dblocksTableAmount = m_disk->getBlocksAmount() / m_disk->getBlockSize();
+    m_table = m_disk->view(Helper::blockToAddr(m_disk->getBlockSize(), DBLOCKS_TABLE_BLOCK_INDX));
+    m_loadedBlocks.resize(m_dblocksTableAmount, false);
+}
+
+unsigned int BlocksTable::getEntriesAmount() const
+{
+    return m_dblocksTableAmount * m_disk->getBlockSize();
+}
+
+/**
+ * @brief verify a block of the table the first time it is used.
+ *
+ * @param index The index of the block in the table.
+ */
+void BlocksTable::loadTableBlock(const unsigned int index) const
+{
+    char probe;
+
+    if (m_loadedBlocks[index])
+        return;
+
+    // a read through the disk verifies the checksum of the whole block
+    m_disk->read(Helper::blockToAddr(m_disk->getBlockSize(), DBLOCKS_TABLE_BLOCK_INDX + index), sizeof(probe), &probe);
+    m_loadedBlocks[index] = true;
+}
+
+/**
+ * @brief Find the first available block in a range of the table.
+ *
+ * @return unsigned int The number of the found block, -1 if there is none.
+ */
+unsigned int BlocksTable::findFreeBlock(const unsigned int from, const unsigned int to) const
 {
     uint32_t blockSize = m_disk->getBlockSize();
-    m_dblocksTableAmount = m_disk->getBlocksAmount() / blockSize;
-    m_table = new bool[m_dblocksTableAmount * blockSize]{false};
 
-    if (!isNew)
+    for (unsigned int start = from; start < to; start = (start / blockSize + 1) * blockSize)
     {
-        for (int i = 0; i < m_dblocksTableAmount; i++)
-        {
-            address addr = Helper::blockToAddr(blockSize, DBLOCKS_TABLE_BLOCK_INDX, i * blockSize);
-            m_disk->read(addr, blockSize, (char*)(m_table + (i * blockSize)));
-        }
+        unsigned int end = std::min(to, (start / blockSize + 1) * blockSize);
+
+        if (getRegionFreeBlocks(start / blockSize) == 0)
+            continue;
+
+        loadTableBlock(start / blockSize);
+
+        const void* found = memchr(m_table + start, 0, end - start);
+        if (found)
+            return (const unsigned char*)found - m_table;
     }
-}
 
-BlocksTable::~BlocksTable()
-{
-    delete[] m_table;
+    return -1;
 }
 
 /**
-* @brief Find available data block to use
+* @brief Find available data block to use, the search continues from the last found block.
 *
 * @return unsigned int The number of the found block.
 */
 unsigned int BlocksTable::getFreeBlock() const
 {
-    unsigned int i = 0;
-    bool found = false;
+    if (m_header->freeBlocks == 0)
+        throw std::runtime_error("no free blocks left on the disk");
+
+    unsigned int blockNum = findFreeBlock(m_cursor, getEntriesAmount());
+
+    if (blockNum == (unsigned int)-1)
+        blockNum = findFreeBlock(0, m_cursor);
+
+    if (blockNum == (unsigned int)-1)
+        throw std::runtime_error("no free blocks left on the disk");
+
+    m_cursor = blockNum;
+
+    return blockNum;
+}
+
+/**
+* @brief Find a run of contiguous available data blocks, the parts of the
+*        table the summary counts as full are skipped.
+*
+* @param amount The amount of blocks needed.
+* @param from The block the search starts at.
+*
+* @return unsigned int The number of the first block in the run.
+*/
+unsigned int BlocksTable::getFreeBlocks(const unsigned int amount, const unsigned int from) const
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    unsigned int runLength = 0;
 
-    for (i = 0; i < m_dblocksTableAmount * m_disk->getBlockSize() && !found; i++)
+    for (unsigned int i = from; i < getEntriesAmount(); i++)
     {
-        if (!m_table[i])
-            found = true;
+        if (i % blockSize == 0 || i == from)
+        {
+            if (getRegionFreeBlocks(i / blockSize) == 0)
+            {
+                runLength = 0;
+                i = (i / blockSize + 1) * blockSize - 1;
+                continue;
+            }
+
+            loadTableBlock(i / blockSize);
+        }
+
+        runLength = m_table[i] ? 0 : runLength + 1;
+
+        if (runLength == amount)
+            return i - amount + 1;
     }
 
-    return found ? i - 1 : -1;
+    return -1;
 }
 
 int BlocksTable::getTableBlocksAmount() const
@@ -47,6 +129,69 @@ int BlocksTable::getTableBlocksAmount() const
     return m_dblocksTableAmount;
 }
 
+/**
+ * @brief Get the amount of blocks the summary area needs (a counter for every block of the table).
+ */
+uint32_t BlocksTable::getSummaryBlocksAmount() const
+{
+    return (m_dblocksTableAmount * sizeof(uint32_t) + m_disk->getBlockSize() - 1) / m_disk->getBlockSize();
+}
+
+/**
+ * @brief set the counters of a new summary area, every block of the table starts free.
+ */
+void BlocksTable::formatSummary()
+{
+    for (int i = 0; i < m_dblocksTableAmount; i++)
+        setRegionFreeBlocks(i, m_disk->getBlockSize());
+}
+
+uint32_t BlocksTable::getRegionFreeBlocks(const unsigned int index) const
+{
+    return ((const uint32_t*)m_disk->view(m_header->summaryAddr))[index];
+}
+
+void BlocksTable::setRegionFreeBlocks(const unsigned int index, const uint32_t freeBlocks)
+{
+    m_disk->write(m_header->summaryAddr + index * sizeof(uint32_t), sizeof(uint32_t), (const char*)&freeBlocks);
+}
+
+/**
+ * @brief change the entry of a block and update the free blocks counters.
+ */
+void BlocksTable::setEntry(const unsigned int blockNum, const unsigned char used)
+{
+    unsigned int region = blockNum / m_disk->getBlockSize();
+
+    loadTableBlock(region);
+
+    if ((bool)m_table[blockNum] == (bool)used)
+        return;
+
+    m_disk->write(Helper::blockToAddr(m_disk->getBlockSize(), DBLOCKS_TABLE_BLOCK_INDX, blockNum), sizeof(used), (const char*)&used);
+
+    m_header->freeBlocks += used ? -1 : 1;
+    m_disk->write(offsetof(struct afsHeader, freeBlocks), sizeof(m_header->freeBlocks), (const char*)&m_header->freeBlocks);
+    setRegionFreeBlocks(region, getRegionFreeBlocks(region) + (used ? -1 : 1));
+
+    // the host releases the space of the block unless a snapshot still reads it
+    if (!used && !(m_snapshots && m_snapshots->blockFreed(blockNum)))
+        m_disk->discard(Helper::blockToAddr(m_disk->getBlockSize(), blockNum), m_disk->getBlockSize());
+}
+
+/**
+ * @brief check whether a block is in use.
+ */
+bool BlocksTable::isReserved(const unsigned int blockNum) const
+{
+    if (blockNum >= getEntriesAmount())
+        return false;
+
+    loadTableBlock(blockNum / m_disk->getBlockSize());
+
+    return m_table[blockNum] != 0;
+}
+
 /**
 * @brief reserve data block in the blocks table.
 *
@@ -54,32 +199,147 @@ int BlocksTable::getTableBlocksAmount() const
 */
 void BlocksTable::reserveDBlock(const unsigned int blockNum)
 {
-    m_table[blockNum] = true;
-    m_disk->write(Helper::blockToAddr(m_disk->getBlockSize(), 1, blockNum), sizeof(bool), (const char*)(m_table + blockNum));
+    setEntry(blockNum, 1);
+}
+
+/**
+ * @brief reserve a run of blocks, the entries of every block of the table are
+ *        set with a single write and the free blocks counters are updated once.
+ *
+ * @param firstBlock The number of the first block.
+ * @param amount The amount of blocks to reserve.
+ */
+void BlocksTable::reserveDBlocks(const unsigned int firstBlock, const unsigned int amount)
+{
+    uint32_t blockSize = m_disk->getBlockSize(), reserved = 0;
+
+    for (unsigned int start = firstBlock; start < firstBlock + amount;)
+    {
+        unsigned int region = start / blockSize, end = std::min(firstBlock + amount, (region + 1) * blockSize);
+
+        loadTableBlock(region);
+
+        uint32_t regionReserved = std::count(m_table + start, m_table + end, 0);
+
+        if (regionReserved != 0)
+        {
+            std::vector<unsigned char> span(end - start, 1);
+
+            m_disk->write(Helper::blockToAddr(blockSize, DBLOCKS_TABLE_BLOCK_INDX, start), span.size(), (const char*)span.data());
+            setRegionFreeBlocks(region, getRegionFreeBlocks(region) - regionReserved);
+            reserved += regionReserved;
+        }
+
+        start = end;
+    }
+
+    if (reserved != 0)
+    {
+        m_header->freeBlocks -= reserved;
+        m_disk->write(offsetof(struct afsHeader, freeBlocks), sizeof(m_header->freeBlocks), (const char*)&m_header->freeBlocks);
+    }
 }
 
 /**
- * @brief release a data block. 
+ * @brief release a data block. A block shared by several files is only freed
+ *        when its last owner releases it.
  * 
  * @param blockNum The number of block to release.
  */
 void BlocksTable::freeDBlock(const unsigned int blockNum)
 {
-    m_table[blockNum] = false;
-    m_disk->write(Helper::blockToAddr(m_disk->getBlockSize(), 1, blockNum), sizeof(bool), (const char*)(m_table + blockNum));
+    if (m_refCounts && m_refCounts->release(blockNum))
+        return;
+
+    setEntry(blockNum, 0);
+}
+
+/**
+ * @brief release a batch of data blocks. The blocks are sorted so the entries of
+ *        every block of the table are cleared with a single write, and the free
+ *        blocks counters are updated once per table block.
+ * 
+ * @param blocks The numbers of the blocks to release.
+ */
+void BlocksTable::freeDBlocks(std::vector<unsigned int> blocks)
+{
+    uint32_t blockSize = m_disk->getBlockSize(), freed = 0;
+    std::vector<unsigned int> discarded;
+
+    // shared blocks keep their other owners
+    if (m_refCounts)
+        blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                     [this](unsigned int blockNum) { return m_refCounts->release(blockNum); }), blocks.end());
+
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+
+    for (size_t first = 0; first < blocks.size();)
+    {
+        unsigned int region = blocks[first] / blockSize;
+        size_t last = first;
+
+        while (last + 1 < blocks.size() && blocks[last + 1] / blockSize == region)
+            last++;
+
+        loadTableBlock(region);
+
+        // rewrite the span between the first and the last block, keeping the entries in between
+        std::vector<unsigned char> span(m_table + blocks[first], m_table + blocks[last] + 1);
+        uint32_t regionFreed = 0;
+
+        for (size_t i = first; i <= last; i++)
+        {
+            regionFreed += span[blocks[i] - blocks[first]] != 0;
+            span[blocks[i] - blocks[first]] = 0;
+
+            if (!(m_snapshots && m_snapshots->blockFreed(blocks[i])))
+                discarded.push_back(blocks[i]);
+        }
+
+        if (regionFreed != 0)
+        {
+            m_disk->write(Helper::blockToAddr(blockSize, DBLOCKS_TABLE_BLOCK_INDX, blocks[first]), span.size(), (const char*)span.data());
+            setRegionFreeBlocks(region, getRegionFreeBlocks(region) + regionFreed);
+            freed += regionFreed;
+        }
+
+        first = last + 1;
+    }
+
+    if (freed != 0)
+    {
+        m_header->freeBlocks += freed;
+        m_disk->write(offsetof(struct afsHeader, freeBlocks), sizeof(m_header->freeBlocks), (const char*)&m_header->freeBlocks);
+    }
+
+    // consecutive blocks are passed to the host together
+    for (size_t first = 0; first < discarded.size();)
+    {
+        size_t last = first;
+
+        while (last + 1 < discarded.size() && discarded[last + 1] == discarded[last] + 1)
+            last++;
+
+        m_disk->discard(Helper::blockToAddr(blockSize, discarded[first]), (unsigned long)(last - first + 1) * blockSize);
+        first = last + 1;
+    }
 }
 
 void BlocksTable::freeAllFileBlocks(const address fileAddr)
 {
     address currentAddr = fileAddr, prevAddr;
-    uint32_t blockSize = m_disk->getBlockSize();
+    uint32_t blockSize = m_disk->getBlockSize(), hops = 0;
     const char reset[sizeof(address)] = { 0 };
 
     while (currentAddr != 0)
     {
+        if (hops++ > m_disk->getBlocksAmount())
+            throw std::runtime_error("block chain has a loop");
+
         prevAddr = currentAddr;
-        freeDBlock(Helper::addrToBlock(blockSize, currentAddr));
-        m_disk->read(currentAddr + blockSize - sizeof(address), sizeof(address), (char*)&currentAddr);
+        currentAddr = Helper::getNextBlock(m_disk, prevAddr);
         m_disk->write(prevAddr + blockSize - sizeof(address), sizeof(address), reset);
+        freeDBlock(Helper::addrToBlock(blockSize, prevAddr));
     }
-}
\ No newline at end of file
+}
@@ -1,5 +1,6 @@
 #include <afs/bootLoad.h>
 #include <afs/helper.h>
+#include <afs/stripeSet.h>
 
 #include <iostream>
 
@@ -14,26 +15,40 @@ Loads the file system if exist, and get the superblock data
 
 @param filePath path to the disk file.
 
-@return superblock (header) struct with all the data from the disk or nullptr if the file doesn't exist/
+@return superblock (header) struct with all the data from the disk or nullptr if the file doesn't exist,
+        or is a striped volume that was not formatted yet.
 
 */
 struct afsHeader* BootLoad::load(const char* filePath)
 {
     int fd = -1;
-    struct afsHeader* header = nullptr;
+    struct afsHeader header;
 
-    if (Helper::isFileExist(filePath))
+    // the header is checked before it is copied out, so the errors leave nothing behind
+    if (StripeSet::isStripeSet(filePath))
+    {
+        StripeSet(filePath).read(0, sizeof(struct afsHeader), (char*)&header);
+
+        if (header.magic[0] == '\0')
+            return nullptr;
+    }
+
+    else if (Helper::isFileExist(filePath))
     {
         fd = Helper::openExistingFile(filePath);
-        header = new struct afsHeader;
-        
-        read(fd, header, sizeof(struct afsHeader));
+        ssize_t bytesRead = read(fd, &header, sizeof(struct afsHeader));
 
-        if (strncmp(header->magic, MAGIC, sizeof(header->magic)) != 0 || header->version != CURR_VERSION)
-            throw std::runtime_error("this file is not afs instance.");
-    
         close(fd);
+
+        if (bytesRead != sizeof(struct afsHeader))
+            throw std::runtime_error("this file is not afs instance.");
     }
 
-    return header;
-}
\ No newline at end of file
+    else
+        return nullptr;
+
+    if (strncmp(header.magic, MAGIC, sizeof(header.magic)) != 0 || header.version != CURR_VERSION)
+        throw std::runtime_error("this file is not afs instance.");
+
+    return new struct afsHeader(header);
+}
@@ -0,0 +1,897 @@
+#include <afs/checker.h>
+#include <afs/bootLoad.h>
+#include <afs/blocksTable.h>
+#include <afs/refCountTable.h>
+#include <afs/dedupIndex.h>
+#include <afs/snapshotTable.h>
+#include <afs/helper.h>
+#include <afs/nameHash.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <cstring>
+
+Checker::Checker(const char* filePath, const unsigned int threads):
+    m_pool(threads), m_directories(0), m_files(0)
+{
+    if (!Helper::isFileExist(filePath))
+        throw std::runtime_error(std::string("disk file does not exist: ") + filePath);
+
+    m_header = BootLoad::load(filePath);
+
+    // a striped volume is created before it is formatted
+    if (!m_header)
+        throw std::runtime_error(std::string("disk file is not formatted: ") + filePath);
+
+    m_disk = new Disk(filePath, m_header->blockSize, m_header->nblocks);
+
+    // bad blocks are reported by the checksum pass, the walk reads them as they are
+    if (m_header->checksumAddr != 0)
+        m_disk->enableChecksums(m_header->checksumAddr, false);
+    m_disk->setVerifyChecksums(false);
+
+    m_tableBlocks = m_header->nblocks / m_header->blockSize;
+    m_inodesCapacity = 0;
+}
+
+Checker::~Checker()
+{
+    delete m_disk;
+    delete m_header;
+}
+
+/**
+ * @brief check the whole disk, and rebuild the blocks table, the reference counts,
+ *        the fragment map and the inode state from the reachable metadata if asked.
+ *
+ * The disk must not be used by anyone else while it is checked.
+ *
+ * @param repair Whether to fix what can be fixed.
+ * @param verifyChecksums Whether to verify the checksum of every block too.
+ *
+ * @return fsckReport What was found on the disk.
+ */
+fsckReport Checker::check(bool repair, const bool verifyChecksums)
+{
+    uint32_t blockSize = m_disk->getBlockSize(), nblocks = m_disk->getBlocksAmount();
+
+    m_report = fsckReport();
+    m_directories = 0;
+    m_files = 0;
+    m_blockRefs.reset(new std::atomic<uint32_t>[nblocks]());
+    m_metadata.assign(nblocks, false);
+    m_fragEntries.clear();
+    m_fragMapBlocks.clear();
+    m_fragIndex.clear();
+    m_badFingerprints.clear();
+
+    markRegion(0, 1, "header");
+    markRegion(Helper::blockToAddr(blockSize, DBLOCKS_TABLE_BLOCK_INDX), m_tableBlocks, "blocks table");
+
+    if (m_header->checksumAddr != 0)
+        markRegion(m_header->checksumAddr, Disk::getChecksumBlocksAmount(blockSize, nblocks), "checksum area");
+
+    if (m_header->refTableAddr != 0)
+        markRegion(m_header->refTableAddr, RefCountTable::getTableBlocksAmount(m_disk), "reference counts");
+
+    if (m_header->dedupIndexAddr != 0)
+        markRegion(m_header->dedupIndexAddr, DedupIndex::getIndexBlocksAmount(m_disk), "dedup index");
+
+    if (m_header->summaryAddr != 0)
+        markRegion(m_header->summaryAddr, (m_tableBlocks * sizeof(uint32_t) + blockSize - 1) / blockSize, "free blocks summary");
+
+    loadInodeTable();
+    loadFragmentMap();
+    checkSnapshots();
+
+    m_inodeLinks.reset(new std::atomic<uint8_t>[m_inodesCapacity]());
+    inode root = m_inodesCapacity > 0 ? readInode(0) : inode(false);
+
+    if (verifyChecksums)
+        checkChecksums();
+
+    // without the root nothing is reachable, rebuilding from the walk would free the whole disk
+    if (!(root.flags & DIRTYPE) || root.flags & DELETED)
+    {
+        addError("the root directory inode is damaged, nothing is repaired", false);
+        repair = false;
+    }
+
+    else
+    {
+        m_inodeLinks[0] = 1;
+        checkOrphans();
+        m_pool.submit([this] { checkDirectory(0, 0); });
+    }
+
+    m_pool.wait();
+
+    // parts of the tree behind damage the walk could not pass would be freed by a rebuild
+    if (repair && m_report.unrepaired > m_report.badChecksums)
+    {
+        addError("the directory tree is damaged, nothing is repaired", false);
+        repair = false;
+    }
+
+    compareFingerprints(repair);
+    compareFragments(repair);
+    compareDedupIndex(repair);
+    compareBlocks(repair);
+    compareInodes(repair);
+
+    m_report.directories = m_directories;
+    m_report.files = m_files;
+    m_report.repaired = repair && m_report.errorsAmount > m_report.unrepaired;
+
+    return m_report;
+}
+
+void Checker::addError(const std::string& error, const bool repairable)
+{
+    std::lock_guard<std::mutex> lock(m_reportLock);
+
+    m_report.errorsAmount++;
+
+    if (!repairable)
+        m_report.unrepaired++;
+
+    if (m_report.errors.size() < MAX_REPORTED_ERRORS)
+        m_report.errors.push_back(error);
+}
+
+address Checker::inodeIndexToAddr(const uint32_t inodeIndex) const
+{
+    uint32_t inodesPerBlock = m_disk->getBlockSize() / sizeof(inode);
+
+    return m_inodeTable[inodeIndex / inodesPerBlock] + sizeof(inode) * (inodeIndex % inodesPerBlock);
+}
+
+inode Checker::readInode(const uint32_t inodeIndex) const
+{
+    inode node;
+
+    m_disk->read(inodeIndexToAddr(inodeIndex), sizeof(inode), (char*)&node);
+
+    return node;
+}
+
+/**
+ * @brief whether an address is the start of a block on the disk (block 0 is never pointed to).
+ */
+bool Checker::isBlockAddr(const address addr) const
+{
+    return addr != 0 && addr % m_disk->getBlockSize() == 0 && addr / m_disk->getBlockSize() < m_disk->getBlocksAmount();
+}
+
+/**
+ * @brief count a reference to a block.
+ *
+ * @param addr The address of the block.
+ * @param owner Description of what points to the block, for the report.
+ */
+void Checker::markBlock(const address addr, const std::string& owner)
+{
+    if (!isBlockAddr(addr))
+    {
+        addError(owner + " points outside the disk (" + std::to_string(addr) + ")", false);
+        return;
+    }
+
+    m_blockRefs[addr / m_disk->getBlockSize()]++;
+}
+
+/**
+ * @brief count a reference to every block of a metadata region.
+ */
+void Checker::markRegion(const address firstAddr, const uint32_t blocksAmount, const std::string& owner)
+{
+    uint32_t firstBlock = firstAddr / m_disk->getBlockSize();
+
+    if (firstAddr % m_disk->getBlockSize() != 0 || firstBlock + blocksAmount > m_disk->getBlocksAmount())
+    {
+        addError("the " + owner + " is outside the disk", false);
+        return;
+    }
+
+    for (uint32_t i = firstBlock; i < firstBlock + blocksAmount; i++)
+    {
+        m_blockRefs[i]++;
+        m_metadata[i] = true;
+    }
+}
+
+/**
+ * @brief follow a block chain and count a reference to each of its blocks.
+ *
+ * @param firstAddr The address of the first block.
+ * @param owner Description of what owns the chain, for the report.
+ *
+ * @return std::vector<address> The blocks of the chain, up to the first broken pointer or cycle.
+ */
+std::vector<address> Checker::readChain(const address firstAddr, const std::string& owner)
+{
+    std::vector<address> chain;
+    std::unordered_set<address> visited;
+    address currentAddr = firstAddr;
+
+    while (currentAddr != 0)
+    {
+        if (!isBlockAddr(currentAddr))
+        {
+            addError(owner + " has a block chain pointer outside the disk (" + std::to_string(currentAddr) + ")", false);
+            break;
+        }
+
+        if (!visited.insert(currentAddr).second)
+        {
+            addError(owner + " has a cycle in its block chain", false);
+            break;
+        }
+
+        markBlock(currentAddr, owner);
+        chain.push_back(currentAddr);
+
+        m_disk->read(currentAddr + m_disk->getBlockSize() - sizeof(address), sizeof(address), (char*)&currentAddr);
+    }
+
+    return chain;
+}
+
+/**
+ * @brief mark the generation table, the snapshot records, and the exceptions
+ *        chains of the snapshots with the blocks they keep.
+ */
+void Checker::checkSnapshots()
+{
+    uint32_t entriesPerBlock = (m_disk->getBlockSize() - sizeof(address)) / sizeof(exceptionEntry);
+    size_t slots = m_disk->getBlockSize() / sizeof(snapshotRecord);
+    std::vector<snapshotRecord> records(slots);
+    std::vector<exceptionEntry> entries(entriesPerBlock);
+
+    if (m_header->snapshotsAddr == 0)
+        return;
+
+    markRegion(m_header->generationsAddr, SnapshotTable::getGenerationBlocksAmount(m_disk), "snapshot generations");
+    markRegion(m_header->snapshotsAddr, 1, "snapshot records");
+
+    m_disk->read(m_header->snapshotsAddr, slots * sizeof(snapshotRecord), (char*)records.data());
+
+    for (const snapshotRecord& record : records)
+    {
+        if (record.generation == 0)
+            continue;
+
+        std::string owner = "snapshot " + std::string(record.name, strnlen(record.name, NAME_MAX_LEN));
+        uint32_t left = record.exceptionsAmount;
+
+        for (address chainAddr : readChain(record.exceptionsAddr, owner))
+        {
+            uint32_t amount = std::min(left, entriesPerBlock);
+
+            m_disk->read(chainAddr, entriesPerBlock * sizeof(exceptionEntry), (char*)entries.data());
+
+            for (uint32_t i = 0; i < amount; i++)
+            {
+                if (entries[i].blockNum == EXCEPTION_PROCESSED)
+                    continue;
+
+                if (!isBlockAddr(entries[i].copyAddr))
+                    addError(owner + " keeps a block outside the disk (" + std::to_string(entries[i].copyAddr) + ")", false);
+                else
+                    markBlock(entries[i].copyAddr, owner);
+            }
+
+            left -= amount;
+        }
+    }
+}
+
+/**
+ * @brief read the block map of the inode table, its blocks and the table blocks are metadata.
+ *        The inodes of the blocks the map lists are the ones that are checked.
+ */
+void Checker::loadInodeTable()
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    uint32_t entriesPerBlock = (blockSize - sizeof(address)) / sizeof(address);
+    std::vector<address> entries(entriesPerBlock);
+
+    m_inodeTable.clear();
+
+    for (address mapAddr : readChain(m_header->inodeMapAddr, "the inode table map"))
+    {
+        m_metadata[mapAddr / blockSize] = true;
+        m_disk->read(mapAddr, entriesPerBlock * sizeof(address), (char*)entries.data());
+
+        for (uint32_t i = 0; i < entriesPerBlock && m_inodeTable.size() < m_header->inodeBlocks; i++)
+        {
+            if (!isBlockAddr(entries[i]))
+            {
+                addError("the inode table map lists a block outside the disk (" + std::to_string(entries[i]) + ")", false);
+                break;
+            }
+
+            markRegion(entries[i], 1, "inode table");
+            m_inodeTable.push_back(entries[i]);
+        }
+    }
+
+    if (m_inodeTable.size() != m_header->inodeBlocks)
+        addError("the inode table map lists " + std::to_string(m_inodeTable.size()) + " of the " +
+                 std::to_string(m_header->inodeBlocks) + " blocks of the inode table", false);
+
+    m_inodesCapacity = m_inodeTable.size() * (blockSize / sizeof(inode));
+}
+
+/**
+ * @brief read the fragment map, its blocks are metadata and every fragment block it lists is owned by it.
+ */
+void Checker::loadFragmentMap()
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    uint32_t entriesPerBlock = (blockSize - sizeof(address)) / sizeof(fragMapEntry);
+    std::vector<fragMapEntry> entries(entriesPerBlock);
+
+    m_fragMapBlocks = readChain(m_header->fragMapAddr, "the fragment map");
+
+    for (address mapAddr : m_fragMapBlocks)
+    {
+        m_metadata[mapAddr / blockSize] = true;
+        m_disk->read(mapAddr, entriesPerBlock * sizeof(fragMapEntry), (char*)entries.data());
+
+        for (const fragMapEntry& entry : entries)
+        {
+            if (entry.blockAddr != 0)
+            {
+                if (!isBlockAddr(entry.blockAddr))
+                    addError("the fragment map lists a block outside the disk (" + std::to_string(entry.blockAddr) + ")", true);
+
+                else if (!m_fragIndex.emplace(entry.blockAddr, m_fragEntries.size()).second)
+                    addError("the fragment map lists block " + std::to_string(entry.blockAddr / blockSize) + " twice", true);
+
+                else
+                    markBlock(entry.blockAddr, "the fragment map");
+            }
+
+            m_fragEntries.push_back(entry);
+        }
+    }
+
+    m_fragUsed.reset(new std::atomic<uint16_t>[m_fragEntries.size()]());
+}
+
+/**
+ * @brief link the deleted inodes of the orphan list and queue a check for each of them,
+ *        their blocks stay in use until the reclaimer releases them.
+ */
+void Checker::checkOrphans()
+{
+    std::unordered_set<uint32_t> visited;
+    uint32_t inodeIndex = m_header->orphanHead;
+
+    while (inodeIndex != NO_ORPHAN)
+    {
+        if (inodeIndex >= m_inodesCapacity || !visited.insert(inodeIndex).second)
+        {
+            addError("the orphan list is broken at inode " + std::to_string(inodeIndex), false);
+            return;
+        }
+
+        inode orphan = readInode(inodeIndex);
+        uint8_t links = 0;
+
+        // an orphan released right before a crash is still at the head of the list
+        if (orphan.flags & DELETED)
+        {
+            inodeIndex = orphan.nextOrphan;
+            continue;
+        }
+
+        if (!(orphan.flags & ORPHAN) || !m_inodeLinks[inodeIndex].compare_exchange_strong(links, 1))
+        {
+            addError("the orphan list links inode " + std::to_string(inodeIndex) + " that is not an orphan", false);
+            return;
+        }
+
+        m_report.orphans++;
+
+        if (orphan.flags & DIRTYPE)
+            m_pool.submit([this, inodeIndex] { checkDirectory(inodeIndex, NO_ORPHAN); });
+        else
+            m_pool.submit([this, inodeIndex, orphan] { checkFile(inodeIndex, orphan); });
+
+        inodeIndex = orphan.nextOrphan;
+    }
+}
+
+/**
+ * @brief check a directory and queue a check for every inode it links.
+ *
+ * @param inodeIndex The inode of the directory.
+ * @param parentIndex The inode of the directory that links it (NO_ORPHAN for an orphan directory).
+ */
+void Checker::checkDirectory(const uint32_t inodeIndex, const uint32_t parentIndex)
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    uint32_t maxSiblingsPerBlock = Helper::getSiblingsPerBlock(blockSize);
+    std::string owner = "directory inode " + std::to_string(inodeIndex);
+    inode dirInode = readInode(inodeIndex);
+    directoryData data;
+
+    m_directories++;
+
+    if (!isBlockAddr(dirInode.firstAddr))
+    {
+        addError(owner + " has no valid entries block", false);
+        return;
+    }
+
+    std::vector<address> chain = readChain(dirInode.firstAddr, owner);
+    m_disk->read(dirInode.firstAddr, sizeof(directoryData), (char*)&data);
+
+    if (data > chain.size() * maxSiblingsPerBlock)
+    {
+        addError(owner + " counts more entries than its blocks hold", false);
+        data = chain.size() * maxSiblingsPerBlock;
+    }
+
+    if (data < 2)
+        addError(owner + " is missing its \".\" and \"..\" entries", false);
+
+    for (uint32_t i = 0; i < data; i++)
+    {
+        dirSibling sibling;
+        address blockAddr = chain[i / maxSiblingsPerBlock];
+        address fingerprintAddr = Helper::getFingerprintAddr(blockAddr, i % maxSiblingsPerBlock);
+        uint8_t fingerprint;
+        uint32_t child;
+
+        m_disk->read(Helper::getSiblingAddr(blockAddr, blockSize, i % maxSiblingsPerBlock), sizeof(dirSibling), (char*)&sibling);
+        m_disk->read(fingerprintAddr, sizeof(fingerprint), (char*)&fingerprint);
+        child = sibling.indodeTableIndex;
+
+        std::string name(sibling.name, strnlen(sibling.name, sizeof(sibling.name)));
+
+        // a wrong fingerprint hides the entry from lookups
+        if (fingerprint != NameHash::fingerprint(sibling.name))
+        {
+            addError("entry \"" + name + "\" of " + owner + " has a wrong name fingerprint", true);
+
+            std::lock_guard<std::mutex> lock(m_reportLock);
+            m_badFingerprints.emplace_back(fingerprintAddr, NameHash::fingerprint(sibling.name));
+        }
+
+        if (i < 2)
+        {
+            const char* expectedName = i == 0 ? "." : "..";
+
+            if (name != expectedName || (i == 0 && child != inodeIndex) || (i == 1 && parentIndex != NO_ORPHAN && child != parentIndex))
+                addError(owner + " has a wrong \"" + expectedName + "\" entry", false);
+
+            continue;
+        }
+
+        std::string entry = "entry \"" + name + "\" of " + owner;
+        uint8_t links = 0;
+
+        if (child >= m_inodesCapacity)
+        {
+            addError(entry + " points outside the inode table", false);
+            continue;
+        }
+
+        inode childInode = readInode(child);
+
+        // every inode has a single entry, this also stops directory cycles. An entry of
+        // a deleted directory can still link an inode that was moved to the orphan list.
+        if (!m_inodeLinks[child].compare_exchange_strong(links, 1))
+        {
+            if (!(childInode.flags & ORPHAN))
+                addError(entry + " links inode " + std::to_string(child) + " that is already linked", false);
+            continue;
+        }
+
+        if (childInode.flags & DELETED || !(childInode.flags & (FILETYPE | DIRTYPE)))
+            addError(entry + " links the free inode " + std::to_string(child), false);
+
+        else if (childInode.flags & DIRTYPE)
+            m_pool.submit([this, child, inodeIndex] { checkDirectory(child, inodeIndex); });
+
+        else if (childInode.firstAddr != (address)-1 && !(childInode.flags & INLINEDATA))
+            m_pool.submit([this, child, childInode] { checkFile(child, childInode); });
+
+        else
+            checkFile(child, childInode);
+    }
+}
+
+/**
+ * @brief check a regular file and count references to its map blocks and data blocks.
+ *
+ * @param inodeIndex The inode of the file.
+ * @param fileInode The content of the inode.
+ */
+void Checker::checkFile(const uint32_t inodeIndex, const inode& fileInode)
+{
+    uint32_t blockSize = m_disk->getBlockSize(), tailSize = 0, mappedBlocks;
+    uint32_t entriesPerBlock = (blockSize - sizeof(address)) / sizeof(address);
+    std::string owner = "file inode " + std::to_string(inodeIndex);
+    bool pastEnd = false;
+
+    m_files++;
+
+    if (fileInode.flags & INLINEDATA)
+    {
+        if (fileInode.fileSize > INLINE_DATA_MAX)
+            addError(owner + " has more inline data than the inode holds", false);
+
+        if (fileInode.firstAddr != (address)-1)
+            addError(owner + " has both inline data and data blocks", false);
+
+        return;
+    }
+
+    if (fileInode.flags & TAILPACKED)
+    {
+        tailSize = fileInode.fileSize % blockSize;
+        checkTail(inodeIndex, fileInode);
+    }
+
+    if (fileInode.firstAddr == (address)-1)
+        return;
+
+    if (fileInode.flags & COMPRESSED)
+    {
+        uint32_t chunkSize = blockSize * COMPRESSION_CHUNK_BLOCKS;
+        mappedBlocks = (fileInode.fileSize + chunkSize - 1) / chunkSize * COMPRESSION_CHUNK_BLOCKS;
+    }
+    else
+        mappedBlocks = (fileInode.fileSize - tailSize + blockSize - 1) / blockSize;
+
+    std::vector<address> mapBlocks = readChain(fileInode.firstAddr, owner + " block map");
+    std::vector<address> entries(entriesPerBlock);
+
+    for (size_t mapIndex = 0; mapIndex < mapBlocks.size(); mapIndex++)
+    {
+        m_disk->read(mapBlocks[mapIndex], entriesPerBlock * sizeof(address), (char*)entries.data());
+
+        for (uint32_t i = 0; i < entriesPerBlock; i++)
+        {
+            if (entries[i] == 0)
+                continue;
+
+            if (mapIndex * entriesPerBlock + i >= mappedBlocks && !pastEnd)
+            {
+                addError(owner + " maps blocks past the end of the file", false);
+                pastEnd = true;
+            }
+
+            markBlock(entries[i], owner);
+        }
+    }
+}
+
+/**
+ * @brief check the packed tail of a file and mark its fragments as used.
+ */
+void Checker::checkTail(const uint32_t inodeIndex, const inode& fileInode)
+{
+    uint32_t blockSize = m_disk->getBlockSize(), fragmentSize = blockSize / FRAGMENTS_PER_BLOCK;
+    uint32_t tailSize = fileInode.fileSize % blockSize;
+    std::string owner = "file inode " + std::to_string(inodeIndex);
+    auto it = m_fragIndex.find(fileInode.tailAddr - fileInode.tailAddr % blockSize);
+
+    if (tailSize == 0 || tailSize > fragmentSize * TAIL_MAX_FRAGMENTS || fileInode.tailAddr % fragmentSize != 0 ||
+        fileInode.flags & COMPRESSED)
+    {
+        addError(owner + " has an invalid packed tail", false);
+        return;
+    }
+
+    if (it == m_fragIndex.end())
+    {
+        addError(owner + " has a packed tail outside the fragment blocks", false);
+        return;
+    }
+
+    uint32_t first = (fileInode.tailAddr % blockSize) / fragmentSize;
+    uint32_t fragments = (tailSize + fragmentSize - 1) / fragmentSize;
+
+    if (first + fragments > FRAGMENTS_PER_BLOCK)
+    {
+        addError(owner + " has a packed tail that crosses its fragment block", false);
+        return;
+    }
+
+    uint16_t mask = (uint16_t)(((1u << fragments) - 1) << first);
+
+    if (m_fragUsed[it->second].fetch_or(mask) & mask)
+        addError(owner + " shares the fragments of its tail with another file", false);
+}
+
+/**
+ * @brief verify the checksums of all the blocks, in batches on the pool.
+ */
+void Checker::checkChecksums()
+{
+    constexpr uint32_t BATCH_BLOCKS = 4096;
+    uint32_t nblocks = m_disk->getBlocksAmount();
+
+    if (!m_disk->hasChecksums())
+        return;
+
+    for (uint32_t first = 0; first < nblocks; first += BATCH_BLOCKS)
+    {
+        m_pool.submit([this, first, nblocks] {
+            uint32_t blockSize = m_disk->getBlockSize();
+
+            // the batch is read from the device at once instead of a page fault at a time
+            m_disk->prefetch((unsigned long)first * blockSize, (unsigned long)BATCH_BLOCKS * blockSize);
+
+            for (uint32_t blockNum = first; blockNum < std::min(first + BATCH_BLOCKS, nblocks); blockNum++)
+            {
+                if (!m_disk->verifyBlock(blockNum))
+                {
+                    addError("block " + std::to_string(blockNum) + " does not match its checksum", false);
+
+                    std::lock_guard<std::mutex> lock(m_reportLock);
+                    m_report.badChecksums++;
+                }
+            }
+        });
+    }
+}
+
+/**
+ * @brief compare the fragments the files use with the used masks of the fragment map.
+ *        A repaired fragment block that holds no tail is left unreferenced, so it is freed.
+ */
+void Checker::compareFragments(const bool repair)
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    uint32_t entriesPerBlock = (blockSize - sizeof(address)) / sizeof(fragMapEntry);
+
+    for (size_t i = 0; i < m_fragEntries.size(); i++)
+    {
+        fragMapEntry& entry = m_fragEntries[i];
+
+        if (entry.blockAddr == 0)
+            continue;
+
+        auto it = m_fragIndex.find(entry.blockAddr);
+        bool listed = it != m_fragIndex.end() && it->second == i;
+        uint16_t used = listed ? m_fragUsed[i].load() : 0;
+
+        if (listed && used == entry.usedMask)
+            continue;
+
+        if (listed && used != 0)
+            addError("fragment block " + std::to_string(entry.blockAddr / blockSize) + " has a wrong used mask", true);
+
+        else if (listed)
+            addError("fragment block " + std::to_string(entry.blockAddr / blockSize) + " holds no file tail", true);
+
+        if (!repair)
+            continue;
+
+        if (listed && used == 0)
+            m_blockRefs[entry.blockAddr / blockSize]--;
+
+        entry.usedMask = used;
+        if (used == 0)
+            entry.blockAddr = 0;
+
+        m_disk->write(m_fragMapBlocks[i / entriesPerBlock] + (i % entriesPerBlock) * sizeof(fragMapEntry),
+                      sizeof(fragMapEntry), (const char*)&entry);
+    }
+}
+
+/**
+ * @brief find dedup index entries of blocks that no file uses anymore.
+ */
+void Checker::compareDedupIndex(const bool repair)
+{
+    if (m_header->dedupIndexAddr == 0)
+        return;
+
+    uint32_t blockSize = m_disk->getBlockSize(), capacity = DedupIndex::getCapacity(m_disk);
+    std::vector<dedupEntry> entries(capacity), stale;
+
+    m_disk->read(m_header->dedupIndexAddr, capacity * sizeof(dedupEntry), (char*)entries.data());
+
+    for (const dedupEntry& entry : entries)
+    {
+        if (entry.blockAddr == 0)
+            continue;
+
+        if (!isBlockAddr(entry.blockAddr) || m_blockRefs[entry.blockAddr / blockSize] == 0 ||
+            m_metadata[entry.blockAddr / blockSize])
+        {
+            addError("the dedup index lists block " + std::to_string(entry.blockAddr / blockSize) + " that holds no file data", true);
+            stale.push_back(entry);
+        }
+    }
+
+    if (repair)
+    {
+        DedupIndex index(m_disk, m_header->dedupIndexAddr);
+
+        for (const dedupEntry& entry : stale)
+            index.remove(entry.fingerprint, entry.blockAddr);
+    }
+}
+
+/**
+ * @brief compare the references found by the walk with the blocks table, the
+ *        reference counts and the free blocks counters, and rewrite what differs.
+ */
+void Checker::compareBlocks(const bool repair)
+{
+    uint32_t blockSize = m_disk->getBlockSize(), nblocks = m_disk->getBlocksAmount();
+    uint32_t coveredBlocks = m_tableBlocks * blockSize;
+    bool hasRefCounts = m_header->refTableAddr != 0;
+    std::vector<char> table(coveredBlocks), rebuiltTable;
+    std::vector<uint32_t> refCounts(hasRefCounts ? nblocks : 0), rebuiltRefCounts;
+
+    m_disk->read(Helper::blockToAddr(blockSize, DBLOCKS_TABLE_BLOCK_INDX), coveredBlocks, table.data());
+
+    if (hasRefCounts)
+        m_disk->read(m_header->refTableAddr, nblocks * sizeof(uint32_t), (char*)refCounts.data());
+
+    rebuiltTable = table;
+    rebuiltRefCounts = refCounts;
+
+    for (uint32_t blockNum = 0; blockNum < nblocks; blockNum++)
+    {
+        uint32_t refs = m_blockRefs[blockNum];
+        uint32_t owners = hasRefCounts ? std::max(1u, refCounts[blockNum] & REF_COUNT_MASK) : 1;
+
+        if (refs > 0)
+            m_report.usedBlocks++;
+
+        if (blockNum >= coveredBlocks)
+        {
+            if (refs > 0)
+                addError("block " + std::to_string(blockNum) + " is used but the blocks table does not cover it", false);
+            continue;
+        }
+
+        if (refs > 0 && !table[blockNum])
+            addError("block " + std::to_string(blockNum) + " is used but marked free", true);
+
+        if (refs == 0 && table[blockNum])
+            m_report.leakedBlocks++;
+
+        // only data blocks can be shared, and only through the reference counts
+        if (refs > 1 && (m_metadata[blockNum] || !hasRefCounts))
+            addError("block " + std::to_string(blockNum) + " is referenced " + std::to_string(refs) + " times", false);
+
+        else if (refs > 0 && owners != refs)
+            addError("block " + std::to_string(blockNum) + " is referenced " + std::to_string(refs) +
+                     " times but counts " + std::to_string(owners) + " owners", true);
+
+        rebuiltTable[blockNum] = refs > 0;
+
+        if (hasRefCounts)
+        {
+            uint32_t indexed = refs > 0 ? refCounts[blockNum] & REF_INDEXED : 0;
+            rebuiltRefCounts[blockNum] = indexed | (refs > 1 ? refs : 0);
+        }
+    }
+
+    if (m_report.leakedBlocks > 0)
+        addError(std::to_string(m_report.leakedBlocks) + " blocks are reserved but not used", true);
+
+    // the free blocks counters of the header and of every block of the table
+    std::vector<uint32_t> summary(m_tableBlocks), rebuiltSummary(m_tableBlocks, 0);
+    uint32_t freeBlocks = 0;
+
+    m_disk->read(m_header->summaryAddr, m_tableBlocks * sizeof(uint32_t), (char*)summary.data());
+
+    for (uint32_t blockNum = 0; blockNum < coveredBlocks; blockNum++)
+    {
+        if (!rebuiltTable[blockNum])
+        {
+            freeBlocks++;
+            rebuiltSummary[blockNum / blockSize]++;
+        }
+    }
+
+    if (summary != rebuiltSummary)
+        addError("the free blocks summary does not match the blocks table", true);
+
+    if (freeBlocks != m_header->freeBlocks)
+        addError("the header counts " + std::to_string(m_header->freeBlocks) + " free blocks but " +
+                 std::to_string(freeBlocks) + " are free", true);
+
+    if (!repair)
+        return;
+
+    if (summary != rebuiltSummary)
+        m_disk->write(m_header->summaryAddr, m_tableBlocks * sizeof(uint32_t), (const char*)rebuiltSummary.data());
+
+    if (freeBlocks != m_header->freeBlocks)
+    {
+        m_header->freeBlocks = freeBlocks;
+        m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+    }
+
+    for (uint32_t i = 0; i < m_tableBlocks; i++)
+    {
+        if (memcmp(&table[i * blockSize], &rebuiltTable[i * blockSize], blockSize) != 0)
+            m_disk->write(Helper::blockToAddr(blockSize, DBLOCKS_TABLE_BLOCK_INDX + i), blockSize, &rebuiltTable[i * blockSize]);
+    }
+
+    for (uint32_t first = 0; first < refCounts.size(); first += blockSize / sizeof(uint32_t))
+    {
+        uint32_t count = std::min<uint32_t>(blockSize / sizeof(uint32_t), refCounts.size() - first);
+
+        if (memcmp(&refCounts[first], &rebuiltRefCounts[first], count * sizeof(uint32_t)) != 0)
+            m_disk->write(m_header->refTableAddr + first * sizeof(uint32_t), count * sizeof(uint32_t), (const char*)&rebuiltRefCounts[first]);
+    }
+}
+
+/**
+ * @brief rewrite the name fingerprints of the entries that the walk found wrong.
+ */
+void Checker::compareFingerprints(const bool repair)
+{
+    if (!repair)
+        return;
+
+    for (const std::pair<address, uint8_t>& bad : m_badFingerprints)
+        m_disk->write(bad.first, sizeof(bad.second), (const char*)&bad.second);
+}
+
+/**
+ * @brief release inodes that no directory links, and fix the inodes count of the header.
+ */
+void Checker::compareInodes(const bool repair)
+{
+    // the table of a big disk does not fit in memory, it is read a block at a time
+    uint32_t count = m_disk->getBlockSize() / sizeof(inode);
+    std::vector<inode> inodes(count);
+    uint32_t reachable = 0;
+
+    for (uint32_t first = 0; first < m_inodesCapacity; first += count)
+    {
+        m_disk->read(inodeIndexToAddr(first), count * sizeof(inode), (char*)inodes.data());
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            bool inUse = !(inodes[i].flags & DELETED) && inodes[i].flags & (FILETYPE | DIRTYPE);
+
+            if (!inUse)
+                continue;
+
+            if (m_inodeLinks[first + i] != 0)
+            {
+                reachable++;
+                continue;
+            }
+
+            addError("inode " + std::to_string(first + i) + " is not linked from any directory", true);
+
+            if (repair)
+            {
+                inodes[i].flags |= DELETED;
+                m_disk->write(inodeIndexToAddr(first + i), sizeof(inode), (const char*)&inodes[i]);
+            }
+        }
+    }
+
+    if (reachable != m_header->inodes || m_inodesCapacity - reachable != m_header->freeInodes)
+    {
+        addError("the header counts " + std::to_string(m_header->inodes) + " inodes in use and " +
+                 std::to_string(m_header->freeInodes) + " free but " + std::to_string(reachable) + " are in use", true);
+
+        if (repair)
+        {
+            m_header->inodes = reachable;
+            m_header->freeInodes = m_inodesCapacity - reachable;
+            m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+        }
+    }
+}
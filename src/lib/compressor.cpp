@@ -0,0 +1,197 @@
+#include <afs/compressor.h>
+
+#include <cstring>
+#include <cstdint>
+
+// LZ77 codec with the sequence layout of LZ4 blocks:
+// token (literals length << 4 | match length - MIN_MATCH), literals, 16 bit offset.
+// The last sequence of a block holds literals only.
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 0xFFFF;
+constexpr int HASH_LOG = 12;
+
+static inline uint32_t read32(const unsigned char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hash(const uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HASH_LOG);
+}
+
+/**
+ * @brief write an extended length (the part that did not fit in the token nibble).
+ * 
+ * @return bool false if the output buffer is too small.
+ */
+static bool writeLength(unsigned char*& op, const unsigned char* opEnd, size_t length)
+{
+    while (length >= 255)
+    {
+        if (op >= opEnd) return false;
+        *op++ = 255;
+        length -= 255;
+    }
+
+    if (op >= opEnd) return false;
+    *op++ = (unsigned char)length;
+
+    return true;
+}
+
+static bool writeSequence(unsigned char*& op, const unsigned char* opEnd, const unsigned char* literals,
+                          const size_t literalsLen, const size_t offset, const size_t matchLen)
+{
+    size_t matchCode = matchLen ? matchLen - MIN_MATCH : 0;
+
+    if (op >= opEnd) return false;
+    *op++ = (unsigned char)(((literalsLen < 15 ? literalsLen : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+
+    if (literalsLen >= 15 && !writeLength(op, opEnd, literalsLen - 15))
+        return false;
+
+    if ((size_t)(opEnd - op) < literalsLen)
+        return false;
+    memcpy(op, literals, literalsLen);
+    op += literalsLen;
+
+    if (matchLen == 0)
+        return true;
+
+    if (opEnd - op < 2) return false;
+    *op++ = (unsigned char)(offset & 0xFF);
+    *op++ = (unsigned char)(offset >> 8);
+
+    if (matchCode >= 15 && !writeLength(op, opEnd, matchCode - 15))
+        return false;
+
+    return true;
+}
+
+/**
+ * @brief compress a buffer.
+ * 
+ * @param src The data to compress.
+ * @param srcSize The size of the data.
+ * @param dst The buffer to write the compressed data to.
+ * @param dstCapacity The size of the output buffer.
+ * 
+ * @return size_t The size of the compressed data, 0 if it does not fit in the output buffer.
+ */
+size_t Compressor::compress(const char* src, const size_t srcSize, char* dst, const size_t dstCapacity)
+{
+    uint32_t table[1 << HASH_LOG] = { 0 };
+    const unsigned char* base = (const unsigned char*)src;
+    const unsigned char* ip = base;
+    const unsigned char* anchor = base;
+    const unsigned char* end = base + srcSize;
+    unsigned char* op = (unsigned char*)dst;
+    const unsigned char* opEnd = op + dstCapacity;
+
+    while (srcSize >= MIN_MATCH && ip <= end - MIN_MATCH)
+    {
+        uint32_t sequence = read32(ip);
+        uint32_t h = hash(sequence);
+        const unsigned char* ref = base + table[h];
+
+        table[h] = (uint32_t)(ip - base);
+
+        if (ref < ip && (size_t)(ip - ref) <= MAX_OFFSET && read32(ref) == sequence)
+        {
+            size_t matchLen = MIN_MATCH;
+            while (ip + matchLen < end && ref[matchLen] == ip[matchLen])
+                matchLen++;
+
+            if (!writeSequence(op, opEnd, anchor, ip - anchor, ip - ref, matchLen))
+                return 0;
+
+            ip += matchLen;
+            anchor = ip;
+        }
+
+        else
+            ip++;
+    }
+
+    if (!writeSequence(op, opEnd, anchor, end - anchor, 0, 0))
+        return 0;
+
+    return op - (unsigned char*)dst;
+}
+
+/**
+ * @brief decompress a buffer that was compressed by Compressor::compress.
+ * 
+ * @param src The compressed data.
+ * @param srcSize The size of the compressed data.
+ * @param dst The buffer to write the original data to.
+ * @param dstSize The size of the original data.
+ * 
+ * @return bool true if the data was decompressed to exactly dstSize bytes.
+ */
+bool Compressor::decompress(const char* src, const size_t srcSize, char* dst, const size_t dstSize)
+{
+    const unsigned char* ip = (const unsigned char*)src;
+    const unsigned char* ipEnd = ip + srcSize;
+    unsigned char* op = (unsigned char*)dst;
+    unsigned char* opEnd = op + dstSize;
+
+    while (ip < ipEnd)
+    {
+        unsigned char token = *ip++;
+        size_t literalsLen = token >> 4, matchLen = token & 0x0F;
+
+        if (literalsLen == 15)
+        {
+            unsigned char byte;
+            do
+            {
+                if (ip >= ipEnd) return false;
+                byte = *ip++;
+                literalsLen += byte;
+            } while (byte == 255);
+        }
+
+        if ((size_t)(ipEnd - ip) < literalsLen || (size_t)(opEnd - op) < literalsLen)
+            return false;
+
+        memcpy(op, ip, literalsLen);
+        ip += literalsLen;
+        op += literalsLen;
+
+        if (ip == ipEnd)
+            break;
+
+        if (ipEnd - ip < 2) return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if (matchLen == 15)
+        {
+            unsigned char byte;
+            do
+            {
+                if (ip >= ipEnd) return false;
+                byte = *ip++;
+                matchLen += byte;
+            } while (byte == 255);
+        }
+
+        matchLen += MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(op - (unsigned char*)dst) || (size_t)(opEnd - op) < matchLen)
+            return false;
+
+        // the match may overlap the bytes it produces, so copy byte by byte
+        const unsigned char* match = op - offset;
+        for (size_t i = 0; i < matchLen; i++)
+            op[i] = match[i];
+        op += matchLen;
+    }
+
+    return op == opEnd;
+}
@@ -0,0 +1,93 @@
+#include <afs/crc32c.h>
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define AFS_HAVE_SSE42_CRC 1
+#endif
+
+constexpr uint32_t CRC32C_POLY = 0x82F63B78; // Castagnoli polynomial, reflected
+
+struct crcTable
+{
+    uint32_t entries[256];
+
+    crcTable()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+            entries[i] = crc;
+        }
+    }
+};
+
+static const crcTable table;
+
+uint32_t Crc32c::computeTable(uint32_t crc, const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        crc = table.entries[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+
+    return crc;
+}
+
+#ifdef AFS_HAVE_SSE42_CRC
+__attribute__((target("sse4.2")))
+uint32_t Crc32c::computeHardware(uint32_t crc, const char* data, size_t size)
+{
+    uint64_t crc64 = crc;
+
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), data += sizeof(uint64_t))
+    {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        crc64 = _mm_crc32_u64(crc64, value);
+    }
+
+    crc = (uint32_t)crc64;
+
+    for (; size > 0; size--, data++)
+        crc = _mm_crc32_u8(crc, *data);
+
+    return crc;
+}
+#else
+uint32_t Crc32c::computeHardware(uint32_t crc, const char* data, size_t size)
+{
+    return computeTable(crc, data, size);
+}
+#endif
+
+/**
+ * @brief Check if the CPU has the SSE4.2 crc32 instruction.
+ */
+bool Crc32c::isHardwareAccelerated()
+{
+#ifdef AFS_HAVE_SSE42_CRC
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Calculate the CRC32C of a buffer, using the crc32 instruction when the CPU has it.
+ * 
+ * @param data The buffer.
+ * @param size The size of the buffer.
+ * @param crc The CRC of the previous data to continue from.
+ * 
+ * @return uint32_t The CRC32C of the data.
+ */
+uint32_t Crc32c::compute(const char* data, const size_t size, const uint32_t crc)
+{
+    if (isHardwareAccelerated())
+        return ~computeHardware(~crc, data, size);
+
+    return ~computeTable(~crc, data, size);
+}
@@ -0,0 +1,241 @@
+#include <afs/dedupIndex.h>
+
+#include <vector>
+#include <stdexcept>
+
+#include <cstring>
+
+constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl(const uint64_t value, const int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const char* p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t round64(uint64_t acc, const uint64_t input)
+{
+    acc += input * PRIME64_2;
+    return rotl(acc, 31) * PRIME64_1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, const uint64_t value)
+{
+    acc ^= round64(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+DedupIndex::DedupIndex(Disk* disk, const address indexAddr):
+    m_disk(disk), m_indexAddr(indexAddr), m_capacity(getCapacity(disk))
+{
+}
+
+uint32_t DedupIndex::getCapacity(const Disk* disk)
+{
+    uint32_t capacity = 1;
+
+    while (capacity < disk->getBlocksAmount())
+        capacity <<= 1;
+
+    return capacity * 2;
+}
+
+/**
+ * @brief Get the amount of blocks the index needs for a disk.
+ */
+uint32_t DedupIndex::getIndexBlocksAmount(const Disk* disk)
+{
+    return (getCapacity(disk) * sizeof(dedupEntry) + disk->getBlockSize() - 1) / disk->getBlockSize();
+}
+
+/**
+ * @brief Calculate the fingerprint of a block (xxHash64 with seed 0).
+ * 
+ * @param data The content of the block.
+ * @param size The size of the content.
+ * 
+ * @return uint64_t The fingerprint of the content.
+ */
+uint64_t DedupIndex::fingerprint(const char* data, const size_t size)
+{
+    const char* p = data;
+    const char* end = data + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = PRIME64_1 + PRIME64_2, v2 = PRIME64_2, v3 = 0, v4 = -PRIME64_1;
+
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+        }
+
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = mergeRound(hash, v1);
+        hash = mergeRound(hash, v2);
+        hash = mergeRound(hash, v3);
+        hash = mergeRound(hash, v4);
+    }
+
+    else
+        hash = PRIME64_5;
+
+    hash += size;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        hash ^= round64(0, read64(p));
+        hash = rotl(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+
+    if (p + 4 <= end)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        hash ^= value * PRIME64_1;
+        hash = rotl(hash, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+    {
+        hash ^= (unsigned char)*p * PRIME64_5;
+        hash = rotl(hash, 11) * PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+dedupEntry DedupIndex::readEntry(const uint32_t slot) const
+{
+    dedupEntry entry;
+
+    m_disk->read(m_indexAddr + slot * sizeof(dedupEntry), sizeof(dedupEntry), (char*)&entry);
+
+    return entry;
+}
+
+void DedupIndex::writeEntry(const uint32_t slot, const dedupEntry& entry)
+{
+    m_disk->write(m_indexAddr + slot * sizeof(dedupEntry), sizeof(dedupEntry), (const char*)&entry);
+}
+
+/**
+ * @brief find a block that holds the given content.
+ * 
+ * @param data The content of a full block.
+ * @param fingerprint The fingerprint of the content.
+ * 
+ * @return address The address of a block with the same content, 0 if there is none.
+ */
+address DedupIndex::find(const char* data, const uint64_t fingerprint) const
+{
+    uint32_t blockSize = m_disk->getBlockSize(), slot = fingerprint & (m_capacity - 1);
+    std::vector<char> blockData(blockSize);
+
+    for (uint32_t i = 0; i < m_capacity; i++, slot = (slot + 1) & (m_capacity - 1))
+    {
+        dedupEntry entry = readEntry(slot);
+
+        if (entry.blockAddr == 0)
+            break;
+
+        if (entry.fingerprint != fingerprint)
+            continue;
+
+        // the fingerprints match, make sure the content does too
+        m_disk->read(entry.blockAddr, blockSize, blockData.data());
+        if (memcmp(blockData.data(), data, blockSize) == 0)
+            return entry.blockAddr;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief register a block in the index.
+ * 
+ * @param fingerprint The fingerprint of the content of the block.
+ * @param blockAddr The address of the block.
+ */
+void DedupIndex::insert(const uint64_t fingerprint, const address blockAddr)
+{
+    uint32_t slot = fingerprint & (m_capacity - 1);
+
+    for (uint32_t i = 0; i < m_capacity; i++, slot = (slot + 1) & (m_capacity - 1))
+    {
+        if (readEntry(slot).blockAddr == 0)
+        {
+            writeEntry(slot, dedupEntry{fingerprint, blockAddr});
+            return;
+        }
+    }
+
+    throw std::runtime_error("dedup index is full");
+}
+
+/**
+ * @brief remove a block from the index.
+ * 
+ * @param fingerprint The fingerprint of the content of the block.
+ * @param blockAddr The address of the block.
+ */
+void DedupIndex::remove(const uint64_t fingerprint, const address blockAddr)
+{
+    uint32_t mask = m_capacity - 1, slot = fingerprint & mask, i;
+    dedupEntry entry;
+
+    for (i = 0; i < m_capacity; i++, slot = (slot + 1) & mask)
+    {
+        entry = readEntry(slot);
+
+        if (entry.blockAddr == 0)
+            return;
+
+        if (entry.fingerprint == fingerprint && entry.blockAddr == blockAddr)
+            break;
+    }
+
+    if (i == m_capacity)
+        return;
+
+    // shift back the entries that were probed past the removed slot
+    for (uint32_t next = (slot + 1) & mask; ; next = (next + 1) & mask)
+    {
+        entry = readEntry(next);
+
+        if (entry.blockAddr == 0)
+            break;
+
+        uint32_t home = entry.fingerprint & mask;
+        bool stays = slot <= next ? (home > slot && home <= next) : (home > slot || home <= next);
+
+        if (!stays)
+        {
+            writeEntry(slot, entry);
+            slot = next;
+        }
+    }
+
+    writeEntry(slot, dedupEntry{0, 0});
+}
@@ -1,34 +1,128 @@
 #include <afs/disk.h>
 #include <afs/helper.h>
+#include <afs/crc32c.h>
+#include <afs/snapshotTable.h>
+#include <afs/stripeSet.h>
 
 #include <string.h>
 #include <sys/mman.h>
 #include <errno.h>
 #include <string>
+#include <vector>
 #include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <chrono>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/file.h>
 
-Disk::Disk(const char* filePath, const uint32_t blockSize, const uint32_t nblocks):
-    m_blockSize(blockSize), m_nblocks(nblocks)
+/**
+ * @brief open a disk file, it is created if it does not exist and is opened for writing.
+ * 
+ * @param filePath The disk file, or any member of a striped volume.
+ * @param blockSize The size of a block.
+ * @param nblocks The amount of blocks.
+ * @param mode OPEN_READ_ONLY maps the disk read-only, the reads can then run next
+ *             to the process that writes it (see beginRead).
+ */
+Disk::Disk(const char* filePath, const uint32_t blockSize, const uint32_t nblocks, const OpenMode mode):
+    fd(-1), m_ownsMap(true), m_blockSize(blockSize), m_nblocks(nblocks), m_stripes(nullptr), m_checksums(nullptr), m_checksumFirstBlock(0),
+    m_checksumBlocks(0), m_pending(nullptr), m_dirtyList(nullptr), m_dirtyCapacity(0), m_verifyChecksums(true), m_discardSupported(true),
+    m_readOnly(mode == OPEN_READ_ONLY), m_sequence(nullptr), m_sectionDepth(0), m_sectionWritten(false), m_readSequence(0), m_snapshots(nullptr), m_view(nullptr), m_viewSlot(0)
 {
-    if (!Helper::isFileExist(filePath))
+    bool exists = Helper::isFileExist(filePath);
+
+    if (!exists && m_readOnly)
+        throw std::runtime_error(std::string("disk file does not exist: ") + filePath);
+
+    if (!exists)
         createDiskFile(filePath);
 
+    // a striped volume is opened by any of its members and mapped stripe by stripe
+    else if (StripeSet::isStripeSet(filePath))
+        m_stripes = new StripeSet(filePath, m_readOnly);
+
+    else if (m_readOnly)
+        fd = open(filePath, O_RDONLY | O_CLOEXEC);
+
     else
         fd = Helper::openExistingFile(filePath);
 
-    m_fileMap = (unsigned char *)mmap(NULL, m_blockSize * m_nblocks, PROT_READ | PROT_WRITE,
-                    MAP_SHARED, fd, 0);
+    if (!m_stripes && fd == -1)
+        throw std::runtime_error(std::string("open failed: ") + strerror(errno));
+
+    try
+    {
+        if (m_stripes)
+            m_fileMap = m_stripes->map(getDiskSize(), m_readOnly);
+        else
+            m_fileMap = (unsigned char *)mmap(NULL, getDiskSize(), m_readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (m_fileMap == (unsigned char *)-1)
+            throw std::runtime_error(strerror(errno));
+
+        m_sequence = (std::atomic<uint64_t>*)(m_fileMap + SEQUENCE_ADDR);
+        m_dirtyList = (uint32_t*)(m_fileMap + DIRTY_LIST_ADDR);
+        m_dirtyCapacity = (m_blockSize - DIRTY_LIST_ADDR) / sizeof(uint32_t) - 1;
+
+        if (!m_readOnly)
+            lockWriter();
+    }
+    catch (...)
+    {
+        // the sequence is set once the disk is mapped
+        if (m_sequence)
+            munmap(m_fileMap, getDiskSize());
+
+        delete m_stripes;
+
+        if (fd != -1)
+            close(fd);
+
+        throw;
+    }
+}
 
-	if (m_fileMap == (unsigned char *)-1)
-		throw std::runtime_error(strerror(errno));
+/**
+ * @brief A read-only view of a snapshot over the mapping of the live disk.
+ * 
+ * @param live The live disk, it must stay open while the view is used.
+ * @param snapshots The snapshots of the live disk.
+ * @param slot The slot of the snapshot to read.
+ */
+Disk::Disk(const Disk& live, const SnapshotTable* snapshots, const size_t slot):
+    fd(-1), m_fileMap(live.m_fileMap), m_ownsMap(false), m_blockSize(live.m_blockSize), m_nblocks(live.m_nblocks), m_stripes(nullptr),
+    m_checksums(nullptr), m_checksumFirstBlock(0), m_checksumBlocks(0), m_pending(live.m_pending), m_dirtyList(nullptr), m_dirtyCapacity(0),
+    m_verifyChecksums(live.m_verifyChecksums), m_discardSupported(false), m_readOnly(false), m_sequence(nullptr), m_sectionDepth(0),
+    m_sectionWritten(false), m_readSequence(0), m_snapshots(nullptr), m_view(snapshots), m_viewSlot(slot)
+{
+    if (live.m_checksums)
+    {
+        m_checksums = live.m_checksums;
+        m_checksumFirstBlock = live.m_checksumFirstBlock;
+        m_checksumBlocks = live.m_checksumBlocks;
+        m_verified.reset(new BlockBitmap(m_nblocks));
+    }
 }
 
 Disk::~Disk()
 {
+    if (!m_ownsMap)
+        return;
+
+    // the writes of a section that was left open are finished
+    updatePendingChecksums();
+
+    if (m_sectionWritten)
+        m_sequence->store(m_sequence->load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
     munmap(m_fileMap, getDiskSize());
-    close(fd);
+    delete m_pending;
+    delete m_stripes;
+
+    if (fd != -1)
+        close(fd);
 }
 
 void Disk::createDiskFile(const char* filePath)
@@ -44,12 +138,550 @@ void Disk::createDiskFile(const char* filePath)
     ::write(fd, "\0", 1);
 }
 
+/**
+ * @brief make sure no other process writes the disk. A writer that stopped in the
+ *        middle of a write section leaves an odd sequence, it is finished here and
+ *        the blocks in the dirty list get their checksums once they are enabled.
+ */
+void Disk::lockWriter()
+{
+    int fileFd;
+    unsigned long offset, length;
+
+    locate(0, fileFd, offset, length);
+
+    if (flock(fileFd, LOCK_EX | LOCK_NB) != 0)
+        throw std::runtime_error(errno == EWOULDBLOCK ? "the disk is open for writing in another process" : strerror(errno));
+
+    uint64_t sequence = m_sequence->load(std::memory_order_acquire);
+
+    if (sequence % 2 == 1)
+        m_sequence->store(sequence + 1, std::memory_order_release);
+}
+
+/**
+ * @brief whether a process has the disk open for writing.
+ */
+bool Disk::hasWriter() const
+{
+    int fileFd;
+    unsigned long offset, length;
+
+    locate(0, fileFd, offset, length);
+
+    if (flock(fileFd, LOCK_SH | LOCK_NB) != 0)
+        return true;
+
+    flock(fileFd, LOCK_UN);
+    return false;
+}
+
+/**
+ * @brief start a write section, the writes until the matching leaveWriteSection
+ *        are seen by read-only mounts at once. Sections nest, every write is one too.
+ */
+void Disk::enterWriteSection()
+{
+    std::lock_guard<std::mutex> lock(m_sectionLock);
+
+    m_sectionDepth++;
+}
+
+void Disk::leaveWriteSection()
+{
+    std::lock_guard<std::mutex> lock(m_sectionLock);
+
+    if (--m_sectionDepth > 0)
+        return;
+
+    // read-only mounts verify the blocks of the section once the sequence is even again
+    updatePendingChecksums();
+
+    if (!m_sectionWritten)
+        return;
+
+    m_sequence->store(m_sequence->load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    m_sectionWritten = false;
+}
+
+/**
+ * @brief calculate the checksums of the blocks in the dirty list, once for all the
+ *        writes of the section that ended to a block, and empty the list.
+ */
+void Disk::updatePendingChecksums()
+{
+    if (!m_checksums || !m_dirtyList || m_readOnly)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_checksumLock);
+    uint32_t amount = std::min(m_dirtyList[0], m_dirtyCapacity);
+
+    for (uint32_t i = 1; i <= amount; i++)
+    {
+        uint32_t blockNum = m_dirtyList[i];
+
+        if (blockNum < m_nblocks && hasChecksum(blockNum))
+        {
+            m_checksums[blockNum] = computeChecksum(blockNum);
+            m_pending->reset(blockNum);
+        }
+    }
+
+    m_dirtyList[0] = 0;
+}
+
+/**
+ * @brief make the sequence odd before the first write of a section.
+ */
+void Disk::markWritten()
+{
+    std::lock_guard<std::mutex> lock(m_sectionLock);
+
+    if (m_sectionWritten)
+        return;
+
+    m_sequence->store(m_sequence->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_sectionWritten = true;
+}
+
+/**
+ * @brief start reading a disk that another process may write. The reads until
+ *        endRead see a consistent disk if endRead returns true, otherwise they
+ *        have to be made again. A read throws once the disk was written since.
+ * 
+ * @return uint64_t The sequence to pass to endRead.
+ */
+uint64_t Disk::beginRead() const
+{
+    for (unsigned int spins = 0;; spins++)
+    {
+        uint64_t sequence = m_sequence->load(std::memory_order_acquire);
+
+        if (sequence % 2 == 0)
+        {
+            // concurrent reads keep the latest, it only differs from the disk once all of them are stale
+            uint64_t latest = m_readSequence.load(std::memory_order_relaxed);
+
+            while (latest < sequence && !m_readSequence.compare_exchange_weak(latest, sequence, std::memory_order_relaxed));
+
+            return sequence;
+        }
+
+        // the writer is in the middle of a section, unless it is gone
+        if (spins % 4096 == 4095 && !hasWriter())
+            throw std::runtime_error("the disk was left in the middle of a write, open it for writing to finish it");
+
+        if (spins < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+bool Disk::endRead(const uint64_t sequence) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return m_sequence->load(std::memory_order_relaxed) == sequence;
+}
+
+/**
+ * @brief Get the checksum of a block, the sequence and the dirty list are left out of the header block.
+ */
+uint32_t Disk::computeChecksum(const uint32_t blockNum) const
+{
+    const char* block = (const char*)m_fileMap + (unsigned long)blockNum * m_blockSize;
+
+    static const char zeros[MIN_SIZE] = {};
+
+    if (blockNum != 0)
+        return Crc32c::compute(block, m_blockSize);
+
+    // the header block is hashed as if it held zeros from the sequence on
+    uint32_t crc = Crc32c::compute(block, SEQUENCE_ADDR);
+
+    for (uint32_t offset = SEQUENCE_ADDR; offset < m_blockSize; offset += sizeof(zeros))
+        crc = Crc32c::compute(zeros, std::min<uint32_t>(sizeof(zeros), m_blockSize - offset), crc);
+
+    return crc;
+}
+
+/**
+ * @brief Get the amount of blocks needed to hold the checksums of a disk.
+ */
+uint32_t Disk::getChecksumBlocksAmount(const uint32_t blockSize, const uint32_t nblocks)
+{
+    return ((uint64_t)nblocks * sizeof(uint32_t) + blockSize - 1) / blockSize;
+}
+
+/**
+ * @brief keep a CRC32C for every block of the disk, every write updates the
+ *        checksums of the blocks it touches and reads verify them.
+ * 
+ * @param checksumAddr The address of the area that holds the checksums.
+ * @param initialize Whether to calculate the checksums of all the blocks (for a new area).
+ */
+void Disk::enableChecksums(const unsigned long checksumAddr, bool initialize)
+{
+    std::vector<char> zeros(m_blockSize, 0);
+    uint32_t zeroChecksum = Crc32c::compute(zeros.data(), m_blockSize);
+    unsigned long dataStart = 0, dataEnd = 0;
+
+    m_checksums = (uint32_t*)(m_fileMap + checksumAddr);
+    m_checksumFirstBlock = checksumAddr / m_blockSize;
+    m_checksumBlocks = getChecksumBlocksAmount(m_blockSize, m_nblocks);
+    m_verified.reset(new BlockBitmap(m_nblocks));
+    delete m_pending;
+    m_pending = new BlockBitmap(m_nblocks);
+
+    // the blocks are verified the first time they are read, a mount does nothing per block
+    // but finish the checksums of a writer that stopped in the middle of a section
+    if (!initialize)
+    {
+        updatePendingChecksums();
+        return;
+    }
+
+    if (m_dirtyList && !m_readOnly)
+        m_dirtyList[0] = 0;
+
+    // the holes of the disk file are found on the host once the mapping is written back
+    msync(m_fileMap, getDiskSize(), MS_SYNC);
+
+    for (uint32_t i = 0; i < m_nblocks; i++)
+    {
+        unsigned long blockAddr = (unsigned long)i * m_blockSize;
+
+        if (!hasChecksum(i))
+            continue;
+
+        // a block in a hole reads as zeros, so most of a new disk is never read
+        if (blockAddr >= dataEnd)
+            findData(blockAddr, dataStart, dataEnd);
+
+        if (blockAddr + m_blockSize <= dataStart)
+            m_checksums[i] = zeroChecksum;
+        else
+            m_checksums[i] = computeChecksum(i);
+    }
+}
+
+/**
+ * @brief find the host file and the offset in it that keep an address of the disk.
+ * 
+ * @param addr The address on the disk.
+ * @param fileFd Set to the host file.
+ * @param offset Set to the offset in the host file.
+ * @param length Set to the bytes from the address the host file keeps in a row.
+ */
+void Disk::locate(const unsigned long addr, int& fileFd, unsigned long& offset, unsigned long& length) const
+{
+    if (!m_stripes)
+    {
+        fileFd = fd;
+        offset = addr;
+        length = getDiskSize() - addr;
+        return;
+    }
+
+    uint64_t memberOffset, memberLength;
+
+    m_stripes->locate(addr, fileFd, memberOffset, memberLength);
+    offset = memberOffset;
+    length = std::min<unsigned long>(memberLength, getDiskSize() - addr);
+}
+
+/**
+ * @brief find the next range of the disk file that holds data, the rest of the file are holes.
+ *        On a striped volume the range ends with its stripe unit at the latest.
+ * 
+ * @param from The address to search from.
+ * @param dataStart Set to the start of the range (the size of the disk if there is none).
+ * @param dataEnd Set to the end of the range.
+ */
+void Disk::findData(const unsigned long from, unsigned long& dataStart, unsigned long& dataEnd) const
+{
+    for (unsigned long addr = from; addr < getDiskSize(); )
+    {
+        int fileFd;
+        unsigned long offset, length;
+
+        locate(addr, fileFd, offset, length);
+
+        off_t start = lseek(fileFd, offset, SEEK_DATA);
+
+        // a host file system that can not tell holes is all data
+        if (start == -1 && errno != ENXIO)
+        {
+            dataStart = addr;
+            dataEnd = addr + length;
+            return;
+        }
+
+        if (start != -1 && (unsigned long)start < offset + length)
+        {
+            off_t end = lseek(fileFd, start, SEEK_HOLE);
+
+            dataStart = addr + (start - offset);
+            dataEnd = addr + (end == -1 ? length : std::min<unsigned long>(end - offset, length));
+            return;
+        }
+
+        addr += length;
+    }
+
+    dataStart = dataEnd = getDiskSize();
+}
+
+bool Disk::hasChecksum(const uint32_t blockNum) const
+{
+    return blockNum < m_checksumFirstBlock || blockNum >= m_checksumFirstBlock + m_checksumBlocks;
+}
+
+/**
+ * @brief compare a block to its checksum.
+ * 
+ * @param blockNum The number of the block.
+ * 
+ * @return bool true if the content of the block matches its checksum.
+ */
+bool Disk::verifyBlock(const uint32_t blockNum) const
+{
+    // a block written in the open section gets its checksum when the section ends
+    if (!m_checksums || !hasChecksum(blockNum) || m_pending->test(blockNum))
+        return true;
+
+    // the block is hashed without the lock so several threads can verify at once
+    uint32_t checksum = computeChecksum(blockNum);
+
+    std::lock_guard<std::mutex> lock(m_checksumLock);
+
+    if (m_pending->test(blockNum))
+        return true;
+
+    // a write may have changed the block meanwhile
+    if (checksum != m_checksums[blockNum])
+        checksum = computeChecksum(blockNum);
+
+    bool valid = checksum == m_checksums[blockNum];
+
+    if (valid)
+        m_verified->set(blockNum);
+
+    return valid;
+}
+
+/**
+ * @brief verify the blocks of a range that were not verified yet.
+ */
+void Disk::verifyRange(const unsigned long addr, const int size) const
+{
+    for (uint32_t blockNum = addr / m_blockSize; blockNum <= (addr + size - 1) / m_blockSize; blockNum++)
+    {
+        if (!m_verified->test(blockNum) && !verifyBlock(blockNum))
+            throw std::runtime_error("checksum mismatch in block " + std::to_string(blockNum));
+    }
+}
+
 void Disk::read(unsigned long addr, int size, char* ans) const 
 {
+    // addresses read from a disk that changed under the reads may point anywhere
+    if (size < 0 || addr + size > getDiskSize())
+        throw std::runtime_error("read past the end of the disk");
+
+    if (!m_view)
+        return readRange(addr, size, ans);
+
+    std::lock_guard<std::recursive_mutex> lock(m_view->getLock());
+
+    // every block is read from where the snapshot keeps it
+    while (size > 0)
+    {
+        uint32_t offset = addr % m_blockSize, partSize = std::min(size, (int)(m_blockSize - offset));
+        unsigned int blockNum = m_view->translate(m_viewSlot, addr / m_blockSize);
+
+        readRange((unsigned long)blockNum * m_blockSize + offset, partSize, ans);
+
+        addr += partSize;
+        ans += partSize;
+        size -= partSize;
+    }
+}
+
+void Disk::readRange(unsigned long addr, int size, char* ans) const
+{
+    // the content is not used once the writer started another section, the read is made again
+    if (m_readOnly && m_sequence->load(std::memory_order_acquire) != m_readSequence.load(std::memory_order_relaxed))
+        throw std::runtime_error("the disk was written while it was read");
+
+    // the members of a striped range are asked for their parts at once, instead of one after the other by the copy
+    if (m_stripes && size > 0 && addr / m_stripes->getStripeUnit() != (addr + size - 1) / m_stripes->getStripeUnit())
+        prefetch(addr, size);
+
+    if (m_checksums && m_verifyChecksums && size > 0)
+        verifyRange(addr, size);
+
     memcpy(ans, m_fileMap + addr, size);
 }
 
 void Disk::write(unsigned long addr, int size, const char* data)
 {
+    if (m_view)
+        throw std::runtime_error("a snapshot is read-only");
+
+    if (m_readOnly)
+        throw std::runtime_error("the disk is open read-only");
+
+    DiskWriteSection section(this);
+    markWritten();
+
+    if (!m_snapshots)
+        return writeRange(addr, size, data);
+
+    std::lock_guard<std::recursive_mutex> lock(m_snapshots->getLock());
+
+    m_snapshots->beforeWrite(addr, size);
+    writeRange(addr, size, data);
+}
+
+void Disk::writeRange(unsigned long addr, int size, const char* data)
+{
+    if (!m_checksums || size <= 0)
+    {
+        memcpy(m_fileMap + addr, data, size);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_checksumLock);
+    uint32_t firstBlock = addr / m_blockSize, lastBlock = (addr + size - 1) / m_blockSize;
+
+    // a block that is only partly overwritten must be valid, or its corruption would get a new checksum
+    for (uint32_t blockNum = firstBlock; m_verifyChecksums && blockNum <= lastBlock; blockNum++)
+    {
+        unsigned long blockAddr = (unsigned long)blockNum * m_blockSize;
+        bool partial = addr > blockAddr || addr + size < blockAddr + m_blockSize;
+
+        if (partial && hasChecksum(blockNum) && !m_verified->test(blockNum) &&
+            computeChecksum(blockNum) != m_checksums[blockNum])
+            throw std::runtime_error("checksum mismatch in block " + std::to_string(blockNum));
+    }
+
+    // the checksums are calculated when the outermost section ends, the small writes of
+    // an operation often hit the same table and header blocks again and again. A block is
+    // listed on the disk before it changes, so a crash only leaves the listed blocks to update
+    for (uint32_t blockNum = firstBlock; blockNum <= lastBlock; blockNum++)
+    {
+        if (hasChecksum(blockNum) && !m_pending->test(blockNum) && m_dirtyList[0] < m_dirtyCapacity)
+        {
+            m_dirtyList[m_dirtyList[0] + 1] = blockNum;
+            m_dirtyList[0]++;
+            m_pending->set(blockNum);
+        }
+
+        m_verified->set(blockNum);
+    }
+
     memcpy(m_fileMap + addr, data, size);
-}
\ No newline at end of file
+
+    // the blocks that did not fit in the list get their checksums right away
+    for (uint32_t blockNum = firstBlock; blockNum <= lastBlock; blockNum++)
+    {
+        if (hasChecksum(blockNum) && !m_pending->test(blockNum))
+            m_checksums[blockNum] = computeChecksum(blockNum);
+    }
+}
+
+/**
+ * @brief tell the host file system that a range of blocks is not used anymore, so it
+ *        can release their space. The range reads as zeros afterwards.
+ * 
+ * @param addr The address of the first block.
+ * @param size The size of the range (whole blocks).
+ */
+void Disk::discard(unsigned long addr, unsigned long size)
+{
+    if (m_view)
+        throw std::runtime_error("a snapshot is read-only");
+
+    if (m_readOnly)
+        throw std::runtime_error("the disk is open read-only");
+
+    if (!m_discardSupported || size == 0)
+        return;
+
+    DiskWriteSection section(this);
+    markWritten();
+
+    std::lock_guard<std::mutex> lock(m_checksumLock);
+    unsigned long end = addr;
+
+    // a striped range is punched in every member it spans, up to the first one that can not
+    while (end < addr + size)
+    {
+        int fileFd;
+        unsigned long offset, length;
+
+        locate(end, fileFd, offset, length);
+        length = std::min(length, addr + size - end);
+
+        if (fallocate(fileFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) != 0)
+        {
+            m_discardSupported = false;
+            break;
+        }
+
+        end += length;
+    }
+
+    if (!m_checksums)
+        return;
+
+    std::vector<char> zeros(m_blockSize, 0);
+    uint32_t zeroChecksum = Crc32c::compute(zeros.data(), m_blockSize);
+
+    for (uint32_t blockNum = addr / m_blockSize; blockNum < end / m_blockSize; blockNum++)
+    {
+        if (hasChecksum(blockNum))
+        {
+            m_checksums[blockNum] = zeroChecksum;
+            m_verified->set(blockNum);
+        }
+    }
+}
+
+/**
+ * @brief start reading a range of the disk into memory in the background, so
+ *        a later read of it does not wait for the device.
+ */
+void Disk::prefetch(unsigned long addr, unsigned long size) const
+{
+    unsigned long pageSize = sysconf(_SC_PAGESIZE), start = addr - addr % pageSize;
+
+    if (size == 0 || addr >= getDiskSize())
+        return;
+
+    size = std::min(size, getDiskSize() - addr);
+    madvise(m_fileMap + start, addr + size - start, MADV_WILLNEED);
+}
+
+/**
+ * @brief tell the kernel how a range of the disk is going to be read.
+ * 
+ * @param pattern sequential reads get a bigger kernel read-ahead, random ones none.
+ * @param addr the start of the range.
+ * @param size the size of the range, 0 for the rest of the disk.
+ */
+void Disk::adviseAccess(const AccessPattern pattern, unsigned long addr, unsigned long size) const
+{
+    unsigned long pageSize = sysconf(_SC_PAGESIZE), start = addr - addr % pageSize;
+    int advice = pattern == ACCESS_SEQUENTIAL ? MADV_SEQUENTIAL : pattern == ACCESS_RANDOM ? MADV_RANDOM : MADV_NORMAL;
+
+    if (addr >= getDiskSize())
+        return;
+
+    if (size == 0 || size > getDiskSize() - addr)
+        size = getDiskSize() - addr;
+
+    madvise(m_fileMap + start, addr + size - start, advice);
+}
@@ -0,0 +1,173 @@
+#include <afs/fragmentTable.h>
+#include <afs/helper.h>
+
+#include <stdexcept>
+
+FragmentTable::FragmentTable(Disk* disk, BlocksTable* dblocksTable, struct afsHeader* header):
+    m_disk(disk), m_dblocksTable(dblocksTable), m_header(header)
+{
+    address currentAddr = m_header->fragMapAddr;
+    uint32_t entriesPerBlock = getEntriesPerBlock(), hops = 0;
+
+    // load the fragment map chain into memory
+    while (currentAddr != 0)
+    {
+        if (hops++ > m_disk->getBlocksAmount())
+            throw std::runtime_error("block chain has a loop");
+
+        std::vector<fragMapEntry> entries(entriesPerBlock);
+        m_disk->read(currentAddr, entriesPerBlock * sizeof(fragMapEntry), (char*)entries.data());
+
+        for (const fragMapEntry& entry : entries)
+        {
+            if (entry.blockAddr != 0)
+                m_entryIndex[entry.blockAddr] = m_entries.size();
+            m_entries.push_back(entry);
+        }
+
+        m_mapBlocks.push_back(currentAddr);
+        currentAddr = Helper::getNextBlock(m_disk, currentAddr);
+    }
+}
+
+uint32_t FragmentTable::getFragmentSize() const
+{
+    return m_disk->getBlockSize() / FRAGMENTS_PER_BLOCK;
+}
+
+/**
+ * @brief Get the biggest file tail that is packed into fragments instead of a full block.
+ */
+uint32_t FragmentTable::getMaxTailSize() const
+{
+    return getFragmentSize() * TAIL_MAX_FRAGMENTS;
+}
+
+uint32_t FragmentTable::getEntriesPerBlock() const
+{
+    return (m_disk->getBlockSize() - sizeof(address)) / sizeof(fragMapEntry);
+}
+
+/**
+ * @brief allocate a run of contiguous fragments inside a shared block.
+ * 
+ * @param size The amount of bytes the fragments need to hold.
+ * 
+ * @return address The address of the first allocated fragment.
+ */
+address FragmentTable::allocate(const uint32_t size)
+{
+    uint32_t fragments = (size + getFragmentSize() - 1) / getFragmentSize();
+    uint16_t runMask = (uint16_t)((1u << fragments) - 1);
+
+    if (fragments == 0 || fragments > TAIL_MAX_FRAGMENTS)
+        throw std::runtime_error("invalid fragment allocation size");
+
+    for (size_t i = 0; i <= m_entries.size(); i++)
+    {
+        if (i == m_entries.size())
+            i = addFragmentBlock();
+
+        fragMapEntry& entry = m_entries[i];
+        if (entry.blockAddr == 0)
+            continue;
+
+        for (uint32_t first = 0; first + fragments <= FRAGMENTS_PER_BLOCK; first++)
+        {
+            if ((entry.usedMask & (runMask << first)) == 0)
+            {
+                entry.usedMask |= runMask << first;
+                writeEntry(i);
+
+                return entry.blockAddr + first * getFragmentSize();
+            }
+        }
+    }
+
+    throw std::runtime_error("could not allocate fragments");
+}
+
+/**
+ * @brief release fragments, the shared block is freed once all of its fragments are released.
+ * 
+ * @param fragAddr The address of the first fragment.
+ * @param size The amount of bytes the fragments hold.
+ */
+void FragmentTable::release(const address fragAddr, const uint32_t size)
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    address blockAddr = fragAddr - (fragAddr % blockSize);
+    uint32_t first = (fragAddr % blockSize) / getFragmentSize();
+    uint32_t fragments = (size + getFragmentSize() - 1) / getFragmentSize();
+    auto it = m_entryIndex.find(blockAddr);
+
+    if (it == m_entryIndex.end())
+        throw std::runtime_error("fragment is not part of the fragment map");
+
+    size_t index = it->second;
+    fragMapEntry& entry = m_entries[index];
+
+    entry.usedMask &= ~(uint16_t)(((1u << fragments) - 1) << first);
+
+    if (entry.usedMask == 0)
+    {
+        m_dblocksTable->freeDBlock(Helper::addrToBlock(blockSize, blockAddr));
+        m_entryIndex.erase(it);
+        entry.blockAddr = 0;
+    }
+
+    writeEntry(index);
+}
+
+/**
+ * @brief reserve a new block for fragments and register it in the fragment map.
+ * 
+ * @return size_t The index of the entry of the new block.
+ */
+size_t FragmentTable::addFragmentBlock()
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    size_t index = 0;
+
+    while (index < m_entries.size() && m_entries[index].blockAddr != 0)
+        index++;
+
+    // the map is full, chain another block to it
+    if (index == m_entries.size())
+    {
+        unsigned int mapBlock = m_dblocksTable->getFreeBlock();
+        address mapAddr = Helper::blockToAddr(blockSize, mapBlock);
+        std::vector<char> reset(blockSize, 0);
+
+        m_dblocksTable->reserveDBlock(mapBlock);
+        m_disk->write(mapAddr, blockSize, reset.data());
+
+        if (m_mapBlocks.empty())
+        {
+            m_header->fragMapAddr = mapAddr;
+            m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+        }
+        else
+            m_disk->write(m_mapBlocks.back() + blockSize - sizeof(address), sizeof(address), (const char*)&mapAddr);
+
+        m_mapBlocks.push_back(mapAddr);
+        m_entries.resize(m_entries.size() + getEntriesPerBlock(), fragMapEntry{0, 0, {}});
+    }
+
+    unsigned int dataBlock = m_dblocksTable->getFreeBlock();
+    m_dblocksTable->reserveDBlock(dataBlock);
+
+    m_entries[index] = fragMapEntry{Helper::blockToAddr(blockSize, dataBlock), 0, {}};
+    m_entryIndex[m_entries[index].blockAddr] = index;
+    writeEntry(index);
+
+    return index;
+}
+
+void FragmentTable::writeEntry(const size_t index)
+{
+    uint32_t entriesPerBlock = getEntriesPerBlock();
+    address entryAddr = m_mapBlocks[index / entriesPerBlock] + (index % entriesPerBlock) * sizeof(fragMapEntry);
+
+    m_disk->write(entryAddr, sizeof(fragMapEntry), (const char*)&m_entries[index]);
+}
@@ -2,16 +2,76 @@
 #include <afs/bootLoad.h>
 #include <afs/helper.h>
 #include <afs/constants.h>
+#include <afs/blockMap.h>
+#include <afs/compressor.h>
+#include <afs/nameHash.h>
 
 #include <iostream>
+#include <algorithm>
+#include <vector>
+#include <chrono>
 
 #include <cstring>
 #include <cmath>
 
-FileSystem::FileSystem(const char* filePath, uint32_t blockSize, uint32_t nblocks)
+// last visited block of a directory, so its entries are read without walking the chain again.
+// Every thread keeps its own, a cursor of another file system or from before a release of
+// directory blocks is not used.
+struct dirCursor
+{
+    const FileSystem* owner;
+    uint64_t epoch;
+    address dir;
+    uint32_t index;
+    address addr;
+};
+
+static std::atomic<uint64_t> s_dirCursorEpoch(0);
+static thread_local dirCursor t_dirCursor = { nullptr, 0, 0, 0, 0 };
+
+FileSystem::FileSystem(const char* filePath, uint32_t blockSize, uint32_t nblocks):
+    FileSystem(filePath, blockSize, nblocks, OPEN_READ_WRITE)
+{
+}
+
+/**
+ * @brief open an existing disk.
+ * 
+ * A read-only mount maps the disk read-only and never waits for the process that
+ * writes it: every read is made again if the disk was written while it ran, so it
+ * sees the disk before or after a whole operation of the writer. Any amount of
+ * processes can mount a disk read-only, only one can open it for writing.
+ * 
+ * @param filePath The disk file.
+ * @param mode OPEN_READ_WRITE opens it like FileSystem(filePath).
+ */
+FileSystem::FileSystem(const char* filePath, const OpenMode mode):
+    FileSystem(filePath, 4096, 4096, mode)
+{
+}
+
+FileSystem::FileSystem(const char* filePath, uint32_t blockSize, uint32_t nblocks, const OpenMode mode):
+    m_snapshots(nullptr), m_inodeCursor(0),
+    m_readOnly(mode == OPEN_READ_ONLY), m_viewSlot(0), m_loadedSequence(1), m_stopReclaimer(true)
 {
     m_header = BootLoad::load(filePath); // try to load header from existing file.
-    
+
+    if (!m_header && m_readOnly)
+        throw std::runtime_error(std::string("disk file does not exist: ") + filePath);
+
+    if (m_readOnly)
+    {
+        // the tables are loaded by the first read, the writer may be changing them now
+        m_disk = new Disk(filePath, m_header->blockSize, m_header->nblocks, OPEN_READ_ONLY);
+        m_disk->enableChecksums(m_header->checksumAddr, false);
+        m_dblocksTable = new BlocksTable(m_disk, m_header);
+        m_fragments = nullptr;
+        m_refCounts = nullptr;
+        m_dedupIndex = nullptr;
+        m_scrubber = nullptr;
+        return;
+    }
+
     if (!m_header)
     {
         blockSize = Helper::getCorrectSize(blockSize);
@@ -21,43 +81,128 @@ FileSystem::FileSystem(const char* filePath, uint32_t blockSize, uint32_t nblock
             nblocks = MIN_BLOCKS_AMOUNT;
 
         m_disk = new Disk(filePath, blockSize, nblocks);
-        m_dblocksTable = new BlocksTable(m_disk, true);
+        m_dblocksTable = new BlocksTable(m_disk, m_header);
         format();
     }
 
     else
     {
         m_disk = new Disk(filePath, m_header->blockSize, m_header->nblocks);
-        m_dblocksTable = new BlocksTable(m_disk);
+        m_disk->enableChecksums(m_header->checksumAddr, false);
+        m_dblocksTable = new BlocksTable(m_disk, m_header);
+        loadInodeTable();
+    }
+
+    m_fragments = new FragmentTable(m_disk, m_dblocksTable, m_header);
+    m_refCounts = nullptr;
+    m_dedupIndex = nullptr;
+    m_scrubber = nullptr;
+
+    if (m_header->refTableAddr != 0)
+    {
+        m_refCounts = new RefCountTable(m_disk, m_header->refTableAddr);
+        m_dblocksTable->setRefCounts(m_refCounts);
+    }
+
+    if (m_header->dedupIndexAddr != 0)
+    {
+        m_dedupIndex = new DedupIndex(m_disk, m_header->dedupIndexAddr);
+        m_refCounts->setDedupIndex(m_dedupIndex);
     }
+
+    if (m_header->snapshotsAddr != 0)
+    {
+        m_snapshots = new SnapshotTable(m_disk, m_dblocksTable, m_header);
+        m_dblocksTable->setSnapshots(m_snapshots);
+        m_disk->setSnapshots(m_snapshots);
+    }
+
+    // deletes that were not reclaimed before the disk was closed continue in the background
+    m_stopReclaimer = false;
+    m_reclaimer = std::thread(&FileSystem::runReclaimer, this);
+}
+
+/**
+ * @brief open a snapshot of a file system read-only.
+ * 
+ * @param live The file system the snapshot was taken of, it must stay open.
+ * @param snapshotName The name of the snapshot.
+ */
+FileSystem::FileSystem(FileSystem& live, const std::string& snapshotName):
+    m_refCounts(nullptr), m_dedupIndex(nullptr), m_scrubber(nullptr), m_snapshots(live.m_snapshots),
+    m_inodeCursor(0),
+    m_readOnly(true), m_loadedSequence(1), m_stopReclaimer(true)
+{
+    if (!m_snapshots)
+        throw std::runtime_error("no snapshot named " + snapshotName);
+
+    m_header = new struct afsHeader;
+    m_viewSlot = m_snapshots->openView(snapshotName, *m_header);
+    m_disk = new Disk(*live.m_disk, m_snapshots, m_viewSlot);
+    m_dblocksTable = new BlocksTable(m_disk, m_header);
+    m_fragments = nullptr;
+    loadInodeTable();
 }
 
 FileSystem::~FileSystem()
 {
+    if (m_reclaimer.joinable())
+    {
+        {
+            std::lock_guard<SharedMutex> lock(m_lock);
+            m_stopReclaimer = true;
+        }
+
+        m_orphanAdded.notify_all();
+        m_reclaimer.join();
+    }
+
+    // another file system may be made at the same address
+    s_dirCursorEpoch++;
+
+    if (m_readOnly && m_snapshots)
+        m_snapshots->closeView(m_viewSlot);
+    else
+        delete m_snapshots;
+
+    delete m_scrubber;
+    delete m_dedupIndex;
+    delete m_refCounts;
+    delete m_fragments;
     delete m_disk;
     delete m_header;
     delete m_dblocksTable;
 }
 
 /**
- * @brief Formats the default blocks the disk need to have (super block, blocks table, inodes table and root directory)
+ * @brief Formats the default blocks the disk need to have (super block, blocks table and root directory),
+ *        the inode table is allocated when the root directory takes the first inode.
  * 
  */
 void FileSystem::format()
 {
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
     int defaultBlocks = 0;
 
     int dblocksTableAmount = m_disk->getBlocksAmount() / m_disk->getBlockSize(); // calculate the amounts of blocks needed for the blocks table. 
 
     setHeader(); // Set the superblock
+    m_dblocksTable->formatSummary();
+
+    // Super Block + blocks table + free blocks summary
+    defaultBlocks = 1 + dblocksTableAmount + m_dblocksTable->getSummaryBlocksAmount();
 
-    defaultBlocks = 1 + dblocksTableAmount + m_header->inodeBlocks; // Super Block + blocks table + inode table blocks
+    m_dblocksTable->reserveDBlocks(0, defaultBlocks);
 
-    for (int i = 0; i < defaultBlocks; i++)
-        m_dblocksTable->reserveDBlock(i);
+    m_header->checksumAddr = reserveRegion(Disk::getChecksumBlocksAmount(m_disk->getBlockSize(), m_disk->getBlocksAmount()));
+    m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+    m_disk->enableChecksums(m_header->checksumAddr, true);
+    s_dirCursorEpoch++;
     
     // Create root directory
-    createFile("/", true);
+    addFile("/", true);
 }
 
 /**
@@ -67,21 +212,37 @@ void FileSystem::format()
  * @param isDir Boolean which tells us if the file is directory or not.
  */
 void FileSystem::createFile(const std::string& path, const bool isDir) 
+{
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
+
+    addFile(path, isDir);
+}
+
+/**
+ * @brief create a file or a directory, for the operations that hold the lock already.
+ */
+void FileSystem::addFile(const std::string& path, const bool isDir)
 {
     afsPath parsedPath = Helper::splitString(path);
-    address fileAddr = 0;
+    bool fileExists = false;
     uint32_t inodeIndex;
 
     if (parsedPath.size() > 1 && parsedPath[parsedPath.size() - 1] == "/")
         parsedPath.pop_back();
 
+    // the name is looked up in its parent, a missing name only costs a scan of the fingerprints
     try
     {
-        fileAddr = pathToAddr(parsedPath);
+        if (parsedPath.size() == 1)
+            fileExists = getRoot().flags & DIRTYPE;
+        else
+            fileExists = getSiblingIndex(pathToAddr(afsPath(parsedPath.begin(), parsedPath.end() - 1)), parsedPath.back()) != -1;
     }
     catch (std::exception &e) {}
 
-    if (fileAddr != 0) throw std::runtime_error("File with this name already exist");
+    if (fileExists) throw std::runtime_error("File with this name already exist");
 
     std::string fileName = parsedPath[parsedPath.size() - 1];
     std::string joinedPath = Helper::joinString(afsPath(parsedPath.begin(), parsedPath.end() - 1));
@@ -91,6 +252,12 @@ void FileSystem::createFile(const std::string& path, const bool isDir)
     // create inode for the file.
     inode fileInode(isDir);
 
+    if (path != "/")
+    {
+        inode parentInode = pathToInode(afsPath(parsedPath.begin(), parsedPath.end() - 1));
+        fileInode.flags |= parentInode.flags & COMPRESSED;
+    }
+
     if (isDir)
         inodeIndex = createDirectory(joinedPath.empty() ? path : joinedPath , fileInode);
 
@@ -117,104 +284,405 @@ void FileSystem::createFile(const std::string& path, const bool isDir)
  */
 void FileSystem::appendContent(const std::string& filePath, std::string content)
 {
-    inode fileInode = pathToInode(Helper::splitString(filePath));
-    address fileAddr = 0, currentAddr;
-    uint32_t blockSize = m_disk->getBlockSize(), remainingForCurrentBlock = blockSize - (fileInode.fileSize % blockSize) - 4;
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
+    afsPath path = Helper::splitString(filePath);
+    uint32_t fileInodeIdx = pathToInodeIndex(path);
+    inode fileInode;
 
-    if (fileInode.flags & DIRTYPE) 
-        throw std::runtime_error("cant write content to a directory");
+    m_disk->read(inodeIndexToAddr(fileInodeIdx), sizeof(inode), (char*)&fileInode);
 
-    // in case of empty file, reserve a data block for it's content
-    if (fileInode.firstAddr == (address)-1)
-    {
-        unsigned int dataBlock = m_dblocksTable->getFreeBlock();
-        m_dblocksTable->reserveDBlock(dataBlock);
-        fileInode.firstAddr = Helper::blockToAddr(blockSize, dataBlock);
-    }
+    appendData(fileInode, content);
+
+    m_disk->write(inodeIndexToAddr(fileInodeIdx), sizeof(inode), (const char*)&fileInode);
+}
+
+/**
+ * @brief Turn compression on or off for a file or a directory.
+ * 
+ * The content of a file is rewritten in the new format, files created in a
+ * directory inherit the setting of the directory.
+ * 
+ * @param path the path of the file or the directory.
+ * @param enable whether to compress the content.
+ */
+void FileSystem::setCompression(const std::string& path, const bool enable)
+{
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
+    afsPath parsedPath = Helper::splitString(path);
+    uint32_t inodeIdx = pathToInodeIndex(parsedPath);
+    inode fileInode;
 
-    fileAddr = fileInode.firstAddr;
-    currentAddr = Helper::getLastFileBlock(m_disk, fileAddr);
+    m_disk->read(inodeIndexToAddr(inodeIdx), sizeof(inode), (char*)&fileInode);
 
-    // Fragmentize the file into multiple blocks if needed
-    while (content.size() > remainingForCurrentBlock)
-    {
-        std::string currentPart = content.substr(0, remainingForCurrentBlock);
-        content = content.substr(remainingForCurrentBlock, content.size());
-        unsigned int nextBlock = m_dblocksTable->getFreeBlock();
-        m_dblocksTable->reserveDBlock(nextBlock);
+    if ((bool)(fileInode.flags & COMPRESSED) == enable)
+        return;
 
-        currentAddr = Helper::blockToAddr(blockSize, nextBlock);
+    if (!(fileInode.flags & DIRTYPE) && !(fileInode.flags & INLINEDATA) && fileInode.fileSize != 0)
+    {
+        std::string content(fileInode.fileSize, '\0');
 
-        // write the needed content and the next address to the current block.
-        m_disk->write(fileAddr + blockSize - remainingForCurrentBlock - sizeof(address), remainingForCurrentBlock, currentPart.c_str());
-        m_disk->write(fileAddr + blockSize - sizeof(address), sizeof(address), (char*)&currentAddr);
+        readFileData(fileInode, 0, fileInode.fileSize, &content[0]);
+        freeFileData(fileInode);
 
-        // update the file size in the inode
-        fileInode.fileSize += currentPart.size();
-        remainingForCurrentBlock = m_disk->getBlockSize() - sizeof(address);
+        fileInode.flags &= ~TAILPACKED;
+        fileInode.fileSize = 0;
+        fileInode.firstAddr = (address)-1;
+        fileInode.tailAddr = 0;
+        fileInode.flags ^= COMPRESSED;
 
-        // move to the next node (address) in the linked list (file)
-        fileAddr = currentAddr;
+        appendData(fileInode, content);
     }
 
-    m_disk->write(fileAddr + (blockSize - 4) - remainingForCurrentBlock, content.size(), content.c_str());
-    fileInode.fileSize += content.size();
-
-    afsPath path = Helper::splitString(filePath);
-    int fileInodeIdx = getSiblingData(pathToAddr(afsPath(path.begin(), path.end() - 1)), path[path.size() - 1]).indodeTableIndex;
+    else
+        fileInode.flags ^= COMPRESSED;
 
-    m_disk->write(inodeIndexToAddr(fileInodeIdx), sizeof(inode), (const char*)&fileInode);
+    m_disk->write(inodeIndexToAddr(inodeIdx), sizeof(inode), (const char*)&fileInode);
 }
 
 /**
- * @brief free blocks of a specified file and add deleted flag to it.
+ * @brief unlink a file from its directory and hand it to the background reclaimer.
+ * 
+ * The inode is put in the orphan list of the disk, its blocks (and the content of a
+ * directory) are released later by the reclaimer, also after the disk is opened again.
  * 
  * @param filePath the path of the file to delete
  * 
  */
 void FileSystem::deleteFile(const std::string& filePath)
 {
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
+
     if (filePath == "/") throw std::runtime_error("Cannot remove root directory!");
     
-    char reset[sizeof(dirSibling)] = { 0 };
     afsPath path = Helper::splitString(filePath);
-    int fileInodeIdx = getSiblingData(pathToAddr(afsPath(path.begin(), path.end() - 1)), path[path.size() - 1]).indodeTableIndex;
+    uint32_t fileInodeIdx = getSiblingData(pathToAddr(afsPath(path.begin(), path.end() - 1)), path[path.size() - 1]).indodeTableIndex;
     inode fileInode = pathToInode(path);
 
     address parentAddress = pathToAddr(afsPath(path.begin(), path.end() - 1));
-    directoryData data;
-    dirSibling sibling, lastSibling;
 
+    removeSibling(parentAddress, path.back());
+    addOrphan(fileInodeIdx, fileInode);
+}
+
+/**
+ * @brief move a file or a directory. Only the directory entry moves, the content is not copied.
+ * 
+ * An existing target is replaced atomically: its entry is pointed at the moved inode
+ * and the old target is handed to the reclaimer. A directory can only replace an
+ * empty directory, and a file only a file.
+ * 
+ * @param srcPath the path of the file to move.
+ * @param dstPath the new path of the file.
+ */
+void FileSystem::rename(const std::string& srcPath, const std::string& dstPath)
+{
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
+
+    afsPath src = Helper::splitString(srcPath), dst = Helper::splitString(dstPath);
+
+    if (src.size() > 1 && src.back() == "/")
+        src.pop_back();
+    if (dst.size() > 1 && dst.back() == "/")
+        dst.pop_back();
+
+    if (src.size() < 2 || dst.size() < 2)
+        throw std::runtime_error("Cannot move the root directory!");
+
+    if (src.back() == "." || src.back() == ".." || dst.back() == "." || dst.back() == "..")
+        throw std::runtime_error("cannot move \".\" or \"..\" entries");
+
+    afsPath srcParent(src.begin(), src.end() - 1), dstParent(dst.begin(), dst.end() - 1);
+    address srcParentAddr = pathToAddr(srcParent);
+    uint32_t dstParentIdx = pathToInodeIndex(dstParent);
+    inode dstParentInode, movedInode;
+
+    m_disk->read(inodeIndexToAddr(dstParentIdx), sizeof(inode), (char*)&dstParentInode);
+
+    if (!(dstParentInode.flags & DIRTYPE))
+        throw std::runtime_error("path contains file that is not a directory.");
+
+    dirSibling moved = getSiblingData(srcParentAddr, src.back());
+    m_disk->read(inodeIndexToAddr(moved.indodeTableIndex), sizeof(inode), (char*)&movedInode);
+
+    // a directory can not be moved into itself or into one of its subdirectories
+    if (movedInode.flags & DIRTYPE)
+    {
+        for (size_t i = 1; i <= dstParent.size(); i++)
+        {
+            if (pathToInodeIndex(afsPath(dstParent.begin(), dstParent.begin() + i)) == moved.indodeTableIndex)
+                throw std::runtime_error("cannot move a directory into itself");
+        }
+    }
+
+    int64_t targetIndex = getSiblingIndex(dstParentInode.firstAddr, dst.back());
+
+    if (targetIndex != -1)
+    {
+        dirSibling target = getSiblingData(dstParentInode.firstAddr, targetIndex);
+        uint32_t targetInodeIdx = target.indodeTableIndex;
+        inode targetInode;
+        directoryData data = 0;
+
+        if (targetInodeIdx == moved.indodeTableIndex)
+            return;
+
+        m_disk->read(inodeIndexToAddr(targetInodeIdx), sizeof(inode), (char*)&targetInode);
+
+        if ((targetInode.flags & DIRTYPE) != (movedInode.flags & DIRTYPE))
+            throw std::runtime_error("cannot replace a file with a directory or a directory with a file");
+
+        if (targetInode.flags & DIRTYPE)
+            m_disk->read(targetInode.firstAddr, sizeof(directoryData), (char*)&data);
+
+        if (data > 2)
+            throw std::runtime_error("cannot replace a directory that is not empty");
+
+        // the target path switches to the moved inode with a single write
+        target.indodeTableIndex = moved.indodeTableIndex;
+        m_disk->write(getSiblingAddr(dstParentInode.firstAddr, targetIndex), sizeof(dirSibling), (const char*)&target);
+
+        removeSibling(srcParentAddr, src.back());
+        addOrphan(targetInodeIdx, targetInode);
+    }
+
+    else
+    {
+        addSibling(dstParentInode.firstAddr, dirSibling(dst.back().c_str(), moved.indodeTableIndex));
+        removeSibling(srcParentAddr, src.back());
+    }
+
+    if (movedInode.flags & DIRTYPE && srcParentAddr != dstParentInode.firstAddr)
+    {
+        dirSibling prev = getSiblingData(movedInode.firstAddr, 1);
+
+        prev.indodeTableIndex = dstParentIdx;
+        m_disk->write(getSiblingAddr(movedInode.firstAddr, 1), sizeof(dirSibling), (const char*)&prev);
+    }
+}
+
+/**
+ * @brief create a file that shares the data blocks of another file.
+ * 
+ * Only the block map is copied and the data blocks get another owner in the
+ * reference counts, a shared block is copied when one of the files appends to it.
+ * Inline data and a packed tail are small and are copied to the new file.
+ * 
+ * @param srcPath the path of the file to clone.
+ * @param dstPath the path of the new file.
+ */
+void FileSystem::clone(const std::string& srcPath, const std::string& dstPath)
+{
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
+    inode srcInode = pathToInode(Helper::splitString(srcPath));
+
+    if (srcInode.flags & DIRTYPE)
+        throw std::runtime_error("cannot clone a directory");
+
+    addFile(dstPath, false);
+
+    uint32_t dstInodeIdx = pathToInodeIndex(Helper::splitString(dstPath));
+    inode dstInode = srcInode;
+
+    dstInode.firstAddr = (address)-1;
+    dstInode.tailAddr = 0;
+    dstInode.nextOrphan = NO_ORPHAN;
+
+    if (srcInode.flags & TAILPACKED)
+    {
+        uint32_t tailSize = srcInode.fileSize % m_disk->getBlockSize();
+        std::string tail(tailSize, '\0');
+
+        m_disk->read(srcInode.tailAddr, tailSize, &tail[0]);
+        dstInode.tailAddr = m_fragments->allocate(tailSize);
+        m_disk->write(dstInode.tailAddr, tailSize, tail.c_str());
+    }
+
+    if (!(srcInode.flags & INLINEDATA) && srcInode.firstAddr != (address)-1)
+    {
+        BlockMap blockMap(m_disk, m_dblocksTable, srcInode.firstAddr);
+        std::vector<unsigned int> dataBlocks;
+
+        createRefCounts();
+        dstInode.firstAddr = blockMap.clone(dataBlocks);
+        m_refCounts->addRefs(dataBlocks);
+    }
+
+    m_disk->write(inodeIndexToAddr(dstInodeIdx), sizeof(inode), (const char*)&dstInode);
+}
+
+/**
+ * @brief change the size of a file. A file that grows gets a hole that reads as
+ *        zeros and takes no blocks, a file that shrinks releases its blocks past the end.
+ * 
+ * @param filePath the path to the file.
+ * @param size the new size of the file.
+ */
+void FileSystem::truncate(const std::string& filePath, const uint64_t size)
+{
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
+    uint32_t inodeIdx = pathToInodeIndex(Helper::splitString(filePath)), blockSize = m_disk->getBlockSize();
+    inode fileInode;
 
-    m_disk->read(parentAddress, sizeof(directoryData), (char*)&data);
+    m_disk->read(inodeIndexToAddr(inodeIdx), sizeof(inode), (char*)&fileInode);
 
     if (fileInode.flags & DIRTYPE)
-        recursiveRemove(fileInode);
+        throw std::runtime_error("cannot truncate a directory");
 
-    fileInode.flags |= DELETED;
+    if (size == fileInode.fileSize)
+        return;
 
-    m_dblocksTable->freeAllFileBlocks(fileInode.firstAddr);
-    m_disk->write(inodeIndexToAddr(fileInodeIdx), sizeof(inode), (const char*)&fileInode);
-    address lastSiblingAddr = Helper::getSiblingAddr(parentAddress, data - 1);
+    if (size <= INLINE_DATA_MAX && ((fileInode.flags & INLINEDATA) || fileInode.fileSize == 0))
+    {
+        uint64_t from = std::min(size, fileInode.fileSize), to = std::max(size, fileInode.fileSize);
 
-    lastSibling = getSiblingData(parentAddress, data - 1);
-    m_disk->write(lastSiblingAddr, sizeof(dirSibling), reset);
+        memset(fileInode.inlineData + from, 0, to - from);
+        fileInode.fileSize = size;
+
+        if (size != 0)
+            fileInode.flags |= INLINEDATA;
+        else
+            fileInode.flags &= ~INLINEDATA;
+    }
+
+    else
+    {
+        unpackFile(fileInode);
+
+        BlockMap blockMap(m_disk, m_dblocksTable, fileInode.firstAddr);
+
+        if (fileInode.flags & COMPRESSED)
+            resizeCompressed(blockMap, fileInode, size);
 
-    for (directoryData i = 0; i < data; i++)
+        else
+        {
+            // the rest of the block the file ends in must read as zeros if the file grows again
+            uint64_t end = std::min(size, fileInode.fileSize);
+
+            if (size < fileInode.fileSize)
+                blockMap.truncate((size + blockSize - 1) / blockSize);
+
+            if (end % blockSize != 0)
+                zeroBlockRange(blockMap, end, end - end % blockSize + blockSize);
+
+            fileInode.fileSize = size;
+        }
+
+        fileInode.firstAddr = blockMap.getFirstAddr();
+    }
+
+    m_disk->write(inodeIndexToAddr(inodeIdx), sizeof(inode), (const char*)&fileInode);
+}
+
+/**
+ * @brief release the blocks of a range of a file, the range reads as zeros and
+ *        the size of the file does not change. Blocks the range only partly
+ *        covers are zeroed.
+ * 
+ * @param filePath the path to the file.
+ * @param offset the start of the range.
+ * @param length the length of the range.
+ */
+void FileSystem::punchHole(const std::string& filePath, const uint64_t offset, const uint64_t length)
+{
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
+    uint32_t inodeIdx = pathToInodeIndex(Helper::splitString(filePath)), blockSize = m_disk->getBlockSize();
+    inode fileInode;
+
+    m_disk->read(inodeIndexToAddr(inodeIdx), sizeof(inode), (char*)&fileInode);
+
+    if (fileInode.flags & DIRTYPE)
+        throw std::runtime_error("cannot punch a hole in a directory");
+
+    if (offset >= fileInode.fileSize || length == 0)
+        return;
+
+    uint64_t end = offset + std::min(length, fileInode.fileSize - offset);
+
+    if (fileInode.flags & INLINEDATA)
+        memset(fileInode.inlineData + offset, 0, end - offset);
+
+    else if (fileInode.flags & COMPRESSED)
     {
-        sibling = getSiblingData(parentAddress, i);
-        if (strncmp(sibling.name, path.back().c_str(), sizeof(sibling.name)) == 0)
+        BlockMap blockMap(m_disk, m_dblocksTable, fileInode.firstAddr);
+        uint32_t chunkSize = blockSize * COMPRESSION_CHUNK_BLOCKS;
+
+        for (uint32_t chunkIndex = offset / chunkSize; (uint64_t)chunkIndex * chunkSize < end; chunkIndex++)
         {
-            m_disk->write(Helper::getSiblingAddr(parentAddress, i), sizeof(dirSibling), (const char*)&lastSibling);
-            m_disk->write(lastSiblingAddr, sizeof(dirSibling), reset);
-            break;
+            uint64_t chunkStart = (uint64_t)chunkIndex * chunkSize;
+            uint32_t rawSize = std::min<uint64_t>(chunkSize, fileInode.fileSize - chunkStart);
+            uint32_t from = std::max(offset, chunkStart) - chunkStart, to = std::min(end, chunkStart + rawSize) - chunkStart;
+
+            if (from == 0 && to == rawSize)
+            {
+                releaseChunk(blockMap, chunkIndex);
+                continue;
+            }
+
+            std::string chunk = readChunk(blockMap, chunkIndex, rawSize);
+
+            memset(&chunk[from], 0, to - from);
+            releaseChunk(blockMap, chunkIndex);
+
+            if (chunk.find_first_not_of('\0') != std::string::npos)
+                writeChunk(blockMap, chunkIndex, chunk.c_str(), rawSize);
         }
     }
 
-    m_header->inodes--;
-    m_disk->write(parentAddress, sizeof(directoryData), (const char*)&(--data));
-    m_disk->write(0, sizeof(*m_header), (const char*)m_header);
+    else
+    {
+        BlockMap blockMap(m_disk, m_dblocksTable, fileInode.firstAddr);
+        uint64_t tailStart = fileInode.fileSize;
 
+        if (fileInode.flags & TAILPACKED)
+            tailStart -= fileInode.fileSize % blockSize;
+
+        if (end > tailStart)
+        {
+            uint64_t from = std::max(offset, tailStart);
+            std::vector<char> zeros(end - from, 0);
+
+            m_disk->write(fileInode.tailAddr + from - tailStart, end - from, zeros.data());
+        }
+
+        uint64_t blocksEnd = std::min(end, tailStart);
+        uint32_t firstFull = (offset + blockSize - 1) / blockSize, lastFull = blocksEnd / blockSize;
+
+        if (offset < blocksEnd && firstFull > lastFull)
+            zeroBlockRange(blockMap, offset, blocksEnd);
+
+        else if (offset < blocksEnd)
+        {
+            zeroBlockRange(blockMap, offset, (uint64_t)firstFull * blockSize);
+            zeroBlockRange(blockMap, (uint64_t)lastFull * blockSize, blocksEnd);
+            blockMap.punch(firstFull, lastFull);
+        }
+    }
+
+    m_disk->write(inodeIndexToAddr(inodeIdx), sizeof(inode), (const char*)&fileInode);
+}
+
+/**
+ * @brief wait until the background reclaimer released all the deleted files.
+ */
+void FileSystem::waitForReclaim()
+{
+    std::unique_lock<SharedMutex> lock(m_lock);
+
+    m_reclaimIdle.wait(lock, [this] { return !hasReclaimWork(); });
 }
 
 /**
@@ -224,99 +692,1437 @@ void FileSystem::deleteFile(const std::string& filePath)
  *
  * @return std::string The content of the requested file.
  */
-std::string FileSystem::getContent(const std::string &filePath) const
+std::string FileSystem::getContent(const std::string &filePath) const
+{
+    return readConsistent([&]()
+    {
+        inode fileInode = pathToInode(Helper::splitString(filePath));
+
+        if (fileInode.flags & DIRTYPE) throw std::runtime_error("cant read content from directory");
+
+        std::string fileContent(fileInode.fileSize, '\0');
+        ReadAhead readAhead(m_disk);
+
+        readFileData(fileInode, 0, fileInode.fileSize, &fileContent[0], &readAhead);
+
+        return fileContent;
+    });
+}
+
+/**
+ * @brief Get part of the content of a file
+ *
+ * @param filePath path to the file to get the content of
+ * @param offset the offset in the file to read from
+ * @param size the amount of bytes to read
+ *
+ * @return std::string The requested content, shorter than size if the file ends before.
+ */
+std::string FileSystem::readContent(const std::string& filePath, const uint64_t offset, uint32_t size) const
+{
+    return readConsistent([&]()
+    {
+        uint32_t inodeIdx = pathToInodeIndex(Helper::splitString(filePath));
+        inode fileInode;
+
+        m_disk->read(inodeIndexToAddr(inodeIdx), sizeof(inode), (char*)&fileInode);
+
+        if (fileInode.flags & DIRTYPE) throw std::runtime_error("cant read content from directory");
+
+        if (offset >= fileInode.fileSize)
+            return std::string();
+
+        uint32_t readSize = std::min<uint64_t>(size, fileInode.fileSize - offset);
+
+        // reads of a file in pieces keep their read-ahead between the calls, a read takes it
+        // out while it runs so concurrent reads of the file do not share one
+        ReadAhead readAhead(m_disk);
+
+        {
+            std::lock_guard<std::mutex> streamsLock(m_readAheadLock);
+            auto stream = m_readAheads.find(inodeIdx);
+
+            if (stream != m_readAheads.end())
+            {
+                readAhead = stream->second;
+                m_readAheads.erase(stream);
+            }
+        }
+
+        std::string content(readSize, '\0');
+        readFileData(fileInode, offset, readSize, &content[0], &readAhead);
+
+        std::lock_guard<std::mutex> streamsLock(m_readAheadLock);
+
+        if (m_readAheads.size() >= MAX_READ_STREAMS)
+            m_readAheads.clear();
+
+        m_readAheads.insert_or_assign(inodeIdx, readAhead);
+
+        return content;
+    });
+}
+
+dirList FileSystem::listDir(const std::string &dirPath) const
+{
+    return readConsistent([&]()
+    {
+        dirList list;
+        inode dirInode = pathToInode(Helper::splitString(dirPath)), siblingInode;
+
+        if (dirInode.flags & DELETED)
+            throw std::runtime_error("cant list deleted directory");
+
+        if (dirInode.flags & FILETYPE)
+            throw std::runtime_error("cannot list a file that is not a directory!");
+
+        for (dirSibling& sibling : readDirEntries(dirInode))
+        {
+            m_disk->read(inodeIndexToAddr(sibling.indodeTableIndex), sizeof(inode), (char*)&siblingInode);
+
+            dirListEntry entry(sibling.name, siblingInode.fileSize, siblingInode.flags & DIRTYPE);
+            list.push_back(entry);
+        }
+
+        return list;
+    });
+}
+
+/**
+ * @brief Get the index of the inode of a path, it stays the same while the file is renamed.
+ */
+uint32_t FileSystem::getInodeIndex(const std::string& path) const
+{
+    return readConsistent([&]()
+    {
+        return pathToInodeIndex(Helper::splitString(path));
+    });
+}
+
+/**
+ * @brief visit every entry under a directory, the directory included. Directories
+ *        are read by inode and spread over a work-stealing pool, so the visitor
+ *        runs concurrently and in no particular order. Writes wait for the walk, reads run next to it.
+ * 
+ * @param rootPath the directory (or file) the walk starts at.
+ * @param visitor called for every entry, false skips the content of a directory.
+ * @param options the walking threads, the depth limit and whether to count blocks.
+ */
+void FileSystem::walk(const std::string& rootPath, const walkVisitor& visitor, const walkOptions& options) const
+{
+    afsPath path = Helper::splitString(rootPath);
+    std::string normalized;
+
+    // empty parts of the path are split as "/"
+    for (const std::string& part : path)
+    {
+        if (part != "/")
+            normalized += "/" + part;
+    }
+
+    // a walk of a read-only mount starts over when the disk was written, its visitor sees the entries again
+    readConsistent([&]()
+    {
+        uint32_t rootIndex = pathToInodeIndex(path);
+        walkEntry root = makeWalkEntry(normalized.empty() ? "/" : normalized, rootIndex, rootIndex, 0, options);
+
+        if (!visitor(root) || !(root.node.flags & DIRTYPE) || options.maxDepth == 0)
+            return true;
+
+        ThreadPool pool(options.threads);
+
+        pool.submit([&]() { walkDirectory(pool, root, visitor, options); });
+        pool.wait();
+
+        return true;
+    });
+}
+
+/**
+ * @brief read all the entries of a directory, each block of it once.
+ */
+std::vector<dirSibling> FileSystem::readDirEntries(const inode& dirInode) const
+{
+    uint32_t maxSiblingsPerBlock = Helper::getSiblingsPerBlock(m_disk->getBlockSize());
+    address blockAddr = dirInode.firstAddr;
+    directoryData amount;
+
+    m_disk->read(dirInode.firstAddr, sizeof(directoryData), (char*)&amount);
+
+    std::vector<dirSibling> entries(amount);
+
+    for (uint32_t i = 0; i < amount;)
+    {
+        uint32_t inBlock = std::min(maxSiblingsPerBlock, amount - i);
+
+        if (blockAddr == 0)
+            throw std::runtime_error("corrupted block chain");
+
+        m_disk->read(Helper::getSiblingAddr(blockAddr, m_disk->getBlockSize(), 0), inBlock * sizeof(dirSibling), (char*)&entries[i]);
+        i += inBlock;
+
+        if (i < amount)
+            blockAddr = Helper::getNextBlock(m_disk, blockAddr);
+    }
+
+    return entries;
+}
+
+walkEntry FileSystem::makeWalkEntry(const std::string& path, const uint32_t inodeIndex, const uint32_t parentIndex,
+                                    const uint32_t depth, const walkOptions& options) const
+{
+    walkEntry entry;
+
+    entry.path = path;
+    entry.inodeIndex = inodeIndex;
+    entry.parentIndex = parentIndex;
+    entry.depth = depth;
+    entry.allocatedBytes = 0;
+    m_disk->read(inodeIndexToAddr(inodeIndex), sizeof(inode), (char*)&entry.node);
+
+    if (options.countBlocks && !(entry.node.flags & INLINEDATA) && entry.node.firstAddr != (address)-1)
+    {
+        // a directory is a plain chain of blocks, a file has a block map
+        uint64_t blocks = 0;
+
+        if (entry.node.flags & DIRTYPE)
+        {
+            for (address blockAddr = entry.node.firstAddr; blockAddr != 0; blockAddr = Helper::getNextBlock(m_disk, blockAddr))
+                blocks++;
+        }
+        else
+            blocks = BlockMap(m_disk, m_dblocksTable, entry.node.firstAddr).countBlocks();
+
+        entry.allocatedBytes = blocks * m_disk->getBlockSize();
+    }
+
+    if (options.countBlocks && (entry.node.flags & TAILPACKED))
+        entry.allocatedBytes += entry.node.fileSize % m_disk->getBlockSize();
+
+    return entry;
+}
+
+/**
+ * @brief visit the entries of a directory and queue a walk of its subdirectories (on the pool).
+ */
+void FileSystem::walkDirectory(ThreadPool& pool, const walkEntry& dir, const walkVisitor& visitor, const walkOptions& options) const
+{
+    std::vector<dirSibling> entries = readDirEntries(dir.node);
+    std::string prefix = dir.path == "/" ? "/" : dir.path + "/";
+
+    // the first two entries are "." and ".."
+    for (size_t i = 2; i < entries.size(); i++)
+    {
+        std::string name(entries[i].name, strnlen(entries[i].name, NAME_MAX_LEN));
+        walkEntry entry = makeWalkEntry(prefix + name, entries[i].indodeTableIndex, dir.inodeIndex, dir.depth + 1, options);
+
+        if (visitor(entry) && (entry.node.flags & DIRTYPE) && entry.depth < options.maxDepth)
+            pool.submit([this, &pool, entry, &visitor, &options]() { walkDirectory(pool, entry, visitor, options); });
+    }
+}
+
+// =========== Helpers (private functions) =========== //
+
+/**
+* @brief write the superblock to the newly created disk
+*
+*/
+void FileSystem::setHeader()
+{
+    memcpy(m_header->magic, MAGIC, sizeof(m_header->magic));
+    m_header->version = CURR_VERSION;
+    m_header->blockSize = m_disk->getBlockSize();
+    m_header->nblocks = m_disk->getBlocksAmount();
+    m_header->inodeBlocks = 0;
+    m_header->inodeMapAddr = 0;
+    m_header->inodes = 0;
+    m_header->fragMapAddr = 0;
+    m_header->features = 0;
+    m_header->refTableAddr = 0;
+    m_header->dedupIndexAddr = 0;
+    m_header->checksumAddr = 0;
+    m_header->freeBlocks = m_dblocksTable->getTableBlocksAmount() * m_disk->getBlockSize();
+    m_header->freeInodes = 0;
+    m_header->orphanHead = NO_ORPHAN;
+    m_header->generationsAddr = 0;
+    m_header->snapshotsAddr = 0;
+    m_header->generation = 0;
+    m_header->summaryAddr = Helper::blockToAddr(m_disk->getBlockSize(), 1 + m_dblocksTable->getTableBlocksAmount());
+
+    m_inodeTable.clear();
+    m_inodeCursor = 0;
+    m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+}
+
+/**
+ * @brief read the addresses of the inode table blocks from its block map.
+ */
+void FileSystem::loadInodeTable() const
+{
+    BlockMap inodeMap(m_disk, m_dblocksTable, m_header->inodeMapAddr == 0 ? (address)-1 : m_header->inodeMapAddr);
+
+    m_inodeTable.clear();
+    m_inodeTable.reserve(m_header->inodeBlocks);
+
+    for (uint32_t i = 0; i < m_header->inodeBlocks; i++)
+    {
+        address tableAddr = inodeMap.get(i);
+
+        if (tableAddr == 0)
+            throw std::runtime_error("block " + std::to_string(i) + " of the inode table is missing from its map");
+
+        m_inodeTable.push_back(tableAddr);
+    }
+}
+
+/**
+ * @brief add a cleared block to the end of the inode table, its inodes are free.
+ */
+void FileSystem::growInodeTable()
+{
+    uint32_t inodesPerBlock = m_disk->getBlockSize() / sizeof(inode);
+
+    // the last index is kept for the end of the orphan list
+    if ((uint64_t)(m_header->inodeBlocks + 1) * inodesPerBlock > NO_ORPHAN)
+        throw std::runtime_error("no free inodes left on the disk");
+
+    BlockMap inodeMap(m_disk, m_dblocksTable, m_header->inodeMapAddr == 0 ? (address)-1 : m_header->inodeMapAddr);
+    address tableAddr = reserveClearedBlock();
+
+    inodeMap.set(m_header->inodeBlocks, tableAddr);
+    m_inodeTable.push_back(tableAddr);
+
+    m_header->inodeMapAddr = inodeMap.getFirstAddr();
+    m_header->inodeBlocks++;
+    m_header->freeInodes += inodesPerBlock;
+    m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+}
+
+
+/**
+* @brief Write newly created inode into the first free slot of the inode table,
+*        the table grows by a block when all of its inodes are used.
+*
+* @param node The inode to write to the disk.
+*
+* @return uint32_t The index of the created Indoe.
+*/
+uint32_t FileSystem::createInode(const inode node)
+{
+    // the table is full, the search starts at the inodes of the new block
+    if (m_header->freeInodes == 0)
+    {
+        m_inodeCursor = getInodesCapacity();
+        growInodeTable();
+    }
+
+    uint32_t capacity = getInodesCapacity();
+
+    for (uint32_t i = 0; i < capacity && m_header->freeInodes != 0; i++)
+    {
+        uint32_t inodeIndex = (m_inodeCursor + i) % capacity;
+        int flags;
+
+        m_disk->read(inodeIndexToAddr(inodeIndex), sizeof(flags), (char*)&flags);
+
+        if (flags == 0 || flags & DELETED)
+        {
+            m_disk->write(inodeIndexToAddr(inodeIndex), sizeof(node), (const char*)&node);
+            m_inodeCursor = inodeIndex + 1;
+
+            m_header->inodes++;
+            m_header->freeInodes--;
+            m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+
+            return inodeIndex;
+        }
+    }
+
+    throw std::runtime_error("no free inodes left on the disk");
+}
+
+/**
+ * @brief mark an inode as deleted so its slot can be used again.
+ *
+ * @param inodeIndex The index of the inode.
+ * @param node The inode (its data must be freed already).
+ */
+void FileSystem::freeInode(const uint32_t inodeIndex, inode& node)
+{
+    node.flags |= DELETED;
+    m_disk->write(inodeIndexToAddr(inodeIndex), sizeof(inode), (const char*)&node);
+
+    m_header->inodes--;
+    m_header->freeInodes++;
+    m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+}
+
+uint32_t FileSystem::getInodesCapacity() const
+{
+    return (uint64_t)m_header->inodeBlocks * m_disk->getBlockSize() / sizeof(inode);
+}
+
+/**
+ * @brief Get the amount of entries of the block map of a file (the tail of a
+ *        tail-packed file is not in it).
+ */
+uint32_t FileSystem::getMappedBlocks(const inode& fileInode) const
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+
+    if (fileInode.flags & INLINEDATA || fileInode.firstAddr == (address)-1)
+        return 0;
+
+    if (fileInode.flags & COMPRESSED)
+    {
+        uint32_t chunkSize = blockSize * COMPRESSION_CHUNK_BLOCKS;
+
+        return (fileInode.fileSize + chunkSize - 1) / chunkSize * COMPRESSION_CHUNK_BLOCKS;
+    }
+
+    uint64_t tailStart = fileInode.fileSize;
+    if (fileInode.flags & TAILPACKED)
+        tailStart -= fileInode.fileSize % blockSize;
+
+    return (tailStart + blockSize - 1) / blockSize;
+}
+
+/**
+ * @brief Count the data blocks of a file that it owns alone and the runs of
+ *        contiguous blocks they are stored in.
+ */
+fragmentationInfo FileSystem::measureFragmentation(const inode& fileInode) const
+{
+    uint32_t blockSize = m_disk->getBlockSize(), mappedBlocks = getMappedBlocks(fileInode);
+    fragmentationInfo info = {0, 0};
+    address prevAddr = 0;
+
+    if (mappedBlocks == 0)
+        return info;
+
+    BlockMap blockMap(m_disk, m_dblocksTable, fileInode.firstAddr);
+
+    for (uint32_t i = 0; i < mappedBlocks; i++)
+    {
+        address dataAddr = blockMap.get(i);
+
+        if (dataAddr == 0 || (m_refCounts && m_refCounts->getRefCount(Helper::addrToBlock(blockSize, dataAddr)) > 1))
+            continue;
+
+        if (dataAddr != prevAddr + blockSize)
+            info.runs++;
+
+        info.blocks++;
+        prevAddr = dataAddr;
+    }
+
+    return info;
+}
+
+/**
+ * @brief Move the next DEFRAG_STEP_BLOCKS blocks of a file to a run of free blocks,
+ *        right after the run the previous step used when it is free.
+ * 
+ * @param fileInode The inode of the file.
+ * @param nextIndex The first block of the file to move, advanced past the step.
+ * @param nextBlock The block after the last one the previous step moved to, advanced too.
+ * 
+ * @return uint32_t The amount of blocks that were moved.
+ */
+uint32_t FileSystem::defragmentStep(const inode& fileInode, uint32_t& nextIndex, unsigned int& nextBlock)
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    uint32_t lastIndex = std::min(nextIndex + DEFRAG_STEP_BLOCKS, getMappedBlocks(fileInode));
+    BlockMap blockMap(m_disk, m_dblocksTable, fileInode.firstAddr);
+    std::vector<uint32_t> indices;
+    std::vector<unsigned int> oldBlocks;
+
+    for (uint32_t i = nextIndex; i < lastIndex; i++)
+    {
+        address dataAddr = blockMap.get(i);
+
+        if (dataAddr == 0 || (m_refCounts && m_refCounts->getRefCount(Helper::addrToBlock(blockSize, dataAddr)) > 1))
+            continue;
+
+        indices.push_back(i);
+        oldBlocks.push_back(Helper::addrToBlock(blockSize, dataAddr));
+    }
+
+    nextIndex = lastIndex;
+
+    if (oldBlocks.empty())
+        return 0;
+
+    uint32_t amount = oldBlocks.size();
+    bool inPlace = oldBlocks.back() - oldBlocks.front() == amount - 1;
+
+    // the blocks are in a run already, the next step continues after it
+    for (uint32_t i = 1; i < amount && inPlace; i++)
+        inPlace = oldBlocks[i] == oldBlocks[i - 1] + 1;
+
+    if (inPlace)
+    {
+        nextBlock = oldBlocks.back() + 1;
+        return 0;
+    }
+
+    unsigned int firstBlock = nextBlock;
+
+    for (uint32_t i = 0; firstBlock != (unsigned int)-1 && i < amount; i++)
+    {
+        if (firstBlock + i >= m_disk->getBlocksAmount() || m_dblocksTable->isReserved(firstBlock + i))
+            firstBlock = (unsigned int)-1;
+    }
+
+    // a new run is looked for with room for the rest of the file, so the next steps continue it
+    if (firstBlock == (unsigned int)-1)
+        firstBlock = m_dblocksTable->getFreeBlocks(getMappedBlocks(fileInode) - indices.front());
+
+    if (firstBlock == (unsigned int)-1)
+        firstBlock = m_dblocksTable->getFreeBlocks(amount);
+
+    // no free run is long enough, the blocks stay where they are
+    if (firstBlock == (unsigned int)-1)
+        return 0;
+
+    std::vector<char> data((size_t)amount * blockSize);
+
+    m_dblocksTable->reserveDBlocks(firstBlock, amount);
+
+    for (uint32_t i = 0; i < amount; i++)
+        m_disk->read(Helper::blockToAddr(blockSize, oldBlocks[i]), blockSize, &data[(size_t)i * blockSize]);
+
+    m_disk->write(Helper::blockToAddr(blockSize, firstBlock), data.size(), data.data());
+
+    for (uint32_t i = 0; i < amount; i++)
+        blockMap.set(indices[i], Helper::blockToAddr(blockSize, firstBlock + i));
+
+    m_dblocksTable->freeDBlocks(oldBlocks);
+    nextBlock = firstBlock + amount;
+
+    return amount;
+}
+
+/**
+ * @brief Get the size and the free space of the file system, from the counters
+ *        kept in the header (no table is scanned).
+ */
+fsStats FileSystem::statfs() const
+{
+    return readConsistent([&]()
+    {
+        fsStats stats;
+
+        stats.blockSize = m_disk->getBlockSize();
+        stats.totalBlocks = m_dblocksTable->getTableBlocksAmount() * m_disk->getBlockSize();
+        stats.freeBlocks = m_header->freeBlocks;
+        stats.totalInodes = getInodesCapacity();
+        stats.freeInodes = m_header->freeInodes;
+
+        return stats;
+    });
+}
+
+/**
+ * @brief append content to a file.
+ * 
+ * Small files keep their content inside the inode (INLINEDATA), once the content
+ * grows past INLINE_DATA_MAX it is moved to data blocks. The end of a file that
+ * does not fill a whole block is packed into fragments of a shared block (TAILPACKED).
+ * 
+ * @param fileInode the inode of the file, updated with the new size and addresses.
+ * @param content the content to append.
+ */
+void FileSystem::appendData(inode& fileInode, std::string content)
+{
+    if (fileInode.flags & DIRTYPE) 
+        throw std::runtime_error("cant write content to a directory");
+
+    bool isInline = (fileInode.flags & INLINEDATA) || fileInode.fileSize == 0;
+
+    if (isInline && fileInode.fileSize + content.size() <= INLINE_DATA_MAX)
+    {
+        memcpy(fileInode.inlineData + fileInode.fileSize, content.c_str(), content.size());
+        fileInode.fileSize += content.size();
+        fileInode.flags |= INLINEDATA;
+        return;
+    }
+
+    // promote the inline content to block storage
+    if (fileInode.flags & INLINEDATA)
+    {
+        content = std::string(fileInode.inlineData, fileInode.fileSize) + content;
+        memset(fileInode.inlineData, 0, sizeof(fileInode.inlineData));
+        fileInode.fileSize = 0;
+        fileInode.flags &= ~INLINEDATA;
+    }
+
+    if (fileInode.flags & COMPRESSED)
+        return appendCompressed(fileInode, content);
+
+    // the packed tail is merged with the new content and packed again if it still fits
+    if (fileInode.flags & TAILPACKED)
+    {
+        uint32_t tailSize = fileInode.fileSize % m_disk->getBlockSize();
+        std::string tail(tailSize, '\0');
+
+        m_disk->read(fileInode.tailAddr, tailSize, &tail[0]);
+        m_fragments->release(fileInode.tailAddr, tailSize);
+
+        content = tail + content;
+        fileInode.fileSize -= tailSize;
+        fileInode.tailAddr = 0;
+        fileInode.flags &= ~TAILPACKED;
+    }
+
+    uint32_t tailSize = getPackableTailSize(fileInode, content.size());
+    appendToBlocks(fileInode, content.c_str(), content.size() - tailSize);
+
+    if (tailSize != 0)
+    {
+        fileInode.tailAddr = m_fragments->allocate(tailSize);
+        m_disk->write(fileInode.tailAddr, tailSize, content.c_str() + content.size() - tailSize);
+        fileInode.fileSize += tailSize;
+        fileInode.flags |= TAILPACKED;
+    }
+}
+
+/**
+ * @brief append content to the data blocks of a file, reserving new blocks when needed.
+ * 
+ * @param fileInode the inode of the file (its size and first address are updated).
+ * @param content the content to append.
+ * @param size the size of the content.
+ */
+void FileSystem::appendToBlocks(inode& fileInode, const char* content, const uint64_t size)
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    uint64_t offset = 0;
+    bool dedup = (m_header->features & FEATURE_DEDUP) && m_dedupIndex;
+    BlockMap blockMap(m_disk, m_dblocksTable, fileInode.firstAddr);
+
+    while (offset < size)
+    {
+        uint32_t blockIndex = fileInode.fileSize / blockSize, used = fileInode.fileSize % blockSize;
+        uint32_t partSize = std::min<uint64_t>(size - offset, blockSize - used);
+        address dataAddr = used == 0 ? 0 : blockMap.get(blockIndex);
+
+        // the partial last block is shared with a clone, it is copied before it changes
+        if (dataAddr != 0 && m_refCounts && m_refCounts->getRefCount(Helper::addrToBlock(blockSize, dataAddr)) > 1)
+            dataAddr = copyBlock(blockMap, blockIndex, dataAddr);
+
+        // a full block of new content that already exists on the disk is shared without writing it
+        if (dedup && partSize == blockSize && shareBlock(blockMap, blockIndex, content + offset))
+        {
+            offset += partSize;
+            fileInode.fileSize += partSize;
+            continue;
+        }
+
+        if (dataAddr == 0)
+        {
+            unsigned int dataBlock = m_dblocksTable->getFreeBlock();
+            m_dblocksTable->reserveDBlock(dataBlock);
+
+            dataAddr = Helper::blockToAddr(blockSize, dataBlock);
+            blockMap.set(blockIndex, dataAddr);
+
+            // the start of a block that was a hole reads as zeros
+            if (used != 0)
+            {
+                std::vector<char> zeros(used, 0);
+                m_disk->write(dataAddr, used, zeros.data());
+            }
+        }
+
+        m_disk->write(dataAddr + used, partSize, content + offset);
+
+        // the block is full now, share it or register it for the next files with the same content
+        if (dedup && used + partSize == blockSize)
+        {
+            std::vector<char> blockData(blockSize);
+            const char* data = content + offset;
+
+            if (used != 0)
+            {
+                m_disk->read(dataAddr, blockSize, blockData.data());
+                data = blockData.data();
+            }
+
+            if (used == 0 || !shareBlock(blockMap, blockIndex, data))
+            {
+                m_dedupIndex->insert(DedupIndex::fingerprint(data, blockSize), dataAddr);
+                m_refCounts->setIndexed(Helper::addrToBlock(blockSize, dataAddr));
+            }
+        }
+
+        offset += partSize;
+        fileInode.fileSize += partSize;
+    }
+
+    fileInode.firstAddr = blockMap.getFirstAddr();
+}
+
+/**
+ * @brief give a logical block of a file its own copy of a shared data block.
+ * 
+ * @param blockMap the block map of the file.
+ * @param blockIndex the index of the logical block.
+ * @param sharedAddr the address of the shared data block.
+ * 
+ * @return address the address of the copy.
+ */
+address FileSystem::copyBlock(BlockMap& blockMap, const uint32_t blockIndex, const address sharedAddr)
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    unsigned int dataBlock = m_dblocksTable->getFreeBlock();
+    address dataAddr = Helper::blockToAddr(blockSize, dataBlock);
+    std::vector<char> blockData(blockSize);
+
+    m_dblocksTable->reserveDBlock(dataBlock);
+    m_disk->read(sharedAddr, blockSize, blockData.data());
+    m_disk->write(dataAddr, blockSize, blockData.data());
+    blockMap.set(blockIndex, dataAddr);
+    m_dblocksTable->freeDBlock(Helper::addrToBlock(blockSize, sharedAddr));
+
+    return dataAddr;
+}
+
+/**
+ * @brief write zeros to a range inside one block of a file, a hole is left as it is.
+ * 
+ * @param blockMap the block map of the file.
+ * @param start the offset in the file the range starts at.
+ * @param end the offset in the file the range ends at (in the same block).
+ */
+void FileSystem::zeroBlockRange(BlockMap& blockMap, const uint64_t start, const uint64_t end)
+{
+    uint32_t blockSize = m_disk->getBlockSize(), blockIndex = start / blockSize;
+    address dataAddr = start < end ? blockMap.get(blockIndex) : 0;
+
+    if (dataAddr == 0)
+        return;
+
+    // a shared or deduplicated block is not changed in place
+    unsigned int dataBlock = Helper::addrToBlock(blockSize, dataAddr);
+    if (m_refCounts && (m_refCounts->getRefCount(dataBlock) > 1 || m_refCounts->isIndexed(dataBlock)))
+        dataAddr = copyBlock(blockMap, blockIndex, dataAddr);
+
+    std::vector<char> zeros(end - start, 0);
+    m_disk->write(dataAddr + start % blockSize, end - start, zeros.data());
+}
+
+/**
+ * @brief move the inline content and the packed tail of a file to data blocks.
+ * 
+ * @param fileInode the inode of the file (updated).
+ */
+void FileSystem::unpackFile(inode& fileInode)
+{
+    if (fileInode.flags & INLINEDATA)
+    {
+        std::string content(fileInode.inlineData, fileInode.fileSize);
+
+        memset(fileInode.inlineData, 0, sizeof(fileInode.inlineData));
+        fileInode.fileSize = 0;
+        fileInode.flags &= ~INLINEDATA;
+
+        if (fileInode.flags & COMPRESSED)
+            appendCompressed(fileInode, content);
+        else
+            appendToBlocks(fileInode, content.c_str(), content.size());
+    }
+
+    if (fileInode.flags & TAILPACKED)
+    {
+        uint32_t tailSize = fileInode.fileSize % m_disk->getBlockSize();
+        std::string tail(tailSize, '\0');
+
+        m_disk->read(fileInode.tailAddr, tailSize, &tail[0]);
+        m_fragments->release(fileInode.tailAddr, tailSize);
+
+        fileInode.fileSize -= tailSize;
+        fileInode.tailAddr = 0;
+        fileInode.flags &= ~TAILPACKED;
+
+        appendToBlocks(fileInode, tail.c_str(), tailSize);
+    }
+}
+
+/**
+ * @brief change the size of a compressed file. The chunk the file ends in is
+ *        written again with its new size, the chunks past it are holes or released.
+ * 
+ * @param blockMap the block map of the file.
+ * @param fileInode the inode of the file (its size is updated).
+ * @param size the new size of the file.
+ */
+void FileSystem::resizeCompressed(BlockMap& blockMap, inode& fileInode, const uint64_t size)
+{
+    uint32_t chunkSize = m_disk->getBlockSize() * COMPRESSION_CHUNK_BLOCKS;
+    uint64_t end = std::min(size, fileInode.fileSize);
+
+    if (end % chunkSize != 0)
+    {
+        uint32_t chunkIndex = end / chunkSize;
+        uint64_t chunkStart = (uint64_t)chunkIndex * chunkSize;
+        uint32_t newSize = std::min<uint64_t>(chunkSize, size - chunkStart);
+        std::string chunk = readChunk(blockMap, chunkIndex, std::min<uint64_t>(chunkSize, fileInode.fileSize - chunkStart));
+
+        chunk.resize(newSize, '\0');
+        releaseChunk(blockMap, chunkIndex);
+
+        if (chunk.find_first_not_of('\0') != std::string::npos)
+            writeChunk(blockMap, chunkIndex, chunk.c_str(), newSize);
+    }
+
+    if (size < fileInode.fileSize)
+        blockMap.truncate((size + chunkSize - 1) / chunkSize * COMPRESSION_CHUNK_BLOCKS);
+
+    fileInode.fileSize = size;
+}
+
+/**
+ * @brief map a logical block of a file to an existing block with the same content.
+ * 
+ * @param blockMap the block map of the file.
+ * @param blockIndex the index of the logical block.
+ * @param data the content of the block.
+ * 
+ * @return bool true if a block with the same content was found and shared.
+ */
+bool FileSystem::shareBlock(BlockMap& blockMap, const uint32_t blockIndex, const char* data)
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    address sharedAddr = m_dedupIndex->find(data, DedupIndex::fingerprint(data, blockSize));
+    address currentAddr = blockMap.get(blockIndex);
+
+    if (sharedAddr == 0 || sharedAddr == currentAddr)
+        return false;
+
+    m_refCounts->addRef(Helper::addrToBlock(blockSize, sharedAddr));
+    blockMap.set(blockIndex, sharedAddr);
+
+    if (currentAddr != 0)
+        m_dblocksTable->freeDBlock(Helper::addrToBlock(blockSize, currentAddr));
+
+    return true;
+}
+
+/**
+ * @brief create the reference counts of the data blocks if the disk has none yet.
+ */
+void FileSystem::createRefCounts()
+{
+    if (m_refCounts)
+        return;
+
+    m_header->refTableAddr = reserveRegion(RefCountTable::getTableBlocksAmount(m_disk));
+    m_refCounts = new RefCountTable(m_disk, m_header->refTableAddr);
+    m_dblocksTable->setRefCounts(m_refCounts);
+    m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+}
+
+/**
+ * @brief Turn block deduplication on or off for content written from now on.
+ * 
+ * The reference counts and the dedup index are created the first time it is turned on.
+ * 
+ * @param enable whether to deduplicate full data blocks.
+ */
+void FileSystem::setDedup(const bool enable)
+{
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
+    if (enable)
+        createRefCounts();
+
+    if (enable && !m_dedupIndex)
+    {
+        m_header->dedupIndexAddr = reserveRegion(DedupIndex::getIndexBlocksAmount(m_disk));
+        m_dedupIndex = new DedupIndex(m_disk, m_header->dedupIndexAddr);
+        m_refCounts->setDedupIndex(m_dedupIndex);
+    }
+
+    if (enable)
+        m_header->features |= FEATURE_DEDUP;
+    else
+        m_header->features &= ~FEATURE_DEDUP;
+
+    m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+}
+
+/**
+ * @brief start verifying the checksums of all the blocks in the background.
+ * 
+ * @param bytesPerSecond the most bytes the scrubber reads in a second (0 for no limit).
+ */
+void FileSystem::startScrubber(const uint64_t bytesPerSecond)
+{
+    stopScrubber();
+
+    m_scrubber = new Scrubber(m_disk, bytesPerSecond);
+    m_scrubber->start();
+}
+
+void FileSystem::stopScrubber()
+{
+    delete m_scrubber;
+    m_scrubber = nullptr;
+}
+
+/**
+ * @brief Get the progress and the errors found by the background scrubber.
+ */
+scrubStatus FileSystem::getScrubStatus() const
+{
+    if (!m_scrubber)
+        throw std::runtime_error("scrubber is not running");
+
+    return m_scrubber->getStatus();
+}
+
+/**
+ * @brief Get how many runs of contiguous blocks the data of a file is stored in.
+ */
+fragmentationInfo FileSystem::getFragmentation(const std::string& filePath) const
+{
+    return readConsistent([&]()
+    {
+        return measureFragmentation(pathToInode(Helper::splitString(filePath)));
+    });
+}
+
+/**
+ * @brief Move the blocks of a file to contiguous runs of free blocks, while the
+ *        file system stays in use.
+ * 
+ * The file is moved DEFRAG_STEP_BLOCKS blocks at a time, each step under the lock,
+ * so other operations run between the steps. A block is copied to its new place
+ * before the block map points to it and the old block is released last, a crash
+ * can only leak blocks. Blocks shared with other files stay where they are.
+ * 
+ * @param filePath The path of the file.
+ * @param bytesPerSecond The most bytes to move per second, 0 for no limit.
+ * 
+ * @return fragmentationInfo The runs of the file once it was moved.
+ */
+fragmentationInfo FileSystem::defragment(const std::string& filePath, const uint64_t bytesPerSecond)
+{
+    auto budgetStart = std::chrono::steady_clock::now();
+    uint64_t bytesMoved = 0;
+    uint32_t nextIndex = 0, inodeIndex = 0;
+    unsigned int nextBlock = (unsigned int)-1;
+
+    for (bool first = true;; first = false)
+    {
+        {
+            std::lock_guard<SharedMutex> lock(m_lock);
+            checkWritable();
+            DiskWriteSection section(m_disk);
+            uint32_t currentIndex = pathToInodeIndex(Helper::splitString(filePath));
+            inode fileInode;
+
+            m_disk->read(inodeIndexToAddr(currentIndex), sizeof(inode), (char*)&fileInode);
+
+            if (fileInode.flags & DIRTYPE)
+                throw std::runtime_error("cant defragment a directory");
+
+            // the file was replaced between the steps
+            if (!first && currentIndex != inodeIndex)
+                throw std::runtime_error(filePath + " was replaced while it was defragmented");
+
+            inodeIndex = currentIndex;
+
+            if (fileInode.flags & INLINEDATA || fileInode.firstAddr == (address)-1 || nextIndex >= getMappedBlocks(fileInode))
+                return measureFragmentation(fileInode);
+
+            bytesMoved += (uint64_t)defragmentStep(fileInode, nextIndex, nextBlock) * m_disk->getBlockSize();
+        }
+
+        if (bytesPerSecond != 0)
+            std::this_thread::sleep_until(budgetStart + std::chrono::microseconds(bytesMoved * 1000000 / bytesPerSecond));
+    }
+}
+
+/**
+ * @brief Set whether reads verify the checksums of the blocks they touch.
+ * 
+ * Each block is verified once after it is loaded, turning it off skips the
+ * verification entirely for latency sensitive work.
+ */
+void FileSystem::setVerifyChecksums(const bool verify)
+{
+    m_disk->setVerifyChecksums(verify);
+}
+
+/**
+ * @brief take a snapshot of the whole file system.
+ * 
+ * Taking a snapshot only starts a new generation, the blocks are copied when the
+ * file system writes to them for the first time after it. The generation table
+ * is created with the first snapshot.
+ * 
+ * @param name The name of the snapshot.
+ */
+void FileSystem::createSnapshot(const std::string& name)
+{
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
+
+    if (!m_snapshots)
+    {
+        m_header->generationsAddr = reserveRegion(SnapshotTable::getGenerationBlocksAmount(m_disk));
+        m_header->snapshotsAddr = reserveRegion(1);
+        m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+
+        m_snapshots = new SnapshotTable(m_disk, m_dblocksTable, m_header);
+        m_snapshots->formatGenerations();
+        m_dblocksTable->setSnapshots(m_snapshots);
+        m_disk->setSnapshots(m_snapshots);
+    }
+
+    m_snapshots->create(name);
+}
+
+/**
+ * @brief delete a snapshot, the blocks only it reads are reclaimed in the background.
+ * 
+ * @param name The name of the snapshot.
+ */
+void FileSystem::deleteSnapshot(const std::string& name)
+{
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+    DiskWriteSection section(m_disk);
+
+    if (!m_snapshots)
+        throw std::runtime_error("no snapshot named " + name);
+
+    m_snapshots->remove(name);
+    m_orphanAdded.notify_all();
+}
+
+std::vector<snapshotInfo> FileSystem::listSnapshots() const
+{
+    std::shared_lock<SharedMutex> lock(m_lock);
+
+    if (!m_snapshots)
+        return std::vector<snapshotInfo>();
+
+    return m_snapshots->list();
+}
+
+/**
+ * @brief open a snapshot as a read-only file system.
+ * 
+ * @param name The name of the snapshot.
+ * 
+ * @return std::unique_ptr<FileSystem> The snapshot, valid while this file system is open.
+ */
+std::unique_ptr<FileSystem> FileSystem::openSnapshot(const std::string& name)
+{
+    std::lock_guard<SharedMutex> lock(m_lock);
+    checkWritable();
+
+    return std::unique_ptr<FileSystem>(new FileSystem(*this, name));
+}
+
+/**
+ * @brief keep the writes of the operations run until endWriteBatch in one write section.
+ *        Their metadata blocks get their checksums once, when the batch ends, and
+ *        read-only mounts see all of them at once. The writes still run one at a time.
+ */
+void FileSystem::beginWriteBatch()
+{
+    checkWritable();
+    m_disk->enterWriteSection();
+}
+
+void FileSystem::endWriteBatch()
+{
+    m_disk->leaveWriteSection();
+}
+
+void FileSystem::checkWritable() const
+{
+    if (m_readOnly)
+        throw std::runtime_error("the file system is read-only");
+}
+
+/**
+ * @brief run a read under the shared lock. A read of a read-only mount runs until no
+ *        write of another process ran next to it, other file systems run it once.
+ * 
+ * @param operation The read, it may run more than once.
+ * 
+ * @return The result of the run that saw a consistent disk.
+ */
+template <typename Operation>
+auto FileSystem::readConsistent(Operation operation) const -> decltype(operation())
+{
+    if (!m_disk->isReadOnly())
+    {
+        std::shared_lock<SharedMutex> lock(m_lock);
+
+        return operation();
+    }
+
+    for (;;)
+    {
+        uint64_t sequence = m_disk->beginRead();
+        std::shared_lock<SharedMutex> lock(m_lock);
+
+        try
+        {
+            // the tables are reloaded alone, the reads of the old ones finish first
+            if (sequence != m_loadedSequence)
+            {
+                lock.unlock();
+
+                {
+                    std::lock_guard<SharedMutex> reloadLock(m_lock);
+
+                    if (sequence != m_loadedSequence)
+                        reloadShared(sequence);
+                }
+
+                lock.lock();
+
+                // another read loaded a later write meanwhile
+                if (sequence != m_loadedSequence)
+                    continue;
+            }
+
+            auto result = operation();
+
+            if (m_disk->endRead(sequence))
+                return result;
+        }
+        catch (std::exception&)
+        {
+            // the errors of a read the writer ran into are not errors of the disk
+            if (m_disk->endRead(sequence))
+                throw;
+        }
+    }
+}
+
+/**
+ * @brief load the header and the tables of a read-only mount again, the writer changed them.
+ */
+void FileSystem::reloadShared(const uint64_t sequence) const
+{
+    m_disk->read(0, sizeof(struct afsHeader), (char*)m_header);
+    loadInodeTable();
+
+    FragmentTable* fragments = new FragmentTable(m_disk, m_dblocksTable, m_header);
+
+    delete m_fragments;
+    m_fragments = fragments;
+    s_dirCursorEpoch++;
+    m_readAheads.clear();
+    m_loadedSequence = sequence;
+}
+
+/**
+ * @brief reserve contiguous cleared blocks for metadata.
+ * 
+ * @param blocksAmount the amount of blocks to reserve.
+ * 
+ * @return address the address of the first block.
+ */
+address FileSystem::reserveRegion(const uint32_t blocksAmount)
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    unsigned int firstBlock = m_dblocksTable->getFreeBlocks(blocksAmount);
+    std::vector<char> reset(blockSize, 0);
+
+    if (firstBlock == (unsigned int)-1)
+        throw std::runtime_error("not enough contiguous free blocks");
+
+    m_dblocksTable->reserveDBlocks(firstBlock, blocksAmount);
+
+    for (unsigned int i = firstBlock; i < firstBlock + blocksAmount; i++)
+        m_disk->write(Helper::blockToAddr(blockSize, i), blockSize, reset.data());
+
+    if (m_snapshots)
+        m_snapshots->setUntracked(Helper::blockToAddr(blockSize, firstBlock), blocksAmount);
+
+    return Helper::blockToAddr(blockSize, firstBlock);
+}
+
+/**
+ * @brief append content to a compressed file.
+ * 
+ * The content is split into chunks of COMPRESSION_CHUNK_BLOCKS blocks, the last
+ * chunk of the file is decompressed and written again together with the new content.
+ * 
+ * @param fileInode the inode of the file (its size and first address are updated).
+ * @param content the content to append.
+ */
+void FileSystem::appendCompressed(inode& fileInode, std::string content)
+{
+    uint32_t chunkSize = m_disk->getBlockSize() * COMPRESSION_CHUNK_BLOCKS;
+    uint32_t partialSize = fileInode.fileSize % chunkSize;
+    size_t offset = 0;
+    BlockMap blockMap(m_disk, m_dblocksTable, fileInode.firstAddr);
+
+    if (partialSize != 0)
+    {
+        uint32_t chunkIndex = fileInode.fileSize / chunkSize;
+
+        content = readChunk(blockMap, chunkIndex, partialSize) + content;
+        releaseChunk(blockMap, chunkIndex);
+        fileInode.fileSize -= partialSize;
+    }
+
+    while (offset < content.size())
+    {
+        uint32_t partSize = std::min<size_t>(content.size() - offset, chunkSize);
+
+        writeChunk(blockMap, fileInode.fileSize / chunkSize, content.c_str() + offset, partSize);
+
+        offset += partSize;
+        fileInode.fileSize += partSize;
+    }
+
+    fileInode.firstAddr = blockMap.getFirstAddr();
+}
+
+/**
+ * @brief read and decompress a chunk of a compressed file.
+ * 
+ * A chunk is stored raw when it takes all the blocks its raw size needs, otherwise its
+ * first blocks hold the compressed size followed by the compressed data.
+ * 
+ * @param blockMap the block map of the file.
+ * @param chunkIndex the index of the chunk in the file.
+ * @param rawSize the size of the chunk after decompression.
+ * 
+ * @return std::string the content of the chunk.
+ */
+std::string FileSystem::readChunk(BlockMap& blockMap, const uint32_t chunkIndex, const uint32_t rawSize) const
+{
+    uint32_t blockSize = m_disk->getBlockSize(), rawBlocks = (rawSize + blockSize - 1) / blockSize;
+    std::vector<address> blocks;
+    std::string chunk(rawSize, '\0');
+
+    for (uint32_t i = 0; i < rawBlocks; i++)
+    {
+        address dataAddr = blockMap.get(chunkIndex * COMPRESSION_CHUNK_BLOCKS + i);
+        if (dataAddr == 0)
+            break;
+
+        blocks.push_back(dataAddr);
+    }
+
+    if (blocks.size() == rawBlocks)
+    {
+        for (uint32_t i = 0; i < rawBlocks; i++)
+            m_disk->read(blocks[i], std::min(blockSize, rawSize - i * blockSize), &chunk[i * blockSize]);
+    }
+
+    else if (!blocks.empty())
+    {
+        std::string stored(blocks.size() * blockSize, '\0');
+        uint32_t storedSize;
+
+        for (size_t i = 0; i < blocks.size(); i++)
+            m_disk->read(blocks[i], blockSize, &stored[i * blockSize]);
+
+        memcpy(&storedSize, stored.c_str(), sizeof(storedSize));
+
+        if (storedSize > stored.size() - sizeof(storedSize) ||
+            !Compressor::decompress(stored.c_str() + sizeof(storedSize), storedSize, &chunk[0], rawSize))
+            throw std::runtime_error("corrupted compressed chunk");
+    }
+
+    return chunk;
+}
+
+/**
+ * @brief compress a chunk of a file and write it to new data blocks.
+ * 
+ * The chunk is kept raw if compressing it does not save at least one block.
+ * 
+ * @param blockMap the block map of the file.
+ * @param chunkIndex the index of the chunk in the file.
+ * @param content the content of the chunk.
+ * @param size the size of the content.
+ */
+void FileSystem::writeChunk(BlockMap& blockMap, const uint32_t chunkIndex, const char* content, const uint32_t size)
+{
+    uint32_t blockSize = m_disk->getBlockSize(), rawBlocks = (size + blockSize - 1) / blockSize;
+    std::string stored;
+    uint32_t storedSize = 0;
+
+    if (rawBlocks > 1)
+    {
+        stored.resize((rawBlocks - 1) * blockSize);
+        storedSize = Compressor::compress(content, size, &stored[sizeof(storedSize)], stored.size() - sizeof(storedSize));
+    }
+
+    if (storedSize != 0)
+    {
+        memcpy(&stored[0], &storedSize, sizeof(storedSize));
+        content = stored.c_str();
+        storedSize += sizeof(storedSize);
+    }
+    else
+        storedSize = size;
+
+    for (uint32_t i = 0; i * blockSize < storedSize; i++)
+    {
+        unsigned int dataBlock = m_dblocksTable->getFreeBlock();
+        address dataAddr = Helper::blockToAddr(blockSize, dataBlock);
+
+        m_dblocksTable->reserveDBlock(dataBlock);
+        m_disk->write(dataAddr, std::min(blockSize, storedSize - i * blockSize), content + i * blockSize);
+        blockMap.set(chunkIndex * COMPRESSION_CHUNK_BLOCKS + i, dataAddr);
+    }
+}
+
+/**
+ * @brief free the data blocks of a chunk of a compressed file.
+ * 
+ * @param blockMap the block map of the file.
+ * @param chunkIndex the index of the chunk in the file.
+ */
+void FileSystem::releaseChunk(BlockMap& blockMap, const uint32_t chunkIndex)
+{
+    for (uint32_t i = 0; i < COMPRESSION_CHUNK_BLOCKS; i++)
+    {
+        address dataAddr = blockMap.get(chunkIndex * COMPRESSION_CHUNK_BLOCKS + i);
+
+        if (dataAddr != 0)
+        {
+            m_dblocksTable->freeDBlock(Helper::addrToBlock(m_disk->getBlockSize(), dataAddr));
+            blockMap.set(chunkIndex * COMPRESSION_CHUNK_BLOCKS + i, 0);
+        }
+    }
+}
+
+/**
+ * @brief read part of the content of a file.
+ * 
+ * @param fileInode the inode of the file.
+ * @param offset the offset in the file to read from.
+ * @param size the amount of bytes to read (must be inside the file).
+ * @param buffer the buffer to read the content into.
+ */
+void FileSystem::readFileData(const inode& fileInode, const uint64_t offset, const uint64_t size, char* buffer, ReadAhead* readAhead) const
 {
-    inode fileInode = pathToInode(Helper::splitString(filePath));
-    address currentAddress = fileInode.firstAddr;
-    std::string fileContent = "", temp = "";
-    uint32_t size = fileInode.fileSize, blockSize = m_disk->getBlockSize();
-    char* buffer = new char[blockSize - sizeof(address)];
+    uint32_t blockSize = m_disk->getBlockSize();
+    uint64_t end = offset + size, position = offset;
+    BlockMap blockMap(m_disk, m_dblocksTable, fileInode.firstAddr);
+    BlockMap aheadMap(m_disk, m_dblocksTable, fileInode.firstAddr);
 
-    if (fileInode.flags & DIRTYPE) throw std::runtime_error("cant read content from directory");
+    if (fileInode.flags & INLINEDATA)
+    {
+        memcpy(buffer, fileInode.inlineData + offset, size);
+        return;
+    }
 
-    while (currentAddress != 0)
+    if (fileInode.flags & COMPRESSED)
     {
-        if (size > blockSize)
-        {
-            m_disk->read(currentAddress, size % (blockSize - sizeof(address)), buffer);
-            temp.assign(buffer, size % (blockSize - sizeof(address)));
-            size -= (blockSize - sizeof(address));
-        }
+        uint32_t chunkSize = blockSize * COMPRESSION_CHUNK_BLOCKS;
 
-        else
+        while (position < end)
         {
-            delete[] buffer;
-            buffer = new char[size];
-            m_disk->read(currentAddress, size, buffer);
-            temp.assign(buffer, size);
+            uint32_t chunkIndex = position / chunkSize, inChunk = position % chunkSize;
+            uint32_t rawSize = std::min<uint64_t>(chunkSize, fileInode.fileSize - (uint64_t)chunkIndex * chunkSize);
+            uint32_t partSize = std::min<uint64_t>(rawSize - inChunk, end - position);
+            uint32_t fileBlocks = (fileInode.fileSize + chunkSize - 1) / chunkSize * COMPRESSION_CHUNK_BLOCKS;
+
+            for (uint32_t i = 0; readAhead && i < COMPRESSION_CHUNK_BLOCKS; i++)
+                readAhead->access(aheadMap, chunkIndex * COMPRESSION_CHUNK_BLOCKS + i, fileBlocks);
+
+            std::string chunk = readChunk(blockMap, chunkIndex, rawSize);
+
+            memcpy(buffer + position - offset, chunk.c_str() + inChunk, partSize);
+            position += partSize;
         }
 
-        fileContent += temp;
-        m_disk->read(currentAddress + blockSize - sizeof(address), sizeof(address), (char*)&currentAddress);
+        return;
     }
 
-    return fileContent;
-}
+    uint64_t tailStart = fileInode.fileSize;
+    if (fileInode.flags & TAILPACKED)
+        tailStart -= fileInode.fileSize % blockSize;
 
-dirList FileSystem::listDir(const std::string &dirPath) const
-{
-    dirList list;
-    inode dirInode = pathToInode(Helper::splitString(dirPath)), siblingInode;
-    directoryData data;
+    while (position < end)
+    {
+        if (position >= tailStart)
+        {
+            m_disk->read(fileInode.tailAddr + position - tailStart, end - position, buffer + position - offset);
+            break;
+        }
 
-    if (dirInode.flags & DELETED)
-        throw std::runtime_error("cant list deleted directory");
+        uint32_t inBlock = position % blockSize;
+        uint32_t partSize = std::min<uint64_t>(blockSize - inBlock, std::min(end, tailStart) - position);
 
-    if (dirInode.flags & FILETYPE)
-        throw std::runtime_error("cannot list a file that is not a directory!");
+        if (readAhead)
+            readAhead->access(aheadMap, position / blockSize, (tailStart + blockSize - 1) / blockSize);
 
-    m_disk->read(dirInode.firstAddr, sizeof(directoryData), (char*)&data);
+        address dataAddr = blockMap.get(position / blockSize);
 
-    for (directoryData i = 0; i < data; i++)
-    {
-        dirSibling sibling = getSiblingData(dirInode.firstAddr, i);
-        m_disk->read(inodeIndexToAddr(sibling.indodeTableIndex), sizeof(inode), (char*)&siblingInode);
+        if (dataAddr != 0)
+            m_disk->read(dataAddr + inBlock, partSize, buffer + position - offset);
+        else
+            memset(buffer + position - offset, 0, partSize);
 
-        dirListEntry entry(sibling.name, siblingInode.fileSize, siblingInode.flags & DIRTYPE);
-        list.push_back(entry);
+        position += partSize;
     }
-
-    return list;
 }
 
-// =========== Helpers (private functions) =========== //
-
 /**
-* @brief write the superblock to the newly created disk
-*
-*/
-void FileSystem::setHeader()
+ * @brief Get how much of the end of the appended content should be packed into fragments.
+ * 
+ * @param fileInode the inode of the file (without a packed tail).
+ * @param contentSize the size of the content that is appended.
+ * 
+ * @return uint32_t the size of the tail to pack, 0 if the content should go to blocks only.
+ */
+uint32_t FileSystem::getPackableTailSize(const inode& fileInode, const uint64_t contentSize) const
 {
-    memcpy(m_header->magic, MAGIC, sizeof(m_header->magic));
-    m_header->version = CURR_VERSION;
-    m_header->blockSize = m_disk->getBlockSize();
-    m_header->nblocks = m_disk->getBlocksAmount();
-    m_header->inodeBlocks = ceil(m_disk->getBlocksAmount() / 10);
-    m_header->inodes = 0;
+    uint32_t blockSize = m_disk->getBlockSize(), freeInLastBlock = 0;
 
-    m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
-}
+    if (fileInode.fileSize % blockSize != 0)
+        freeInLastBlock = blockSize - (fileInode.fileSize % blockSize);
+
+    if (contentSize <= freeInLastBlock)
+        return 0;
 
+    uint32_t tailSize = (contentSize - freeInLastBlock) % blockSize;
+
+    return tailSize <= m_fragments->getMaxTailSize() ? tailSize : 0;
+}
 
 /**
-* @brief Write newly created inode into the disk.
-*
-* @param node The inode to write to the disk.
-*
-* @return uint32_t The index of the created Indoe.
-*/
-uint32_t FileSystem::createInode(const inode node)
+ * @brief release the data blocks and fragments of a file.
+ * 
+ * @param fileInode the inode of the file.
+ */
+void FileSystem::freeFileData(const inode& fileInode)
 {
-    m_disk->write(inodeIndexToAddr(m_header->inodes), sizeof(node), (const char*)&node);
-    m_header->inodes++;
-    m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+    address firstAddr = fileInode.firstAddr;
+
+    if (fileInode.flags & INLINEDATA)
+        return;
 
-    return m_header->inodes - 1;
+    if (fileInode.flags & TAILPACKED)
+        m_fragments->release(fileInode.tailAddr, fileInode.fileSize % m_disk->getBlockSize());
+
+    if (firstAddr == (address)-1)
+        return;
+
+    if (fileInode.flags & DIRTYPE)
+        m_dblocksTable->freeAllFileBlocks(firstAddr);
+    else
+        BlockMap(m_disk, m_dblocksTable, firstAddr).release();
 }
 
 /**
@@ -327,9 +2133,14 @@ uint32_t FileSystem::createInode(const inode node)
 * @return int The address of the inode in the inode table.
 
 */
-address FileSystem::inodeIndexToAddr(const int inodeIndex) const
+address FileSystem::inodeIndexToAddr(const uint32_t inodeIndex) const
 {
-    return ((1 + m_dblocksTable->getTableBlocksAmount()) * m_disk->getBlockSize()) + (sizeof(inode) * inodeIndex);
+    uint32_t inodesPerBlock = m_disk->getBlockSize() / sizeof(inode);
+
+    if (inodeIndex / inodesPerBlock >= m_inodeTable.size())
+        throw std::runtime_error("inode " + std::to_string(inodeIndex) + " is outside the inode table");
+
+    return m_inodeTable[inodeIndex / inodesPerBlock] + sizeof(inode) * (inodeIndex % inodesPerBlock);
 }
 
 
@@ -355,25 +2166,79 @@ inode FileSystem::getRoot() const
  * 
  * @return FileSystem::dirSibling the sibling with all the needed data.
  */
-dirSibling FileSystem::getSiblingData(const address dirAddr, const int indx) const
+dirSibling FileSystem::getSiblingData(const address dirAddr, const directoryData indx) const
 {
     dirSibling sibling;
-    uint16_t maxSiblingsPerBlock = (m_disk->getBlockSize() - sizeof(directoryData) - sizeof(address)) / sizeof(dirSibling);
-    unsigned int blockNum = indx / maxSiblingsPerBlock;
-    address currentAddr = dirAddr;
-    int offset = sizeof(dirSibling) * (indx - maxSiblingsPerBlock * blockNum);
 
-    if (blockNum == 0)
-        offset += sizeof(directoryData);
-
-    for (unsigned int i = 0; i < blockNum; i++)
-        m_disk->read(currentAddr + m_disk->getBlockSize() - sizeof(address), sizeof(address), (char*)&currentAddr);
-    
-    m_disk->read(currentAddr + offset, sizeof(dirSibling), (char*)&sibling);
+    m_disk->read(getSiblingAddr(dirAddr, indx), sizeof(dirSibling), (char*)&sibling);
     
     return sibling;
 }
 
+/**
+ * @brief Get the address of a sibling in a directory by its index.
+ * 
+ * @param dirAddr the address of the directory.
+ * @param indx the index of the sibling in the directory.
+ * 
+ * @return address the address of the sibling entry.
+ */
+address FileSystem::getSiblingAddr(const address dirAddr, const directoryData indx) const
+{
+    uint32_t maxSiblingsPerBlock = Helper::getSiblingsPerBlock(m_disk->getBlockSize());
+    address blockAddr = getDirBlock(dirAddr, indx / maxSiblingsPerBlock);
+
+    if (blockAddr == 0)
+        throw std::runtime_error("corrupted block chain");
+
+    return Helper::getSiblingAddr(blockAddr, m_disk->getBlockSize(), indx % maxSiblingsPerBlock);
+}
+
+/**
+ * @brief Get the address of the fingerprint of a sibling in a directory by its index.
+ */
+address FileSystem::getFingerprintAddr(const address dirAddr, const directoryData indx) const
+{
+    uint32_t maxSiblingsPerBlock = Helper::getSiblingsPerBlock(m_disk->getBlockSize());
+    address blockAddr = getDirBlock(dirAddr, indx / maxSiblingsPerBlock);
+
+    if (blockAddr == 0)
+        throw std::runtime_error("corrupted block chain");
+
+    return Helper::getFingerprintAddr(blockAddr, indx % maxSiblingsPerBlock);
+}
+
+/**
+ * @brief Get the address of a block of a directory. The last visited block is kept,
+ *        so reading the entries one after the other follows the chain once.
+ *
+ * @param dirAddr the address of the directory.
+ * @param blockIndex the index of the block in the chain of the directory.
+ *
+ * @return address the address of the block, 0 if the chain is shorter.
+ */
+address FileSystem::getDirBlock(const address dirAddr, const uint32_t blockIndex) const
+{
+    dirCursor& cursor = t_dirCursor;
+    uint64_t epoch = s_dirCursorEpoch.load(std::memory_order_relaxed);
+
+    if (cursor.owner != this || cursor.epoch != epoch || cursor.dir != dirAddr || cursor.index > blockIndex)
+        cursor = { this, epoch, dirAddr, 0, dirAddr };
+
+    while (cursor.index < blockIndex)
+    {
+        address nextAddr = Helper::getNextBlock(m_disk, cursor.addr);
+
+        if (nextAddr == 0)
+            return 0;
+
+        cursor.addr = nextAddr;
+        cursor.index++;
+    }
+
+    return cursor.addr;
+}
+
 /**
  * @brief Get the sibling of a directory by the name of the sibling in the directory.
  * 
@@ -384,25 +2249,14 @@ dirSibling FileSystem::getSiblingData(const address dirAddr, const int indx) con
  */
 dirSibling FileSystem::getSiblingData(const address dirAddr, const std::string& siblingName) const
 {
-    dirSibling sibling;
-    directoryData data;
-    bool found = false;
-
-    m_disk->read(dirAddr, sizeof(directoryData), (char*)&data);
-
-    for (uint16_t i = 0; i < data && !found; i++)
-    {
-        sibling = getSiblingData(dirAddr, i);
-        if (strncmp(sibling.name, siblingName.c_str(), sizeof(sibling.name)) == 0)
-            found = true;
-    }
+    int64_t index = getSiblingIndex(dirAddr, siblingName);
 
-    if (!found)
+    if (index == -1)
     {
         throw std::runtime_error(std::string("could not find file: ") + siblingName);
     }
 
-    return sibling;
+    return getSiblingData(dirAddr, index);
 }
 
 /**
@@ -417,7 +2271,7 @@ address FileSystem::pathToAddr(afsPath path) const
     inode curr;
     directorySibling sibling;
 
-    uint16_t i;
+    size_t i;
 
     if (path.size() != 1 && path[path.size() - 1] == "/")
         path.pop_back();
@@ -447,21 +2301,47 @@ address FileSystem::pathToAddr(afsPath path) const
 address FileSystem::getFreeDirChunkAddr(const address dirAddr)
 {
     directoryData data;
-    address lastAddr = Helper::getLastFileBlock(m_disk, dirAddr), chunkAddress = 0;
-    uint16_t maxSiblingsPerBlock = (m_disk->getBlockSize() - sizeof(directoryData) - sizeof(address)) / sizeof(dirSibling);
-    unsigned int dirBlocks;
-    
+    uint32_t blockSize = m_disk->getBlockSize();
+    uint32_t maxSiblingsPerBlock = Helper::getSiblingsPerBlock(blockSize);
 
     m_disk->read(dirAddr, sizeof(directoryData), (char*)&data);
-    dirBlocks = floor(data / maxSiblingsPerBlock) + 1;
-    
-    unsigned int siblingsRemainInBlock =  (maxSiblingsPerBlock * dirBlocks) - (maxSiblingsPerBlock * (dirBlocks - 1)) - data;
 
-    chunkAddress = lastAddr + sizeof(dirSibling) * (maxSiblingsPerBlock - siblingsRemainInBlock);
-    if (lastAddr == dirAddr)
-        chunkAddress += sizeof(directoryData);
+    uint32_t blockNum = data / maxSiblingsPerBlock;
+    address blockAddr = getDirBlock(dirAddr, blockNum);
+
+    // the last block is full, chain a new block to the directory
+    if (blockAddr == 0)
+    {
+        address lastAddr = getDirBlock(dirAddr, blockNum - 1);
+
+        if (lastAddr == 0)
+            throw std::runtime_error("corrupted block chain");
+
+        blockAddr = reserveClearedBlock();
+        m_disk->write(lastAddr + blockSize - sizeof(address), sizeof(address), (const char*)&blockAddr);
+        t_dirCursor.addr = blockAddr;
+        t_dirCursor.index = blockNum;
+    }
+
+    return Helper::getSiblingAddr(blockAddr, blockSize, data % maxSiblingsPerBlock);
+}
+
+/**
+ * @brief reserve a cleared block, for directory entries or the inode table.
+ * 
+ * @return address the address of the block.
+ */
+address FileSystem::reserveClearedBlock()
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    unsigned int dirBlock = m_dblocksTable->getFreeBlock();
+    address dirAddr = Helper::blockToAddr(blockSize, dirBlock);
+    std::vector<char> reset(blockSize, 0);
+
+    m_dblocksTable->reserveDBlock(dirBlock);
+    m_disk->write(dirAddr, blockSize, reset.data());
 
-    return chunkAddress;
+    return dirAddr;
 }
 
 /**
@@ -474,28 +2354,86 @@ address FileSystem::getFreeDirChunkAddr(const address dirAddr)
 void FileSystem::addSibling(const address dirAddr, const dirSibling sibling)
 {
     directoryData data;
-    address currentAddress = dirAddr;
-    uint16_t maxSiblingsPerBlock = (m_disk->getBlockSize() - sizeof(directoryData) - sizeof(address)) / sizeof(dirSibling);
+    uint8_t fingerprint = NameHash::fingerprint(sibling.name);
+
+    m_disk->read(dirAddr, sizeof(directoryData), (char*)&data);
+
+    m_disk->write(getFreeDirChunkAddr(dirAddr), sizeof(dirSibling), (const char*)&sibling);
+    m_disk->write(getFingerprintAddr(dirAddr, data), sizeof(fingerprint), (const char*)&fingerprint);
+    m_disk->write(dirAddr, sizeof(directoryData), (const char*)&(++data));
+}
+
+
+/**
+ * @brief remove a sibling from a directory, the last sibling takes its place.
+ * 
+ * @param dirAddr the address of the directory.
+ * @param siblingName the name of the sibling to remove.
+ */
+void FileSystem::removeSibling(const address dirAddr, const std::string& siblingName)
+{
+    char reset[sizeof(dirSibling)] = { 0 };
+    int64_t index = getSiblingIndex(dirAddr, siblingName);
+    directoryData data;
 
-    unsigned int dirBlocks;
+    if (index == -1)
+        throw std::runtime_error(std::string("could not find file: ") + siblingName);
+
+    m_disk->read(dirAddr, sizeof(directoryData), (char*)&data);
+
+    address lastSiblingAddr = getSiblingAddr(dirAddr, data - 1);
+    address lastFingerprintAddr = getFingerprintAddr(dirAddr, data - 1);
+    dirSibling lastSibling = getSiblingData(dirAddr, data - 1);
+    uint8_t lastFingerprint;
+
+    m_disk->read(lastFingerprintAddr, sizeof(lastFingerprint), (char*)&lastFingerprint);
+
+    m_disk->write(getSiblingAddr(dirAddr, index), sizeof(dirSibling), (const char*)&lastSibling);
+    m_disk->write(getFingerprintAddr(dirAddr, index), sizeof(lastFingerprint), (const char*)&lastFingerprint);
+    m_disk->write(lastSiblingAddr, sizeof(dirSibling), reset);
+    m_disk->write(lastFingerprintAddr, sizeof(uint8_t), reset);
+    m_disk->write(dirAddr, sizeof(directoryData), (const char*)&(--data));
+}
+
+/**
+ * @brief Get the index of a sibling in a directory by its name.
+ * 
+ * @return int64_t the index of the sibling, -1 if the directory has no sibling with this name.
+ */
+int64_t FileSystem::getSiblingIndex(const address dirAddr, const std::string& siblingName) const
+{
+    uint32_t blockSize = m_disk->getBlockSize(), maxSiblingsPerBlock = Helper::getSiblingsPerBlock(blockSize);
+    uint8_t fingerprint = NameHash::fingerprint(siblingName.c_str());
+    std::vector<uint8_t> fingerprints(maxSiblingsPerBlock);
+    directoryData data;
 
     m_disk->read(dirAddr, sizeof(directoryData), (char*)&data);
-    currentAddress = Helper::getLastFileBlock(m_disk, currentAddress);
 
-    dirBlocks = floor(data / maxSiblingsPerBlock) + 1;
-    if (data + 1 > (uint16_t)(maxSiblingsPerBlock * dirBlocks))
+    // only the entries whose fingerprint matches are read and compared
+    for (uint32_t first = 0, blockNum = 0; first < data; first += maxSiblingsPerBlock, blockNum++)
     {
-        unsigned int nextBlock = m_dblocksTable->getFreeBlock();
-        address nextBlockAddr = Helper::blockToAddr(m_disk->getBlockSize(), currentAddress);
-        m_dblocksTable->reserveDBlock(nextBlock);
-        m_disk->write(currentAddress + m_disk->getBlockSize() - sizeof(address), sizeof(address), (const char*)&nextBlockAddr);
+        uint32_t inBlock = std::min(maxSiblingsPerBlock, data - first);
+        address blockAddr = getDirBlock(dirAddr, blockNum);
+
+        if (blockAddr == 0)
+            throw std::runtime_error("corrupted block chain");
+
+        m_disk->read(Helper::getFingerprintAddr(blockAddr, 0), inBlock * sizeof(uint8_t), (char*)fingerprints.data());
+
+        for (uint32_t i = NameHash::find(fingerprints.data(), inBlock, fingerprint); i < inBlock; i = NameHash::find(fingerprints.data(), inBlock, fingerprint, i + 1))
+        {
+            dirSibling sibling;
+
+            m_disk->read(Helper::getSiblingAddr(blockAddr, blockSize, i), sizeof(dirSibling), (char*)&sibling);
+
+            if (strncmp(sibling.name, siblingName.c_str(), sizeof(sibling.name)) == 0)
+                return first + i;
+        }
     }
 
-    m_disk->write(getFreeDirChunkAddr(dirAddr), sizeof(dirSibling), (const char*)&sibling);
-    m_disk->write(dirAddr, sizeof(directoryData), (const char*)&(++data));
+    return -1;
 }
 
-
 /**
  * @brief create previous (..) and current (.) dir and add it to the needed directory 
  * 
@@ -557,50 +2495,260 @@ inode FileSystem::pathToInode(const afsPath path) const
 
 uint32_t FileSystem::createDirectory(std::string path, inode fileInode)
 {
-    fileInode.firstAddr = Helper::blockToAddr(m_disk->getBlockSize(), m_dblocksTable->getFreeBlock());
-    m_dblocksTable->reserveDBlock(Helper::addrToBlock(m_disk->getBlockSize(), fileInode.firstAddr));
+    uint32_t parentIndex = pathToInodeIndex(Helper::splitString(path));
+
+    fileInode.firstAddr = reserveClearedBlock();
     uint32_t inodeIndex = createInode(fileInode);
 
-    if ( path.size() > 1 && path[path.size() - 1] == '/')
-        path = path.substr(0, path.size() - 1);
+    createCurrAndPrevDir(inodeIndex, path == "/" && inodeIndex == 0 ? inodeIndex : parentIndex);
 
-    if (path == "/")
-        createCurrAndPrevDir(inodeIndex, inodeIndex);
+    return inodeIndex;
+}
 
-    else
+/**
+ * @brief convert file path to the index of its inode.
+ * 
+ * @param path the path of the file.
+ * 
+ * @return uint32_t the index of the inode in the inode table.
+ */
+uint32_t FileSystem::pathToInodeIndex(afsPath path) const
+{
+    if (path.size() > 1 && path[path.size() - 1] == "/")
+        path.pop_back();
+
+    if (path.size() == 1 && path[0] == "/")
+        return 0;
+
+    afsPath parentPath = afsPath(path.begin(), path.end() - 1);
+
+    if (parentPath.empty())
+        parentPath.push_back("/");
+
+    return getSiblingData(pathToAddr(parentPath), path[path.size() - 1]).indodeTableIndex;
+}
+
+/**
+ * @brief put an inode at the head of the orphan list and wake the reclaimer.
+ * 
+ * @param inodeIndex The index of the inode.
+ * @param node The inode, already unlinked from its directory.
+ */
+void FileSystem::addOrphan(const uint32_t inodeIndex, inode& node)
+{
+    node.flags |= ORPHAN;
+    node.nextOrphan = m_header->orphanHead;
+    m_disk->write(inodeIndexToAddr(inodeIndex), sizeof(inode), (const char*)&node);
+
+    m_header->orphanHead = inodeIndex;
+    m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+
+    m_orphanAdded.notify_all();
+}
+
+/**
+ * @brief background thread that releases the orphans one step at a time, so
+ *        other operations can run in between the steps.
+ */
+void FileSystem::runReclaimer()
+{
+    std::unique_lock<SharedMutex> lock(m_lock);
+
+    while (!m_stopReclaimer)
+    {
+        if (!hasReclaimWork())
+        {
+            m_reclaimIdle.notify_all();
+            m_orphanAdded.wait(lock);
+            continue;
+        }
+
+        uint32_t orphan = m_header->orphanHead;
+
+        try
+        {
+            DiskWriteSection section(m_disk);
+
+            // the deleted files are reclaimed first, then the deleted snapshots
+            if (orphan != NO_ORPHAN)
+                reclaimStep();
+            else
+                m_snapshots->reclaimStep();
+        }
+        catch (std::exception& e)
+        {
+            // a damaged orphan or snapshot is left for afs-fsck instead of being retried forever
+            m_reclaimStatus.lastError = e.what();
+
+            if (orphan != NO_ORPHAN)
+            {
+                m_reclaimStatus.failedOrphans.push_back(orphan);
+                skipOrphan(orphan);
+            }
+            else
+                m_reclaimStatus.snapshotsFailed = true;
+
+            m_reclaimIdle.notify_all();
+            continue;
+        }
+
+        lock.unlock();
+        std::this_thread::yield();
+        lock.lock();
+    }
+}
+
+/**
+ * @brief take an orphan the reclaimer failed on out of the orphan list, the orphans
+ *        behind it are still reclaimed. The list is cut there when the orphan cannot be read
+ *        or the list goes back to an orphan that failed before.
+ */
+void FileSystem::skipOrphan(const uint32_t inodeIndex)
+{
+    // the failed step may have added orphans before it
+    if (m_header->orphanHead != inodeIndex)
+        return;
+
+    inode node;
+
+    try
     {
-        dirSibling parent = getSiblingData(pathToAddr(Helper::splitString(path + "/..")), ".");
-        createCurrAndPrevDir(inodeIndex, parent.indodeTableIndex);
+        m_disk->read(inodeIndexToAddr(inodeIndex), sizeof(inode), (char*)&node);
+        m_header->orphanHead = node.nextOrphan;
+
+        // a list that loops back to an orphan that failed would fail forever
+        if (std::find(m_reclaimStatus.failedOrphans.begin(), m_reclaimStatus.failedOrphans.end(), node.nextOrphan) != m_reclaimStatus.failedOrphans.end())
+            m_header->orphanHead = NO_ORPHAN;
+    }
+    catch (std::exception&)
+    {
+        m_header->orphanHead = NO_ORPHAN;
     }
 
-    return inodeIndex;
+    try
+    {
+        DiskWriteSection section(m_disk);
+        m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+    }
+    catch (std::exception&) {}
+}
+
+/**
+ * @brief the orphans and snapshots the reclaimer failed on, and the error of the last failure.
+ */
+reclaimStatus FileSystem::getReclaimStatus() const
+{
+    std::shared_lock<SharedMutex> lock(m_lock);
+
+    return m_reclaimStatus;
+}
+
+/**
+ * @brief check whether deleted files or snapshots are waiting to be reclaimed.
+ */
+bool FileSystem::hasReclaimWork() const
+{
+    if (m_readOnly)
+        return false;
+
+    return m_header->orphanHead != NO_ORPHAN || (m_snapshots && !m_reclaimStatus.snapshotsFailed && m_snapshots->hasDeleted());
 }
 
-void FileSystem::recursiveRemove(inode dirInode)
+/**
+ * @brief release a part of the orphan at the head of the list.
+ * 
+ * A step moves one entry of a directory to the orphan list, or releases the tail,
+ * one map block with its data blocks, or the entries blocks of a directory. The
+ * inode is updated before the blocks are released, so a crash can leak blocks
+ * (found by afs-fsck) but never release them twice. The orphan leaves the list
+ * once nothing is left.
+ */
+void FileSystem::reclaimStep()
 {
-    directoryData data, reset = 0;
-    dirSibling currentSibling;
-    inode currentSiblingInode;
-    address inodeAddr;
+    uint32_t inodeIndex = m_header->orphanHead, blockSize = m_disk->getBlockSize();
+    inode node;
+    std::vector<unsigned int> blocks;
 
-    m_disk->read(dirInode.firstAddr, sizeof(data), (char*)&data);
-    m_disk->write(dirInode.firstAddr, sizeof(data), (char*)&reset);
+    m_disk->read(inodeIndexToAddr(inodeIndex), sizeof(inode), (char*)&node);
 
-    for (int i = 2; i < data; i++) // skip .. and . files.
+    // the inode was released right before a crash
+    if (node.flags & DELETED)
     {
-        currentSibling = getSiblingData(dirInode.firstAddr, i);
-        inodeAddr = inodeIndexToAddr(currentSibling.indodeTableIndex);
-        m_disk->read(inodeAddr, sizeof(inode), (char*)&currentSiblingInode);
-        
-        if (currentSiblingInode.flags & DIRTYPE)
-            recursiveRemove(currentSiblingInode);
+        m_header->orphanHead = node.nextOrphan;
+        m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+        return;
+    }
+
+    if (node.flags & DIRTYPE && node.firstAddr != (address)-1)
+    {
+        directoryData data;
+        m_disk->read(node.firstAddr, sizeof(directoryData), (char*)&data);
+
+        // the directory is expanded lazily, from its last entry down to "." and ".."
+        if (data > 2)
+        {
+            dirSibling child = getSiblingData(node.firstAddr, data - 1);
+            inode childInode;
+
+            m_disk->read(inodeIndexToAddr(child.indodeTableIndex), sizeof(inode), (char*)&childInode);
+
+            if (!(childInode.flags & (ORPHAN | DELETED)))
+                addOrphan(child.indodeTableIndex, childInode);
+
+            m_disk->write(node.firstAddr, sizeof(directoryData), (const char*)&(--data));
+            return;
+        }
+
+        for (address currentAddr = node.firstAddr; currentAddr != 0; currentAddr = Helper::getNextBlock(m_disk, currentAddr))
+        {
+            if (blocks.size() > m_disk->getBlocksAmount())
+                throw std::runtime_error("block chain has a loop");
+
+            blocks.push_back(Helper::addrToBlock(blockSize, currentAddr));
+        }
 
-        if (currentSiblingInode.firstAddr != (address)-1)
-            m_dblocksTable->freeAllFileBlocks(currentSiblingInode.firstAddr);
+        node.firstAddr = (address)-1;
+        s_dirCursorEpoch++;
+    }
+
+    else if (node.flags & TAILPACKED)
+    {
+        address tailAddr = node.tailAddr;
+
+        node.flags &= ~TAILPACKED;
+        m_disk->write(inodeIndexToAddr(inodeIndex), sizeof(inode), (const char*)&node);
+        m_fragments->release(tailAddr, node.fileSize % blockSize);
+        return;
+    }
+
+    else if (!(node.flags & INLINEDATA) && node.firstAddr != (address)-1)
+    {
+        uint32_t entriesPerBlock = (blockSize - sizeof(address)) / sizeof(address);
+        std::vector<address> entries(entriesPerBlock);
+        address nextAddr = Helper::getNextBlock(m_disk, node.firstAddr);
+
+        m_disk->read(node.firstAddr, entriesPerBlock * sizeof(address), (char*)entries.data());
 
-        currentSiblingInode.flags |= DELETED;
+        for (address dataAddr : entries)
+        {
+            if (dataAddr != 0)
+                blocks.push_back(Helper::addrToBlock(blockSize, dataAddr));
+        }
+
+        blocks.push_back(Helper::addrToBlock(blockSize, node.firstAddr));
+        node.firstAddr = nextAddr == 0 ? (address)-1 : nextAddr;
+    }
 
-        m_disk->write(inodeAddr, sizeof(inode), (const char*)&currentSiblingInode);
-        m_header->inodes--;
+    else
+    {
+        node.flags &= ~ORPHAN;
+        freeInode(inodeIndex, node);
+
+        m_header->orphanHead = node.nextOrphan;
+        m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+        return;
     }
+
+    m_disk->write(inodeIndexToAddr(inodeIndex), sizeof(inode), (const char*)&node);
+    m_dblocksTable->freeDBlocks(blocks);
 }
@@ -74,7 +74,7 @@ uint32_t Helper::getCorrectSize(uint32_t inputSize)
 */
 address Helper::blockToAddr(uint32_t blockSize, unsigned int blockNum, unsigned int offset)
 {
-    return (blockNum * blockSize) + offset;
+    return (address)blockNum * blockSize + offset;
 }
 
 /**
@@ -89,18 +89,68 @@ unsigned int Helper::addrToBlock(uint32_t blockSize, address addr)
     return addr / blockSize; 
 }
 
-address Helper::getSiblingAddr(address parentAddr, unsigned int index)
+/**
+ * @brief Get the amount of entries a directory block holds. A block starts with the
+ *        entries amount (used in the first block of the directory only), then the
+ *        fingerprints of the names, the entries, and the address of the next block.
+ */
+uint32_t Helper::getSiblingsPerBlock(uint32_t blockSize)
+{
+    return (blockSize - sizeof(directoryData) - sizeof(address)) / (sizeof(dirSibling) + sizeof(uint8_t));
+}
+
+/**
+ * @brief Get the address of an entry in a directory block.
+ * 
+ * @param blockAddr The address of the block.
+ * @param index The index of the entry in the block.
+ */
+address Helper::getSiblingAddr(address blockAddr, uint32_t blockSize, unsigned int index)
+{
+    return blockAddr + sizeof(directoryData) + getSiblingsPerBlock(blockSize) * sizeof(uint8_t) + sizeof(dirSibling) * index;
+}
+
+/**
+ * @brief Get the address of the fingerprint of an entry in a directory block.
+ */
+address Helper::getFingerprintAddr(address blockAddr, unsigned int index)
 {
-    return parentAddr + sizeof(directoryData) + (sizeof(dirSibling) * index);
+    return blockAddr + sizeof(directoryData) + sizeof(uint8_t) * index;
+}
+
+/**
+ * @brief Get the next block of a chain, the pointer at the end of the block
+ *        must be the address of a block on the disk.
+ * 
+ * @param disk The disk the chain is on.
+ * @param blockAddr The address of the current block.
+ * 
+ * @return address The address of the next block, 0 at the end of the chain.
+ */
+address Helper::getNextBlock(const Disk* disk, address blockAddr)
+{
+    address nextAddr;
+
+    disk->read(blockAddr + disk->getBlockSize() - sizeof(address), sizeof(address), (char*)&nextAddr);
+
+    if (nextAddr != 0 && (nextAddr % disk->getBlockSize() != 0 || nextAddr >= disk->getDiskSize()))
+        throw std::runtime_error("corrupted block chain");
+
+    return nextAddr;
 }
 
 address Helper::getLastFileBlock(const Disk* disk, address fileAddr)
 {
     address currentAddr = fileAddr;
+    uint32_t hops = 0;
+
     while (currentAddr != 0)
     {
+        if (hops++ > disk->getBlocksAmount())
+            throw std::runtime_error("block chain has a loop");
+
         fileAddr = currentAddr;
-        disk->read(currentAddr + disk->getBlockSize() - sizeof(address), sizeof(address), (char*)&currentAddr);
+        currentAddr = getNextBlock(disk, currentAddr);
     }
 
     return fileAddr;
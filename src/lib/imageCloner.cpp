@@ -0,0 +1,343 @@
+#include <afs/imageCloner.h>
+#include <afs/bootLoad.h>
+#include <afs/blocksTable.h>
+#include <afs/snapshotTable.h>
+#include <afs/disk.h>
+#include <afs/helper.h>
+#include <afs/stripeSet.h>
+
+#include <stdexcept>
+#include <system_error>
+#include <algorithm>
+#include <memory>
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+
+/**
+ * @brief add a block to a list of runs, it extends the last run when it follows it.
+ */
+template <typename Run>
+static void addToRuns(std::vector<Run>& runs, const uint32_t blockNum, const uint32_t maxBlocks)
+{
+    if (!runs.empty() && runs.back().first + runs.back().amount == blockNum && runs.back().amount < maxBlocks)
+        runs.back().amount++;
+    else
+        runs.push_back({blockNum, 1});
+}
+
+/**
+ * @brief open an image to copy.
+ * 
+ * @param filePath The image.
+ * @param threads The amount of copying threads, 0 for one per CPU.
+ */
+ImageCloner::ImageCloner(const char* filePath, const unsigned int threads):
+    m_fd(-1), m_header(nullptr), m_pool(threads), m_bytesCopied(0)
+{
+    if (!Helper::isFileExist(filePath))
+        throw std::runtime_error(std::string("disk file does not exist: ") + filePath);
+
+    int headerFd;
+    uint64_t offset, length;
+
+    // a striped volume is copied to a single image
+    if (StripeSet::isStripeSet(filePath))
+    {
+        m_stripes.reset(new StripeSet(filePath));
+        m_stripes->locate(0, headerFd, offset, length);
+    }
+    else
+    {
+        m_fd = open(filePath, O_RDONLY | O_CLOEXEC);
+
+        if (m_fd == -1)
+            throw std::system_error(errno, std::generic_category(), filePath);
+
+        headerFd = m_fd;
+    }
+
+    // a writer locks the image alone, so the copy is refused while one has it open
+    // and the writers that come later are refused until the cloner is destroyed
+    if (flock(headerFd, LOCK_SH | LOCK_NB) != 0)
+    {
+        int error = errno;
+
+        if (m_fd != -1)
+            close(m_fd);
+
+        throw std::runtime_error(error == EWOULDBLOCK ? "the disk is open for writing in another process" : strerror(error));
+    }
+
+    try
+    {
+        m_header = BootLoad::load(filePath);
+
+        // a striped volume is created before it is formatted
+        if (!m_header)
+            throw std::runtime_error(std::string("disk file is not formatted: ") + filePath);
+    }
+    catch (...)
+    {
+        if (m_fd != -1)
+            close(m_fd);
+
+        throw;
+    }
+}
+
+ImageCloner::~ImageCloner()
+{
+    if (m_fd != -1)
+        close(m_fd);
+
+    delete m_header;
+}
+
+/**
+ * @brief read a range of the image, from the members of a striped volume.
+ */
+void ImageCloner::readImage(const uint64_t addr, const uint64_t size, char* data) const
+{
+    if (m_stripes)
+        return m_stripes->read(addr, size, data);
+
+    if (pread(m_fd, data, size, addr) != (ssize_t)size)
+        throw std::runtime_error("could not read the image");
+}
+
+std::vector<unsigned char> ImageCloner::readBlocksTable() const
+{
+    std::vector<unsigned char> table(m_header->nblocks);
+
+    readImage(Helper::blockToAddr(m_header->blockSize, DBLOCKS_TABLE_BLOCK_INDX), table.size(), (char*)table.data());
+
+    return table;
+}
+
+/**
+ * @brief read the generation of every block, empty if no snapshot was ever taken.
+ */
+std::vector<uint32_t> ImageCloner::readGenerations() const
+{
+    std::vector<uint32_t> generations;
+
+    if (m_header->generationsAddr == 0)
+        return generations;
+
+    generations.resize(m_header->nblocks);
+
+    readImage(m_header->generationsAddr, generations.size() * sizeof(uint32_t), (char*)generations.data());
+
+    return generations;
+}
+
+/**
+ * @brief copy a range of the image to the same offset in another file, a range
+ *        of a striped volume part by part from the members that keep it.
+ */
+void ImageCloner::copyRange(const int dstFd, const uint64_t offset, const uint64_t length)
+{
+    for (uint64_t addr = offset; addr < offset + length; )
+    {
+        int srcFd = m_fd;
+        uint64_t srcOffset = addr, partLength = offset + length - addr;
+
+        if (m_stripes)
+        {
+            m_stripes->locate(addr, srcFd, srcOffset, partLength);
+            partLength = std::min(partLength, offset + length - addr);
+        }
+
+        copyFile(srcFd, srcOffset, dstFd, addr, partLength);
+        addr += partLength;
+    }
+
+    m_bytesCopied += length;
+}
+
+/**
+ * @brief copy a range between two files with copy_file_range, or by reading and
+ *        writing when the host can not.
+ */
+void ImageCloner::copyFile(const int srcFd, const uint64_t srcAddr, const int dstFd, const uint64_t dstAddr, const uint64_t length)
+{
+    loff_t srcOffset = srcAddr, dstOffset = dstAddr;
+    uint64_t left = length;
+
+    while (left > 0)
+    {
+        ssize_t res = copy_file_range(srcFd, &srcOffset, dstFd, &dstOffset, left, 0);
+
+        if (res == -1 && errno == EINTR)
+            continue;
+
+        if (res == -1 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+            break;
+
+        if (res == -1)
+            throw std::system_error(errno, std::generic_category(), "copy_file_range");
+
+        if (res == 0)
+            throw std::runtime_error("the image is shorter than its header says");
+
+        left -= res;
+    }
+
+    std::vector<char> buffer(std::min<uint64_t>(left, 1 << 20));
+
+    for (; left > 0; )
+    {
+        ssize_t res = pread(srcFd, buffer.data(), std::min<uint64_t>(left, buffer.size()), srcOffset);
+
+        if (res <= 0)
+            throw std::runtime_error("could not read the image");
+
+        if (pwrite(dstFd, buffer.data(), res, dstOffset) != res)
+            throw std::system_error(errno, std::generic_category(), "write");
+
+        srcOffset += res;
+        dstOffset += res;
+        left -= res;
+    }
+}
+
+/**
+ * @brief open the copy with the given flags and copy runs of blocks to it in parallel,
+ *        then release the free blocks of the copy so their checksums are the ones of empty blocks.
+ */
+cloneReport ImageCloner::copyRuns(const char* dstPath, const int openFlags, const std::vector<blockRun>& copied, const std::vector<blockRun>& discarded)
+{
+    uint32_t blockSize = m_header->blockSize;
+    cloneReport report = {0, 0, 0};
+    int dstFd = open(dstPath, O_WRONLY | O_CLOEXEC | openFlags, 0664);
+
+    if (dstFd == -1)
+        throw std::system_error(errno, std::generic_category(), dstPath);
+
+    m_bytesCopied = 0;
+
+    try
+    {
+        // a new copy gets its full size up front, the blocks that are not copied stay holes
+        if (openFlags & O_CREAT && ftruncate(dstFd, (off_t)blockSize * m_header->nblocks) != 0)
+            throw std::system_error(errno, std::generic_category(), "ftruncate");
+
+        for (const blockRun& run : copied)
+        {
+            m_pool.submit([this, dstFd, run, blockSize]() {
+                copyRange(dstFd, Helper::blockToAddr(blockSize, run.first), (uint64_t)run.amount * blockSize);
+            });
+
+            report.blocksCopied += run.amount;
+        }
+
+        m_pool.wait();
+
+        if (fsync(dstFd) != 0)
+            throw std::system_error(errno, std::generic_category(), "fsync");
+    }
+    catch (...)
+    {
+        close(dstFd);
+        throw;
+    }
+
+    close(dstFd);
+    report.bytesCopied = m_bytesCopied;
+
+    if (!discarded.empty())
+    {
+        Disk disk(dstPath, blockSize, m_header->nblocks);
+
+        if (m_header->checksumAddr != 0)
+            disk.enableChecksums(m_header->checksumAddr, false);
+
+        for (const blockRun& run : discarded)
+        {
+            disk.discard(Helper::blockToAddr(blockSize, run.first), (uint64_t)run.amount * blockSize);
+            report.blocksDiscarded += run.amount;
+        }
+    }
+
+    return report;
+}
+
+/**
+ * @brief copy the image to a new sparse file.
+ * 
+ * @param dstPath The file to create.
+ * 
+ * @return cloneReport What was copied.
+ */
+cloneReport ImageCloner::clone(const char* dstPath)
+{
+    std::vector<unsigned char> table = readBlocksTable();
+    std::vector<uint32_t> generations = readGenerations();
+    std::vector<blockRun> copied, discarded;
+    uint32_t chunkBlocks = CLONE_CHUNK_BYTES / m_header->blockSize;
+
+    for (uint32_t blockNum = 0; blockNum < m_header->nblocks; blockNum++)
+    {
+        // a free block a snapshot still reads has neither the free nor the untracked mark
+        bool snapshotRead = !generations.empty() && generations[blockNum] != GEN_UNTRACKED && !(generations[blockNum] & GEN_FREE);
+
+        if (table[blockNum] || snapshotRead)
+            addToRuns(copied, blockNum, chunkBlocks);
+        else
+            addToRuns(discarded, blockNum, (uint32_t)-1);
+    }
+
+    return copyRuns(dstPath, O_CREAT | O_EXCL, copied, discarded);
+}
+
+/**
+ * @brief bring a copy made by clone or update up to date. The blocks written since
+ *        the generation of the copy are copied, with the metadata areas; the blocks
+ *        released since then are released in the copy too.
+ * 
+ * @param dstPath The copy.
+ * 
+ * @return cloneReport What was copied.
+ */
+cloneReport ImageCloner::update(const char* dstPath)
+{
+    std::vector<uint32_t> generations = readGenerations();
+    std::vector<blockRun> copied, discarded;
+    uint32_t chunkBlocks = CLONE_CHUNK_BYTES / m_header->blockSize;
+
+    if (generations.empty())
+        throw std::runtime_error("the image keeps no block generations, take a snapshot before the first copy");
+
+    std::unique_ptr<struct afsHeader> dstHeader(BootLoad::load(dstPath));
+
+    if (!dstHeader)
+        throw std::runtime_error(std::string("disk file does not exist: ") + dstPath);
+
+    if (StripeSet::isStripeSet(dstPath))
+        throw std::runtime_error("a copy is a single image, not a striped volume");
+
+    if (dstHeader->blockSize != m_header->blockSize || dstHeader->nblocks != m_header->nblocks ||
+        dstHeader->generationsAddr != m_header->generationsAddr || dstHeader->generation > m_header->generation)
+        throw std::runtime_error(std::string(dstPath) + " is not a copy of this image");
+
+    // a block the live disk wrote in the generation of the copy may be newer than the copy
+    uint32_t since = dstHeader->generation;
+
+    for (uint32_t blockNum = 0; blockNum < m_header->nblocks; blockNum++)
+    {
+        uint32_t generation = generations[blockNum];
+
+        if (generation == GEN_UNTRACKED || (!(generation & GEN_FREE) && generation >= since))
+            addToRuns(copied, blockNum, chunkBlocks);
+
+        else if (generation & GEN_FREE && (generation & ~GEN_FREE) >= since)
+            addToRuns(discarded, blockNum, (uint32_t)-1);
+    }
+
+    return copyRuns(dstPath, 0, copied, discarded);
+}
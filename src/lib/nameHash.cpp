@@ -0,0 +1,121 @@
+#include <afs/nameHash.h>
+#include <afs/constants.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AFS_HAVE_X86_SIMD 1
+#endif
+
+constexpr uint32_t FNV_OFFSET = 2166136261u;
+constexpr uint32_t FNV_PRIME = 16777619u;
+
+enum SimdLevel
+{
+    SIMD_NONE,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+static SimdLevel getSimdLevel()
+{
+#ifdef AFS_HAVE_X86_SIMD
+    static const SimdLevel level = __builtin_cpu_supports("avx2") ? SIMD_AVX2 : __builtin_cpu_supports("sse2") ? SIMD_SSE2 : SIMD_NONE;
+    return level;
+#else
+    return SIMD_NONE;
+#endif
+}
+
+/**
+ * @brief Calculate the fingerprint of a name, as it is stored in an entry (up to NAME_MAX_LEN characters).
+ */
+uint8_t NameHash::fingerprint(const char* name)
+{
+    uint32_t hash = FNV_OFFSET;
+
+    for (int i = 0; i < NAME_MAX_LEN && name[i] != '\0'; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash ^ hash >> 8 ^ hash >> 16 ^ hash >> 24;
+}
+
+uint32_t NameHash::findScalar(const uint8_t* fingerprints, const uint32_t amount, const uint8_t fingerprint, uint32_t from)
+{
+    for (; from < amount; from++)
+    {
+        if (fingerprints[from] == fingerprint)
+            return from;
+    }
+
+    return amount;
+}
+
+#ifdef AFS_HAVE_X86_SIMD
+__attribute__((target("sse2")))
+uint32_t NameHash::findSse2(const uint8_t* fingerprints, const uint32_t amount, const uint8_t fingerprint, uint32_t from)
+{
+    __m128i needle = _mm_set1_epi8((char)fingerprint);
+
+    for (; from + 16 <= amount; from += 16)
+    {
+        uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(fingerprints + from)), needle));
+
+        if (mask != 0)
+            return from + __builtin_ctz(mask);
+    }
+
+    return findScalar(fingerprints, amount, fingerprint, from);
+}
+
+__attribute__((target("avx2")))
+uint32_t NameHash::findAvx2(const uint8_t* fingerprints, const uint32_t amount, const uint8_t fingerprint, uint32_t from)
+{
+    __m256i needle = _mm256_set1_epi8((char)fingerprint);
+
+    for (; from + 32 <= amount; from += 32)
+    {
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(fingerprints + from)), needle));
+
+        if (mask != 0)
+            return from + __builtin_ctz(mask);
+    }
+
+    return findSse2(fingerprints, amount, fingerprint, from);
+}
+#else
+uint32_t NameHash::findSse2(const uint8_t* fingerprints, const uint32_t amount, const uint8_t fingerprint, uint32_t from)
+{
+    return findScalar(fingerprints, amount, fingerprint, from);
+}
+
+uint32_t NameHash::findAvx2(const uint8_t* fingerprints, const uint32_t amount, const uint8_t fingerprint, uint32_t from)
+{
+    return findScalar(fingerprints, amount, fingerprint, from);
+}
+#endif
+
+/**
+ * @brief Find the next fingerprint that matches, with AVX2 or SSE2 when the CPU has them.
+ * 
+ * @param fingerprints The fingerprints of the entries of a directory block.
+ * @param amount The amount of fingerprints.
+ * @param fingerprint The fingerprint of the name that is looked up.
+ * @param from The index the search starts at.
+ * 
+ * @return uint32_t The index of the match, amount if there is none.
+ */
+uint32_t NameHash::find(const uint8_t* fingerprints, const uint32_t amount, const uint8_t fingerprint, const uint32_t from)
+{
+    switch (getSimdLevel())
+    {
+    case SIMD_AVX2:
+        return findAvx2(fingerprints, amount, fingerprint, from);
+    case SIMD_SSE2:
+        return findSse2(fingerprints, amount, fingerprint, from);
+    default:
+        return findScalar(fingerprints, amount, fingerprint, from);
+    }
+}
@@ -0,0 +1,76 @@
+#include <afs/readAhead.h>
+#include <afs/helper.h>
+
+#include <algorithm>
+
+ReadAhead::ReadAhead(Disk* disk):
+    m_disk(disk), m_maxWindow(std::max(READAHEAD_MIN_BLOCKS, READAHEAD_MAX_BYTES / disk->getBlockSize())),
+    m_window(0), m_run(0), m_nextBlock(0), m_prefetchedUntil(0)
+{
+}
+
+/**
+ * @brief note that a block of the file is read, and prefetch the blocks after
+ *        it when the reads are sequential and less than half the window is left ahead.
+ * 
+ * @param blockMap a block map of the file used only by the read-ahead (its cursor runs ahead of the reader).
+ * @param blockIndex the logical block that is read.
+ * @param fileBlocks the amount of logical blocks of the file.
+ */
+void ReadAhead::access(BlockMap& blockMap, const uint32_t blockIndex, const uint32_t fileBlocks)
+{
+    // a read that continues in the block the last one ended in is still sequential
+    if (blockIndex == m_nextBlock)
+        m_run++;
+
+    else if (blockIndex + 1 != m_nextBlock)
+    {
+        m_run = 0;
+        m_window = 0;
+        m_prefetchedUntil = blockIndex + 1;
+    }
+
+    m_nextBlock = blockIndex + 1;
+
+    if (m_run < READAHEAD_TRIGGER || m_prefetchedUntil > blockIndex + m_window / 2 + 1)
+        return;
+
+    uint32_t firstBlock = std::max(m_prefetchedUntil, blockIndex + 1);
+
+    m_window = m_window == 0 ? READAHEAD_MIN_BLOCKS : std::min(m_window * 2, m_maxWindow);
+    m_prefetchedUntil = std::min(fileBlocks, blockIndex + 1 + m_window);
+
+    if (firstBlock < m_prefetchedUntil)
+        prefetch(blockMap, firstBlock, m_prefetchedUntil - 1);
+}
+
+/**
+ * @brief prefetch the data blocks of a range of logical blocks, in one request
+ *        for every run of blocks that follow each other on the disk.
+ */
+void ReadAhead::prefetch(BlockMap& blockMap, const uint32_t firstBlock, const uint32_t lastBlock) const
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    address runStart = 0, runEnd = 0;
+
+    for (uint32_t blockIndex = firstBlock; blockIndex <= lastBlock; blockIndex++)
+    {
+        address dataAddr = blockMap.get(blockIndex);
+
+        if (dataAddr == 0)
+            continue;
+
+        if (dataAddr != runEnd)
+        {
+            if (runEnd != runStart)
+                m_disk->prefetch(runStart, runEnd - runStart);
+
+            runStart = dataAddr;
+        }
+
+        runEnd = dataAddr + blockSize;
+    }
+
+    if (runEnd != runStart)
+        m_disk->prefetch(runStart, runEnd - runStart);
+}
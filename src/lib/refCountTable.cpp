@@ -0,0 +1,148 @@
+#include <afs/refCountTable.h>
+#include <afs/dedupIndex.h>
+#include <afs/helper.h>
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+RefCountTable::RefCountTable(Disk* disk, const address tableAddr):
+    m_disk(disk), m_tableAddr(tableAddr), m_dedupIndex(nullptr)
+{
+}
+
+/**
+ * @brief Get the amount of blocks the table needs for a disk.
+ */
+uint32_t RefCountTable::getTableBlocksAmount(const Disk* disk)
+{
+    return (disk->getBlocksAmount() * sizeof(uint32_t) + disk->getBlockSize() - 1) / disk->getBlockSize();
+}
+
+uint32_t RefCountTable::getEntry(const unsigned int blockNum) const
+{
+    uint32_t entry;
+
+    m_disk->read(m_tableAddr + blockNum * sizeof(uint32_t), sizeof(uint32_t), (char*)&entry);
+
+    return entry;
+}
+
+void RefCountTable::setEntry(const unsigned int blockNum, const uint32_t entry)
+{
+    m_disk->write(m_tableAddr + blockNum * sizeof(uint32_t), sizeof(uint32_t), (const char*)&entry);
+}
+
+/**
+ * @brief Get the amount of owners of a block.
+ */
+uint32_t RefCountTable::getRefCount(const unsigned int blockNum) const
+{
+    uint32_t count = getEntry(blockNum) & REF_COUNT_MASK;
+
+    return count == 0 ? 1 : count;
+}
+
+bool RefCountTable::isIndexed(const unsigned int blockNum) const
+{
+    return getEntry(blockNum) & REF_INDEXED;
+}
+
+/**
+ * @brief add an owner to a block.
+ * 
+ * @param blockNum The number of the shared block.
+ */
+void RefCountTable::addRef(const unsigned int blockNum)
+{
+    uint32_t entry = getEntry(blockNum);
+    uint32_t count = entry & REF_COUNT_MASK;
+
+    if (count == REF_COUNT_MASK)
+        throw std::runtime_error("too many references to a block");
+
+    setEntry(blockNum, (entry & REF_INDEXED) | ((count == 0 ? 1 : count) + 1));
+}
+
+/**
+ * @brief add an owner to many blocks, the counters that share a block of the
+ *        table are updated with a single read and write.
+ * 
+ * @param blocks The numbers of the blocks (a block may appear more than once).
+ */
+void RefCountTable::addRefs(std::vector<unsigned int> blocks)
+{
+    uint32_t entriesPerBlock = m_disk->getBlockSize() / sizeof(uint32_t);
+    std::vector<uint32_t> entries(entriesPerBlock);
+
+    std::sort(blocks.begin(), blocks.end());
+
+    for (size_t first = 0; first < blocks.size();)
+    {
+        unsigned int tableBlock = blocks[first] / entriesPerBlock;
+        address entriesAddr = m_tableAddr + tableBlock * m_disk->getBlockSize();
+        size_t last = first;
+
+        while (last + 1 < blocks.size() && blocks[last + 1] / entriesPerBlock == tableBlock)
+            last++;
+
+        m_disk->read(entriesAddr, m_disk->getBlockSize(), (char*)entries.data());
+
+        for (size_t i = first; i <= last; i++)
+        {
+            uint32_t& entry = entries[blocks[i] % entriesPerBlock];
+            uint32_t count = entry & REF_COUNT_MASK;
+
+            if (count == REF_COUNT_MASK)
+                throw std::runtime_error("too many references to a block");
+
+            entry = (entry & REF_INDEXED) | ((count == 0 ? 1 : count) + 1);
+        }
+
+        m_disk->write(entriesAddr, m_disk->getBlockSize(), (const char*)entries.data());
+        first = last + 1;
+    }
+}
+
+/**
+ * @brief mark a block as registered in the dedup index.
+ */
+void RefCountTable::setIndexed(const unsigned int blockNum)
+{
+    setEntry(blockNum, getEntry(blockNum) | REF_INDEXED);
+}
+
+/**
+ * @brief remove an owner from a block, the block is removed from the dedup index
+ *        when its last owner releases it.
+ * 
+ * @param blockNum The number of the block.
+ * 
+ * @return bool true if the block still has owners, false if it can be freed.
+ */
+bool RefCountTable::release(const unsigned int blockNum)
+{
+    uint32_t entry = getEntry(blockNum);
+    uint32_t count = entry & REF_COUNT_MASK;
+
+    if (count > 1)
+    {
+        setEntry(blockNum, (entry & REF_INDEXED) | (count - 1));
+        return true;
+    }
+
+    if (entry & REF_INDEXED && m_dedupIndex)
+    {
+        uint32_t blockSize = m_disk->getBlockSize();
+        std::vector<char> data(blockSize);
+        address blockAddr = Helper::blockToAddr(blockSize, blockNum);
+
+        m_disk->read(blockAddr, blockSize, data.data());
+        m_dedupIndex->remove(DedupIndex::fingerprint(data.data(), blockSize), blockAddr);
+    }
+
+    if (entry != 0)
+        setEntry(blockNum, 0);
+
+    return false;
+}
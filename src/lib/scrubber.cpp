@@ -0,0 +1,88 @@
+#include <afs/scrubber.h>
+
+#include <algorithm>
+#include <chrono>
+
+Scrubber::Scrubber(Disk* disk, const uint64_t bytesPerSecond):
+    m_disk(disk), m_bytesPerSecond(bytesPerSecond), m_running(false), m_status{0, 0, {}}
+{
+}
+
+Scrubber::~Scrubber()
+{
+    stop();
+}
+
+void Scrubber::start()
+{
+    if (m_running.exchange(true))
+        return;
+
+    m_thread = std::thread(&Scrubber::run, this);
+}
+
+void Scrubber::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_running = false;
+    }
+
+    m_stopped.notify_all();
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+scrubStatus Scrubber::getStatus() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    return m_status;
+}
+
+/**
+ * @brief verify the blocks of the disk in passes, sleeping between blocks so the
+ *        amount of bytes read stays within the budget.
+ */
+void Scrubber::run()
+{
+    auto budgetStart = std::chrono::steady_clock::now();
+    uint64_t bytesRead = 0;
+
+    while (m_running)
+    {
+        for (uint32_t blockNum = 0; blockNum < m_disk->getBlocksAmount() && m_running; blockNum++)
+        {
+            // the next blocks are read in the background while these are verified
+            if (blockNum % SCRUB_PREFETCH_BLOCKS == 0)
+                m_disk->prefetch((unsigned long)(blockNum + SCRUB_PREFETCH_BLOCKS) * m_disk->getBlockSize(),
+                                 (unsigned long)SCRUB_PREFETCH_BLOCKS * m_disk->getBlockSize());
+
+            bool valid = m_disk->verifyBlock(blockNum);
+            bytesRead += m_disk->getBlockSize();
+
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_status.blocksChecked++;
+
+                auto badBlock = std::find(m_status.badBlocks.begin(), m_status.badBlocks.end(), blockNum);
+
+                if (!valid && badBlock == m_status.badBlocks.end())
+                    m_status.badBlocks.push_back(blockNum);
+                else if (valid && badBlock != m_status.badBlocks.end())
+                    m_status.badBlocks.erase(badBlock);
+
+                if (m_bytesPerSecond != 0)
+                {
+                    auto due = budgetStart + std::chrono::microseconds(bytesRead * 1000000 / m_bytesPerSecond);
+                    m_stopped.wait_until(lock, due, [this] { return !m_running; });
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_running)
+            m_status.passes++;
+    }
+}
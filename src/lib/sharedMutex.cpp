@@ -0,0 +1,27 @@
+#include <afs/sharedMutex.h>
+
+void SharedMutex::lock()
+{
+    std::lock_guard<std::mutex> turn(m_writerTurn);
+
+    m_lock.lock();
+}
+
+void SharedMutex::unlock()
+{
+    m_lock.unlock();
+}
+
+void SharedMutex::lock_shared()
+{
+    {
+        std::lock_guard<std::mutex> turn(m_writerTurn);
+    }
+
+    m_lock.lock_shared();
+}
+
+void SharedMutex::unlock_shared()
+{
+    m_lock.unlock_shared();
+}
@@ -0,0 +1,561 @@
+#include <afs/snapshotTable.h>
+#include <afs/refCountTable.h>
+#include <afs/dedupIndex.h>
+#include <afs/helper.h>
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <cstring>
+#include <ctime>
+
+SnapshotTable::SnapshotTable(Disk* disk, BlocksTable* dblocksTable, struct afsHeader* header):
+    m_disk(disk), m_dblocksTable(dblocksTable), m_header(header)
+{
+    size_t slots = m_disk->getBlockSize() / sizeof(snapshotRecord);
+
+    m_records.resize(slots);
+    m_exceptions.resize(slots);
+    m_chainTails.resize(slots, 0);
+    m_openViews.resize(slots, 0);
+
+    m_disk->read(m_header->snapshotsAddr, slots * sizeof(snapshotRecord), (char*)m_records.data());
+
+    for (size_t slot = 0; slot < slots; slot++)
+    {
+        if (m_records[slot].generation != 0)
+            loadExceptions(slot);
+    }
+
+    sortSlots();
+}
+
+/**
+ * @brief Get the amount of blocks the generation table needs for a disk.
+ */
+uint32_t SnapshotTable::getGenerationBlocksAmount(const Disk* disk)
+{
+    return (disk->getBlocksAmount() * sizeof(uint32_t) + disk->getBlockSize() - 1) / disk->getBlockSize();
+}
+
+uint32_t SnapshotTable::getEntriesPerBlock() const
+{
+    return (m_disk->getBlockSize() - sizeof(address)) / sizeof(exceptionEntry);
+}
+
+uint32_t SnapshotTable::getGeneration(const unsigned int blockNum) const
+{
+    return ((const uint32_t*)m_disk->view(m_header->generationsAddr))[blockNum];
+}
+
+void SnapshotTable::setGeneration(const unsigned int blockNum, const uint32_t generation)
+{
+    m_disk->write(m_header->generationsAddr + blockNum * sizeof(uint32_t), sizeof(uint32_t), (const char*)&generation);
+}
+
+/**
+ * @brief start the generation table of a disk that had no snapshots, the blocks in
+ *        use get the generation before the first snapshot and the metadata areas
+ *        are never copied out.
+ */
+void SnapshotTable::formatGenerations()
+{
+    uint32_t blockSize = m_disk->getBlockSize(), nblocks = m_disk->getBlocksAmount();
+    std::vector<uint32_t> generations(nblocks);
+
+    for (unsigned int blockNum = 0; blockNum < nblocks; blockNum++)
+        generations[blockNum] = m_dblocksTable->isReserved(blockNum) ? 0 : GEN_FREE;
+
+    m_disk->write(m_header->generationsAddr, nblocks * sizeof(uint32_t), (const char*)generations.data());
+
+    m_header->generation = 1;
+    m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+
+    setUntracked(0, 1);
+    setUntracked(Helper::blockToAddr(blockSize, DBLOCKS_TABLE_BLOCK_INDX), m_dblocksTable->getTableBlocksAmount());
+    setUntracked(m_header->summaryAddr, m_dblocksTable->getSummaryBlocksAmount());
+    setUntracked(m_header->checksumAddr, Disk::getChecksumBlocksAmount(blockSize, nblocks));
+    setUntracked(m_header->generationsAddr, getGenerationBlocksAmount(m_disk));
+    setUntracked(m_header->snapshotsAddr, 1);
+
+    if (m_header->refTableAddr != 0)
+        setUntracked(m_header->refTableAddr, RefCountTable::getTableBlocksAmount(m_disk));
+
+    if (m_header->dedupIndexAddr != 0)
+        setUntracked(m_header->dedupIndexAddr, DedupIndex::getIndexBlocksAmount(m_disk));
+}
+
+/**
+ * @brief never copy out the blocks of a metadata area, snapshots do not read them.
+ *
+ * @param firstAddr The address of the area.
+ * @param blocksAmount The amount of blocks in the area.
+ */
+void SnapshotTable::setUntracked(const address firstAddr, const uint32_t blocksAmount)
+{
+    std::vector<uint32_t> generations(blocksAmount, GEN_UNTRACKED);
+    unsigned int firstBlock = Helper::addrToBlock(m_disk->getBlockSize(), firstAddr);
+
+    m_disk->write(m_header->generationsAddr + firstBlock * sizeof(uint32_t), blocksAmount * sizeof(uint32_t), (const char*)generations.data());
+}
+
+void SnapshotTable::writeRecord(const size_t slot)
+{
+    m_disk->write(m_header->snapshotsAddr + slot * sizeof(snapshotRecord), sizeof(snapshotRecord), (const char*)&m_records[slot]);
+}
+
+/**
+ * @brief read the exceptions chain of a snapshot into memory.
+ */
+void SnapshotTable::loadExceptions(const size_t slot)
+{
+    uint32_t entriesPerBlock = getEntriesPerBlock(), left = m_records[slot].exceptionsAmount, hops = 0;
+    std::vector<exceptionEntry> entries(entriesPerBlock);
+    address chainAddr = m_records[slot].exceptionsAddr;
+
+    while (chainAddr != 0)
+    {
+        if (hops++ > m_disk->getBlocksAmount())
+            throw std::runtime_error("block chain has a loop");
+
+        uint32_t amount = std::min(left, entriesPerBlock);
+
+        m_disk->read(chainAddr, entriesPerBlock * sizeof(exceptionEntry), (char*)entries.data());
+
+        for (uint32_t i = 0; i < amount; i++)
+        {
+            if (entries[i].blockNum != EXCEPTION_PROCESSED)
+                m_exceptions[slot][entries[i].blockNum] = entries[i].copyAddr;
+        }
+
+        left -= amount;
+        m_chainTails[slot] = chainAddr;
+        chainAddr = Helper::getNextBlock(m_disk, chainAddr);
+    }
+}
+
+void SnapshotTable::sortSlots()
+{
+    m_order.clear();
+
+    for (size_t slot = 0; slot < m_records.size(); slot++)
+    {
+        if (m_records[slot].generation != 0)
+            m_order.push_back(slot);
+    }
+
+    std::sort(m_order.begin(), m_order.end(),
+              [this](size_t a, size_t b) { return m_records[a].generation < m_records[b].generation; });
+}
+
+/**
+ * @brief Get the slot of the newest snapshot that was not deleted, -1 if there is none.
+ */
+int SnapshotTable::getNewestLive() const
+{
+    for (auto it = m_order.rbegin(); it != m_order.rend(); it++)
+    {
+        if (!(m_records[*it].flags & SNAPSHOT_DELETED))
+            return *it;
+    }
+
+    return -1;
+}
+
+int SnapshotTable::findSlot(const std::string& name) const
+{
+    for (size_t slot : m_order)
+    {
+        if (!(m_records[slot].flags & SNAPSHOT_DELETED) && name == std::string(m_records[slot].name, strnlen(m_records[slot].name, NAME_MAX_LEN)))
+            return slot;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief reserve a block for the snapshots. A free block whose content a snapshot
+ *        still reads is not overwritten, it is kept as it is and recorded as the
+ *        exception of itself once the current exception is written.
+ *
+ * @return unsigned int The number of the block.
+ */
+unsigned int SnapshotTable::allocateBlock()
+{
+    while (true)
+    {
+        unsigned int blockNum = m_dblocksTable->getFreeBlock();
+        bool kept = needsCopy(blockNum);
+
+        m_dblocksTable->reserveDBlock(blockNum);
+        setGeneration(blockNum, GEN_UNTRACKED);
+
+        if (!kept)
+            return blockNum;
+
+        m_keptBlocks.push_back(blockNum);
+    }
+}
+
+/**
+ * @brief record the blocks allocateBlock kept for the newest snapshot.
+ */
+void SnapshotTable::flushKeptBlocks()
+{
+    while (!m_keptBlocks.empty())
+    {
+        unsigned int blockNum = m_keptBlocks.back();
+        int slot = getNewestLive();
+
+        m_keptBlocks.pop_back();
+
+        if (slot == -1)
+            m_dblocksTable->freeDBlock(blockNum);
+        else
+            addException(slot, blockNum, Helper::blockToAddr(m_disk->getBlockSize(), blockNum));
+    }
+}
+
+/**
+ * @brief check whether a snapshot still reads the content of a block from its place.
+ */
+bool SnapshotTable::needsCopy(const unsigned int blockNum) const
+{
+    uint32_t generation = getGeneration(blockNum);
+    int slot = getNewestLive();
+
+    return generation != GEN_UNTRACKED && !(generation & GEN_FREE) && slot != -1 && generation <= m_records[slot].generation;
+}
+
+/**
+ * @brief append an exception to the chain of a snapshot.
+ *
+ * @param slot The slot of the snapshot.
+ * @param blockNum The block the exception replaces.
+ * @param copyAddr The address of the content the snapshot reads instead.
+ */
+void SnapshotTable::addException(const size_t slot, const unsigned int blockNum, const address copyAddr)
+{
+    snapshotRecord& record = m_records[slot];
+    uint32_t blockSize = m_disk->getBlockSize(), entriesPerBlock = getEntriesPerBlock();
+    exceptionEntry entry = { blockNum, copyAddr };
+
+    if (record.exceptionsAmount % entriesPerBlock == 0)
+    {
+        address chainAddr = Helper::blockToAddr(blockSize, allocateBlock());
+        std::vector<char> reset(blockSize, 0);
+
+        m_disk->write(chainAddr, blockSize, reset.data());
+
+        if (record.exceptionsAddr == 0)
+            record.exceptionsAddr = chainAddr;
+        else
+            m_disk->write(m_chainTails[slot] + blockSize - sizeof(address), sizeof(address), (const char*)&chainAddr);
+
+        m_chainTails[slot] = chainAddr;
+    }
+
+    m_disk->write(m_chainTails[slot] + (record.exceptionsAmount % entriesPerBlock) * sizeof(exceptionEntry),
+                  sizeof(exceptionEntry), (const char*)&entry);
+
+    record.exceptionsAmount++;
+    writeRecord(slot);
+    m_exceptions[slot][blockNum] = copyAddr;
+}
+
+/**
+ * @brief save the content of a block for a snapshot before it is overwritten.
+ */
+void SnapshotTable::copyOut(const unsigned int blockNum, const size_t slot)
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+    address copyAddr = Helper::blockToAddr(blockSize, allocateBlock());
+    std::vector<char> content(blockSize);
+
+    m_disk->read(Helper::blockToAddr(blockSize, blockNum), blockSize, content.data());
+    m_disk->write(copyAddr, blockSize, content.data());
+
+    addException(slot, blockNum, copyAddr);
+    flushKeptBlocks();
+}
+
+/**
+ * @brief take a snapshot of the disk, only a new generation is started.
+ *
+ * @param name The name of the snapshot.
+ */
+void SnapshotTable::create(const std::string& name)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_lock);
+    size_t slot = 0;
+
+    if (name.empty() || name.size() >= NAME_MAX_LEN)
+        throw std::runtime_error("invalid snapshot name");
+
+    if (findSlot(name) != -1)
+        throw std::runtime_error("a snapshot with this name already exists");
+
+    while (slot < m_records.size() && m_records[slot].generation != 0)
+        slot++;
+
+    if (slot == m_records.size())
+        throw std::runtime_error("no room for more snapshots");
+
+    snapshotRecord& record = m_records[slot];
+
+    memset(&record, 0, sizeof(snapshotRecord));
+    strncpy(record.name, name.c_str(), NAME_MAX_LEN);
+    record.generation = m_header->generation;
+    record.createdAt = time(nullptr);
+    record.header = *m_header;
+
+    // the live disk moves to the next generation before the snapshot exists, so a
+    // crash in between can not leave a snapshot without copy outs
+    m_header->generation++;
+    m_disk->write(0, sizeof(struct afsHeader), (const char*)m_header);
+    writeRecord(slot);
+
+    m_exceptions[slot].clear();
+    m_chainTails[slot] = 0;
+    sortSlots();
+}
+
+/**
+ * @brief delete a snapshot, its blocks are reclaimed later by reclaimStep.
+ *
+ * @param name The name of the snapshot.
+ */
+void SnapshotTable::remove(const std::string& name)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_lock);
+    int slot = findSlot(name);
+
+    if (slot == -1)
+        throw std::runtime_error("no snapshot named " + name);
+
+    if (m_openViews[slot] != 0)
+        throw std::runtime_error("snapshot " + name + " is open");
+
+    m_records[slot].flags |= SNAPSHOT_DELETED;
+    writeRecord(slot);
+}
+
+std::vector<snapshotInfo> SnapshotTable::list() const
+{
+    std::lock_guard<std::recursive_mutex> lock(m_lock);
+    std::vector<snapshotInfo> snapshots;
+
+    for (size_t slot : m_order)
+    {
+        const snapshotRecord& record = m_records[slot];
+
+        snapshots.push_back({ std::string(record.name, strnlen(record.name, NAME_MAX_LEN)), record.generation,
+                              record.createdAt, (uint32_t)m_exceptions[slot].size(), (bool)(record.flags & SNAPSHOT_DELETED) });
+    }
+
+    return snapshots;
+}
+
+/**
+ * @brief start reading a snapshot, it can not be deleted until the view is closed.
+ *
+ * @param name The name of the snapshot.
+ * @param header Set to the header of the disk when the snapshot was taken.
+ *
+ * @return size_t The slot of the snapshot.
+ */
+size_t SnapshotTable::openView(const std::string& name, struct afsHeader& header)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_lock);
+    int slot = findSlot(name);
+
+    if (slot == -1)
+        throw std::runtime_error("no snapshot named " + name);
+
+    m_openViews[slot]++;
+    header = m_records[slot].header;
+
+    return slot;
+}
+
+void SnapshotTable::closeView(const size_t slot)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_lock);
+
+    m_openViews[slot]--;
+}
+
+/**
+ * @brief Get the block that holds the content a snapshot has for a block.
+ *
+ * @param slot The slot of the snapshot.
+ * @param blockNum The number of the block.
+ */
+unsigned int SnapshotTable::translate(const size_t slot, const unsigned int blockNum) const
+{
+    auto first = std::find(m_order.begin(), m_order.end(), slot);
+
+    for (auto it = first; it != m_order.end(); it++)
+    {
+        auto exception = m_exceptions[*it].find(blockNum);
+
+        if (exception != m_exceptions[*it].end())
+            return Helper::addrToBlock(m_disk->getBlockSize(), exception->second);
+    }
+
+    return blockNum;
+}
+
+/**
+ * @brief called before every write to the disk: the blocks a snapshot still reads
+ *        in place are copied out, and the blocks move to the live generation.
+ *
+ * @param addr The address of the write.
+ * @param size The size of the write.
+ */
+void SnapshotTable::beforeWrite(const unsigned long addr, const int size)
+{
+    uint32_t blockSize = m_disk->getBlockSize();
+
+    if (size <= 0)
+        return;
+
+    for (unsigned int blockNum = addr / blockSize; blockNum <= (addr + size - 1) / blockSize; blockNum++)
+    {
+        uint32_t generation = getGeneration(blockNum);
+
+        if (generation == GEN_UNTRACKED || generation == m_header->generation)
+            continue;
+
+        if (needsCopy(blockNum))
+            copyOut(blockNum, getNewestLive());
+
+        setGeneration(blockNum, m_header->generation);
+    }
+}
+
+/**
+ * @brief called when a block is released, a block no snapshot reads is marked
+ *        free so it is not copied out when it is used again.
+ * 
+ * @return bool true if a snapshot still reads the content of the block.
+ */
+bool SnapshotTable::blockFreed(const unsigned int blockNum)
+{
+    uint32_t generation = getGeneration(blockNum);
+
+    if (generation != GEN_UNTRACKED && (generation & GEN_FREE))
+        return false;
+
+    if (generation != GEN_UNTRACKED && needsCopy(blockNum))
+        return true;
+
+    setGeneration(blockNum, m_header->generation | GEN_FREE);
+    return false;
+}
+
+bool SnapshotTable::hasDeleted() const
+{
+    std::lock_guard<std::recursive_mutex> lock(m_lock);
+
+    for (size_t slot : m_order)
+    {
+        if (m_records[slot].flags & SNAPSHOT_DELETED)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief reclaim a block of exceptions of the oldest deleted snapshot.
+ *
+ * An exception is handed to the next older snapshot when it would read it,
+ * otherwise its block is freed. Every exception is marked as processed before its
+ * block is freed, so a crash can leak blocks (found by afs-fsck) but never free
+ * them twice. The record is cleared once the chain is empty.
+ */
+void SnapshotTable::reclaimStep()
+{
+    std::lock_guard<std::recursive_mutex> lock(m_lock);
+    uint32_t blockSize = m_disk->getBlockSize(), entriesPerBlock = getEntriesPerBlock();
+    auto deleted = std::find_if(m_order.begin(), m_order.end(),
+                                [this](size_t slot) { return m_records[slot].flags & SNAPSHOT_DELETED; });
+
+    if (deleted == m_order.end())
+        return;
+
+    size_t slot = *deleted;
+    snapshotRecord& record = m_records[slot];
+    auto older = std::find_if(std::make_reverse_iterator(deleted), m_order.rend(),
+                              [this](size_t olderSlot) { return !(m_records[olderSlot].flags & SNAPSHOT_DELETED); });
+
+    if (record.exceptionsAddr == 0)
+    {
+        memset(&record, 0, sizeof(snapshotRecord));
+        writeRecord(slot);
+        m_exceptions[slot].clear();
+        m_chainTails[slot] = 0;
+        sortSlots();
+        return;
+    }
+
+    std::vector<exceptionEntry> entries(entriesPerBlock);
+    uint32_t amount = std::min(record.exceptionsAmount, entriesPerBlock);
+    address chainAddr = record.exceptionsAddr;
+
+    m_disk->read(chainAddr, entriesPerBlock * sizeof(exceptionEntry), (char*)entries.data());
+
+    for (uint32_t i = 0; i < amount; i++)
+    {
+        exceptionEntry entry = entries[i];
+        unsigned int copyBlock = Helper::addrToBlock(blockSize, entry.copyAddr);
+        bool keep = false;
+
+        if (entry.blockNum == EXCEPTION_PROCESSED)
+            continue;
+
+        // the older snapshot reads the first exception in itself or a newer snapshot
+        if (older != m_order.rend())
+        {
+            auto it = std::find(m_order.begin(), m_order.end(), *older);
+            bool found = false;
+
+            for (; *it != slot; it++)
+            {
+                auto exception = m_exceptions[*it].find(entry.blockNum);
+
+                if (exception != m_exceptions[*it].end())
+                {
+                    found = true;
+                    keep = exception->second == entry.copyAddr; // handed over before a crash
+                    break;
+                }
+            }
+
+            if (!found)
+            {
+                addException(*older, entry.blockNum, entry.copyAddr);
+                keep = true;
+            }
+        }
+
+        entries[i].blockNum = EXCEPTION_PROCESSED;
+        m_disk->write(chainAddr + i * sizeof(exceptionEntry), sizeof(uint32_t), (const char*)&entries[i].blockNum);
+        m_exceptions[slot].erase(entry.blockNum);
+
+        if (!keep && getGeneration(copyBlock) == GEN_UNTRACKED && m_dblocksTable->isReserved(copyBlock))
+            m_dblocksTable->freeDBlock(copyBlock);
+    }
+
+    // the record points past the block before it is freed
+    record.exceptionsAddr = Helper::getNextBlock(m_disk, chainAddr);
+    record.exceptionsAmount -= amount;
+    if (record.exceptionsAddr == 0)
+        m_chainTails[slot] = 0;
+
+    writeRecord(slot);
+    m_dblocksTable->freeDBlock(Helper::addrToBlock(blockSize, chainAddr));
+    flushKeptBlocks();
+}
@@ -0,0 +1,243 @@
+#include <afs/stripeSet.h>
+#include <afs/helper.h>
+
+#include <stdexcept>
+#include <system_error>
+#include <random>
+#include <algorithm>
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+/**
+ * @brief open a member of a volume, read-only or for reading and writing.
+ */
+static int openMember(const char* filePath, const bool readOnly)
+{
+    if (!readOnly)
+        return Helper::openExistingFile(filePath);
+
+    int fd = open(filePath, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+        throw std::system_error(errno, std::generic_category(), filePath);
+
+    return fd;
+}
+
+/**
+ * @brief open all the members of a volume.
+ * 
+ * @param filePath The path of any of the members.
+ * @param readOnly Whether the members are only read.
+ */
+StripeSet::StripeSet(const char* filePath, const bool readOnly)
+{
+    int fd = openMember(filePath, readOnly);
+
+    if (pread(fd, &m_header, sizeof(m_header), 0) != sizeof(m_header) ||
+        strncmp(m_header.magic, STRIPE_MAGIC, sizeof(m_header.magic)) != 0 || m_header.version != STRIPE_VERSION)
+    {
+        close(fd);
+        throw std::runtime_error(std::string("not a member of a striped volume: ") + filePath);
+    }
+
+    close(fd);
+
+    for (uint8_t i = 0; i < m_header.members; i++)
+    {
+        struct stripeHeader member;
+
+        m_fds.push_back(openMember(m_header.paths[i], readOnly));
+
+        if (pread(m_fds.back(), &member, sizeof(member), 0) != sizeof(member) || member.volumeId != m_header.volumeId || member.index != i)
+        {
+            for (int memberFd : m_fds)
+                close(memberFd);
+
+            throw std::runtime_error(std::string("member of another volume: ") + m_header.paths[i]);
+        }
+    }
+}
+
+StripeSet::~StripeSet()
+{
+    for (int fd : m_fds)
+        close(fd);
+}
+
+/**
+ * @brief whether a file is a member of a striped volume.
+ */
+bool StripeSet::isStripeSet(const char* filePath)
+{
+    char magic[sizeof(STRIPE_MAGIC)] = {};
+    int fd = open(filePath, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+        return false;
+
+    ssize_t res = pread(fd, magic, sizeof(magic), 0);
+    close(fd);
+
+    return res == sizeof(magic) && memcmp(magic, STRIPE_MAGIC, sizeof(magic)) == 0;
+}
+
+uint64_t StripeSet::getMemberSize(const uint32_t stripeUnit, const uint64_t volumeSize, const size_t members)
+{
+    uint64_t units = (volumeSize + stripeUnit - 1) / stripeUnit;
+
+    return STRIPE_HEADER_SIZE + (units + members - 1) / members * stripeUnit;
+}
+
+/**
+ * @brief create the members of a new volume, they are sparse files until the volume is written.
+ * 
+ * @param paths The members, none of them may exist.
+ * @param stripeUnit Bytes of the volume on a member before the next one, a multiple of the page size.
+ * @param volumeSize The size of the volume.
+ */
+void StripeSet::create(const std::vector<std::string>& paths, const uint32_t stripeUnit, const uint64_t volumeSize)
+{
+    struct stripeHeader header;
+
+    if (paths.empty() || paths.size() > STRIPE_MAX_MEMBERS)
+        throw std::runtime_error("a striped volume has 1 to " + std::to_string(STRIPE_MAX_MEMBERS) + " members");
+
+    if (stripeUnit == 0 || stripeUnit % sysconf(_SC_PAGESIZE) != 0)
+        throw std::runtime_error("the stripe unit must be a multiple of the page size");
+
+    if ((volumeSize + stripeUnit - 1) / stripeUnit > STRIPE_MAX_UNITS)
+        throw std::runtime_error("the stripe unit is too small for the volume, use at least " +
+                                 std::to_string((volumeSize + STRIPE_MAX_UNITS - 1) / STRIPE_MAX_UNITS) + " bytes");
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STRIPE_MAGIC, sizeof(header.magic));
+    header.version = STRIPE_VERSION;
+    header.members = paths.size();
+    header.stripeUnit = stripeUnit;
+    header.volumeSize = volumeSize;
+    header.volumeId = std::random_device()() | (uint64_t)std::random_device()() << 32;
+
+    std::vector<int> fds;
+
+    for (const std::string& path : paths)
+    {
+        int fd = open(path.c_str(), O_CREAT | O_RDWR | O_EXCL | O_CLOEXEC, 0664);
+
+        if (fd == -1)
+        {
+            int error = errno;
+
+            for (int memberFd : fds)
+                close(memberFd);
+
+            throw std::system_error(error, std::generic_category(), path);
+        }
+
+        fds.push_back(fd);
+
+        // the members are found again by their paths, which must not depend on the working directory
+        char* fullPath = realpath(path.c_str(), nullptr);
+
+        if (fullPath && strlen(fullPath) < STRIPE_PATH_LEN)
+            strcpy(header.paths[fds.size() - 1], fullPath);
+        free(fullPath);
+    }
+
+    bool written = true;
+
+    for (size_t i = 0; i < fds.size(); i++)
+    {
+        header.index = i;
+
+        written = written && header.paths[i][0] != '\0' && pwrite(fds[i], &header, sizeof(header), 0) == sizeof(header) &&
+                  ftruncate(fds[i], getMemberSize(stripeUnit, volumeSize, fds.size())) == 0;
+
+        close(fds[i]);
+    }
+
+    if (!written)
+        throw std::runtime_error("could not create the members of the striped volume");
+}
+
+/**
+ * @brief find where a byte of the volume is kept.
+ * 
+ * @param addr The address on the volume.
+ * @param fd Set to the member that keeps it.
+ * @param offset Set to the offset in the member.
+ * @param length Set to the bytes from the address to the end of its stripe unit.
+ */
+void StripeSet::locate(const uint64_t addr, int& fd, uint64_t& offset, uint64_t& length) const
+{
+    uint64_t unit = addr / m_header.stripeUnit, unitOffset = addr % m_header.stripeUnit;
+
+    fd = m_fds[unit % m_fds.size()];
+    offset = STRIPE_HEADER_SIZE + unit / m_fds.size() * m_header.stripeUnit + unitOffset;
+    length = m_header.stripeUnit - unitOffset;
+}
+
+/**
+ * @brief map the start of the volume, every stripe unit over its member.
+ * 
+ * @param size The bytes to map.
+ * @param readOnly Whether the mapping can only be read.
+ * 
+ * @return unsigned char* The mapping, unmapped with munmap as a whole.
+ */
+unsigned char* StripeSet::map(const uint64_t size, const bool readOnly) const
+{
+    if (size > m_header.volumeSize)
+        throw std::runtime_error("the disk is bigger than its striped volume");
+
+    // the range is reserved first, so the units land next to each other
+    unsigned char* base = (unsigned char*)mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (base == MAP_FAILED)
+        throw std::system_error(errno, std::generic_category(), "mmap");
+
+    for (uint64_t addr = 0; addr < size; addr += m_header.stripeUnit)
+    {
+        int fd;
+        uint64_t offset, length;
+
+        locate(addr, fd, offset, length);
+
+        if (mmap(base + addr, std::min(length, size - addr), readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset) == MAP_FAILED)
+        {
+            int error = errno;
+
+            munmap(base, size);
+            throw std::system_error(error, std::generic_category(), "mmap of a stripe");
+        }
+    }
+
+    return base;
+}
+
+/**
+ * @brief read a range of the volume without mapping it.
+ */
+void StripeSet::read(uint64_t addr, uint64_t size, char* data) const
+{
+    while (size > 0)
+    {
+        int fd;
+        uint64_t offset, length;
+
+        locate(addr, fd, offset, length);
+        length = std::min(length, size);
+
+        if (pread(fd, data, length, offset) != (ssize_t)length)
+            throw std::runtime_error("could not read the striped volume");
+
+        addr += length;
+        data += length;
+        size -= length;
+    }
+}
@@ -0,0 +1,150 @@
+#include <afs/threadPool.h>
+
+static thread_local const ThreadPool* t_pool = nullptr;
+static thread_local unsigned int t_queueIndex = 0;
+
+/**
+ * @brief start the workers of the pool.
+ * 
+ * @param threads The amount of workers, 0 for one per hardware thread.
+ */
+ThreadPool::ThreadPool(unsigned int threads):
+    m_queued(0), m_pending(0), m_nextQueue(0), m_stopping(false)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < threads; i++)
+        m_queues.emplace_back(new workerQueue);
+
+    for (unsigned int i = 0; i < threads; i++)
+        m_threads.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stopping = true;
+    }
+
+    m_taskAdded.notify_all();
+
+    for (std::thread& thread : m_threads)
+        thread.join();
+}
+
+/**
+ * @brief queue a task to run on one of the workers.
+ */
+void ThreadPool::submit(std::function<void()> task)
+{
+    unsigned int index = t_pool == this ? t_queueIndex : m_nextQueue++ % m_queues.size();
+
+    m_pending++;
+
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->lock);
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_queued++;
+    }
+
+    m_taskAdded.notify_one();
+}
+
+/**
+ * @brief wait until all the submitted tasks, and the tasks they submitted, are done.
+ *        The first exception a task threw is rethrown here.
+ */
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_allDone.wait(lock, [this] { return m_pending == 0; });
+
+    if (m_error)
+    {
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+/**
+ * @brief take the newest task of a worker, or steal the oldest task of another worker.
+ */
+bool ThreadPool::popTask(const unsigned int index, std::function<void()>& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->lock);
+
+        if (!m_queues[index]->tasks.empty())
+        {
+            task = std::move(m_queues[index]->tasks.back());
+            m_queues[index]->tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (unsigned int i = 1; i < m_queues.size(); i++)
+    {
+        workerQueue& victim = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim.lock);
+
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::run(const unsigned int index)
+{
+    t_pool = this;
+    t_queueIndex = index;
+
+    while (true)
+    {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_taskAdded.wait(lock, [this] { return m_queued > 0 || m_stopping; });
+
+            if (m_queued == 0 && m_stopping)
+                return;
+        }
+
+        if (!popTask(index, task))
+            continue;
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_queued--;
+        }
+
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_error)
+                m_error = std::current_exception();
+        }
+
+        if (--m_pending == 0)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_allDone.notify_all();
+        }
+    }
+}
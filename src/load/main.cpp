@@ -0,0 +1,209 @@
+#include <afsd/client.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+
+typedef struct loadOptions
+{
+    std::string socketPath;
+    std::string operation;
+    unsigned int clients;
+    unsigned int depth;      // requests each client keeps in flight
+    unsigned int requests;   // requests each client sends
+    uint32_t size;           // bytes an append writes or a read returns
+} loadOptions;
+
+typedef struct clientResult
+{
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t bytes;
+    std::vector<uint32_t> latencies; // microseconds of a sample of the requests
+} clientResult;
+
+static void usage(const char* program)
+{
+    std::cerr << "usage: " << program << " [-c clients] [-d depth] [-n requests] [-b bytes] [-o ping|append|read|stat] <socket>" << std::endl
+              << "  -c  concurrent connections (default: 4)" << std::endl
+              << "  -d  requests in flight on each connection (default: 16)" << std::endl
+              << "  -n  requests of each connection (default: 100000)" << std::endl
+              << "  -b  bytes an append writes or a read returns (default: 4096)" << std::endl
+              << "  -o  operation to send (default: ping)" << std::endl;
+}
+
+static std::string buildRequest(const loadOptions& options, const std::string& path, uint8_t& opcode)
+{
+    if (options.operation == "ping")
+    {
+        opcode = OP_PING;
+        return "";
+    }
+
+    if (options.operation == "append")
+    {
+        opcode = OP_APPEND;
+        return MessageWriter().putPath(path).putContent(std::string(options.size, 'l')).getData();
+    }
+
+    if (options.operation == "read")
+    {
+        opcode = OP_READ;
+        return MessageWriter().putPath(path).putUint64(0).putUint32(options.size).getData();
+    }
+
+    if (options.operation == "stat")
+    {
+        opcode = OP_STATFS;
+        return "";
+    }
+
+    throw std::runtime_error("unknown operation " + options.operation);
+}
+
+/**
+ * @brief keep depth requests in flight until all of them were answered.
+ */
+static void runClient(const loadOptions& options, const unsigned int index, clientResult& result)
+{
+    AfsdClient client(options.socketPath);
+    std::string path = "/load" + std::to_string(getpid()) + "_" + std::to_string(index);
+    std::vector<std::chrono::steady_clock::time_point> sentAt(options.depth);
+    uint8_t opcode;
+    std::string payload = buildRequest(options, path, opcode);
+    unsigned int sent = 0;
+
+    client.createFile(path);
+    if (opcode == OP_READ)
+        client.appendContent(path, std::string(options.size, 'r'));
+
+    // requests are sent when the client waits for a reply, so every batch of replies is answered by one write
+    for (; sent < options.requests && sent < options.depth; sent++)
+        sentAt[client.submit(opcode, payload) % options.depth] = std::chrono::steady_clock::now();
+
+    while (client.getInFlight() > 0)
+    {
+        afsdReply reply = client.receive();
+        auto now = std::chrono::steady_clock::now();
+
+        result.requests++;
+        if (reply.status != STATUS_OK)
+            result.errors++;
+        result.bytes += reply.payload.size();
+
+        if (result.requests % 16 == 0)
+            result.latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now - sentAt[reply.id % options.depth]).count());
+
+        if (sent < options.requests)
+        {
+            sentAt[client.submit(opcode, payload) % options.depth] = now;
+            sent++;
+        }
+    }
+
+    client.deleteFile(path);
+}
+
+int main(int argc, char* argv[])
+{
+    loadOptions options = {"", "ping", 4, 16, 100000, 4096};
+    int option;
+
+    while ((option = getopt(argc, argv, "c:d:n:b:o:h")) != -1)
+    {
+        switch (option)
+        {
+        case 'c':
+            options.clients = std::max(1ul, std::stoul(optarg));
+            break;
+        case 'd':
+            options.depth = std::max(1ul, std::stoul(optarg));
+            break;
+        case 'n':
+            options.requests = std::stoul(optarg);
+            break;
+        case 'b':
+            options.size = std::stoul(optarg);
+            break;
+        case 'o':
+            options.operation = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    options.socketPath = argv[optind];
+
+    std::vector<clientResult> results(options.clients);
+    std::vector<std::thread> threads;
+    std::atomic<bool> failed(false);
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < options.clients; i++)
+    {
+        threads.emplace_back([&, i]()
+        {
+            try
+            {
+                runClient(options, i, results[i]);
+            }
+            catch (std::exception& e)
+            {
+                std::cerr << argv[0] << ": " << e.what() << std::endl;
+                failed = true;
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    uint64_t requests = 0, errors = 0, bytes = 0;
+    std::vector<uint32_t> latencies;
+
+    for (const clientResult& result : results)
+    {
+        requests += result.requests;
+        errors += result.errors;
+        bytes += result.bytes;
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << std::fixed << std::setprecision(0) << requests << " " << options.operation << " requests, "
+              << options.clients << " clients, depth " << options.depth << ": " << requests / elapsed.count() << " requests/s";
+
+    if (options.operation == "append")
+        std::cout << ", " << std::setprecision(1) << requests * options.size / elapsed.count() / (1 << 20) << " MB/s written";
+    else if (options.operation == "read")
+        std::cout << ", " << std::setprecision(1) << bytes / elapsed.count() / (1 << 20) << " MB/s read";
+
+    std::cout << std::endl;
+
+    if (!latencies.empty())
+        std::cout << "latency p50 " << latencies[latencies.size() / 2] << "us, p99 " << latencies[latencies.size() * 99 / 100]
+                  << "us, max " << latencies.back() << "us" << std::endl;
+
+    if (errors > 0)
+        std::cout << errors << " requests failed" << std::endl;
+
+    return failed || errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+#include <afs/fs.h>
+#include <afs/stripeSet.h>
+#include <afs/helper.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <unistd.h>
+
+static void usage(const char* program)
+{
+    std::cerr << "usage: " << program << " -s MB [-u KB] [-b bytes] <member>..." << std::endl
+              << "  -s  size of the volume" << std::endl
+              << "  -u  stripe unit, bytes on a member before the next one (default: 4096)" << std::endl
+              << "  -b  block size (default: 4096)" << std::endl
+              << "  the volume is opened by the path of any of its members" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t volumeSize = 0;
+    uint32_t stripeUnit = 4 << 20, blockSize = 4096;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:u:b:h")) != -1)
+    {
+        switch (option)
+        {
+        case 's':
+            volumeSize = std::stoull(optarg) << 20;
+            break;
+        case 'u':
+            stripeUnit = std::stoul(optarg) << 10;
+            break;
+        case 'b':
+            blockSize = std::stoul(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc || volumeSize == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> members(argv + optind, argv + argc);
+
+    try
+    {
+        uint64_t nblocks = volumeSize / Helper::getCorrectSize(blockSize);
+
+        if (nblocks > UINT32_MAX)
+            throw std::runtime_error("the volume has too many blocks, use bigger blocks");
+
+        StripeSet::create(members, stripeUnit, nblocks * Helper::getCorrectSize(blockSize));
+        FileSystem fs(members[0].c_str(), blockSize, nblocks);
+
+        std::cout << members[0] << ": " << nblocks << " blocks of " << fs.statfs().blockSize << " bytes striped over "
+                  << members.size() << " members in units of " << (stripeUnit >> 10) << " KB" << std::endl;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -2,17 +2,39 @@
 #include <afshell/colors.h>
 
 #include <iomanip> // for setw
+#include <fstream>
 #include <stdexcept>
 #include <iostream>
 #include <limits>
+#include <algorithm>
+#include <ctime>
+#include <mutex>
+#include <unordered_map>
+
+#include <fnmatch.h>
+
+constexpr uint32_t TRANSFER_CHUNK = 1 << 20; // a multiple of every block size, so only the last chunk leaves a tail
 
 handlers CommandHandlers::handlersMap = {
     {"ls",    CommandHandlers::listFiles},
     {"rm",    CommandHandlers::removeFile},
+    {"mv",    CommandHandlers::moveFile},
+    {"cp",    CommandHandlers::copyFile},
+    {"truncate", CommandHandlers::truncateFile},
+    {"punch", CommandHandlers::punchHole},
     {"cat",   CommandHandlers::showContent},
+    {"put",   CommandHandlers::importFile},
+    {"get",   CommandHandlers::exportFile},
     {"edit",  CommandHandlers::addContent},
     {"touch", CommandHandlers::createFile},
-    {"mkdir", CommandHandlers::createDirectory}
+    {"mkdir", CommandHandlers::createDirectory},
+    {"compress", CommandHandlers::setCompression},
+    {"dedup", CommandHandlers::setDedup},
+    {"scrub", CommandHandlers::scrub},
+    {"df",    CommandHandlers::showFreeSpace},
+    {"find",  CommandHandlers::findFiles},
+    {"du",    CommandHandlers::showUsage},
+    {"snapshot", CommandHandlers::snapshot}
 };
 
 void CommandHandlers::handleCommand(FileSystem* fs, const std::string& cmd, args argv)
@@ -42,6 +64,104 @@ void CommandHandlers::removeFile(FileSystem* fs, args argv)
     fs->deleteFile(argv[0]);
 }
 
+void CommandHandlers::moveFile(FileSystem* fs, args argv)
+{
+    if (argv.size() < 2)
+        throw std::runtime_error("Usage: mv <source> <target>");
+
+    fs->rename(argv[0], argv[1]);
+}
+
+void CommandHandlers::copyFile(FileSystem* fs, args argv)
+{
+    if (argv.size() < 2)
+        throw std::runtime_error("Usage: cp <source> <target>");
+
+    fs->clone(argv[0], argv[1]);
+}
+
+void CommandHandlers::truncateFile(FileSystem* fs, args argv)
+{
+    if (argv.size() < 2)
+        throw std::runtime_error("Usage: truncate <file> <size>");
+
+    fs->truncate(argv[0], std::stoul(argv[1]));
+}
+
+void CommandHandlers::punchHole(FileSystem* fs, args argv)
+{
+    if (argv.size() < 3)
+        throw std::runtime_error("Usage: punch <file> <offset> <length>");
+
+    fs->punchHole(argv[0], std::stoul(argv[1]), std::stoul(argv[2]));
+}
+
+/**
+ * @brief copy a host file into the disk a chunk at a time, replacing the content of the target.
+ */
+void CommandHandlers::importFile(FileSystem* fs, args argv)
+{
+    if (argv.size() < 2)
+        throw std::runtime_error("Usage: put <host file|-> <target>");
+
+    std::ifstream hostFile;
+    std::istream& input = argv[0] == "-" ? std::cin : hostFile;
+    std::string chunk(TRANSFER_CHUNK, '\0');
+
+    if (argv[0] != "-")
+    {
+        hostFile.open(argv[0], std::ios::binary);
+        if (!hostFile)
+            throw std::runtime_error("could not open " + argv[0]);
+    }
+
+    try
+    {
+        fs->truncate(argv[1], 0);
+    }
+    catch (const std::exception&)
+    {
+        fs->createFile(argv[1]);
+    }
+
+    while (input.read(&chunk[0], chunk.size()) || input.gcount() > 0)
+        fs->appendContent(argv[1], chunk.substr(0, input.gcount()));
+
+    if (input.bad())
+        throw std::runtime_error("could not read " + argv[0]);
+}
+
+/**
+ * @brief copy a file of the disk to a host file a chunk at a time.
+ */
+void CommandHandlers::exportFile(FileSystem* fs, args argv)
+{
+    if (argv.size() < 2)
+        throw std::runtime_error("Usage: get <file> <host file|->");
+
+    std::ofstream hostFile;
+    std::ostream& output = argv[1] == "-" ? std::cout : hostFile;
+    std::string chunk;
+    uint64_t offset = 0;
+
+    if (argv[1] != "-")
+    {
+        hostFile.open(argv[1], std::ios::binary | std::ios::trunc);
+        if (!hostFile)
+            throw std::runtime_error("could not create " + argv[1]);
+    }
+
+    do
+    {
+        chunk = fs->readContent(argv[0], offset, TRANSFER_CHUNK);
+        output.write(chunk.data(), chunk.size());
+        offset += chunk.size();
+    } while (chunk.size() == TRANSFER_CHUNK);
+
+    if (!output.flush())
+        throw std::runtime_error("could not write " + argv[1]);
+}
+
 void CommandHandlers::createDirectory(FileSystem* fs, args argv)
 {
     if (argv.empty())
@@ -50,6 +170,207 @@ void CommandHandlers::createDirectory(FileSystem* fs, args argv)
     fs->createFile(argv[0], true);
 }
 
+void CommandHandlers::setCompression(FileSystem* fs, args argv)
+{
+    if (argv.empty())
+        throw std::runtime_error("File name was not provided!");
+
+    if (argv.size() > 1 && argv[1] != "on" && argv[1] != "off")
+        throw std::runtime_error("Usage: compress <path> [on|off]");
+
+    fs->setCompression(argv[0], argv.size() == 1 || argv[1] == "on");
+}
+
+void CommandHandlers::setDedup(FileSystem* fs, args argv)
+{
+    if (argv.empty() || (argv[0] != "on" && argv[0] != "off"))
+        throw std::runtime_error("Usage: dedup <on|off>");
+
+    fs->setDedup(argv[0] == "on");
+}
+
+void CommandHandlers::scrub(FileSystem* fs, args argv)
+{
+    if (argv.empty())
+        throw std::runtime_error("Usage: scrub <start [KB per second]|stop|status>");
+
+    if (argv[0] == "start")
+        fs->startScrubber(argv.size() > 1 ? std::stoull(argv[1]) * 1024 : 0);
+
+    else if (argv[0] == "stop")
+        fs->stopScrubber();
+
+    else if (argv[0] == "status")
+    {
+        scrubStatus status = fs->getScrubStatus();
+
+        std::cout << "passes: " << status.passes << ", blocks checked: " << status.blocksChecked << "\n";
+
+        for (uint32_t blockNum : status.badBlocks)
+            std::cout << red << "checksum mismatch in block " << blockNum << reset << "\n";
+    }
+
+    else
+        throw std::runtime_error("Usage: scrub <start [KB per second]|stop|status>");
+}
+
+void CommandHandlers::snapshot(FileSystem* fs, args argv)
+{
+    if (argv.empty())
+        throw std::runtime_error("Usage: snapshot <list|create <name>|delete <name>|cat <name> <file>>");
+
+    if (argv[0] == "list")
+    {
+        for (const snapshotInfo& info : fs->listSnapshots())
+        {
+            char created[32];
+            time_t createdAt = info.createdAt;
+
+            strftime(created, sizeof(created), "%Y-%m-%d %H:%M:%S", localtime(&createdAt));
+            std::cout << (info.deleted ? red : cyan) << std::setw(NAME_MAX_LEN + 2) << std::left << info.name << reset
+                      << created << "  " << info.blocks << " blocks" << (info.deleted ? " (deleting)" : "") << "\n";
+        }
+    }
+
+    else if (argv[0] == "create" && argv.size() > 1)
+        fs->createSnapshot(argv[1]);
+
+    else if (argv[0] == "delete" && argv.size() > 1)
+        fs->deleteSnapshot(argv[1]);
+
+    else if (argv[0] == "cat" && argv.size() > 2)
+        std::cout << fs->openSnapshot(argv[1])->getContent(argv[2]) << "\n";
+
+    else
+        throw std::runtime_error("Usage: snapshot <list|create <name>|delete <name>|cat <name> <file>>");
+}
+
+void CommandHandlers::showFreeSpace(FileSystem* fs, args argv)
+{
+    fsStats stats = fs->statfs();
+    uint32_t usedBlocks = stats.totalBlocks - stats.freeBlocks, usedInodes = stats.totalInodes - stats.freeInodes;
+
+    std::cout << cyan << std::setw(10) << std::left << "" << std::setw(12) << "total" << std::setw(12) << "used"
+              << std::setw(12) << "free" << "use%" << reset << "\n";
+
+    std::cout << std::setw(10) << std::left << "blocks" << std::setw(12) << stats.totalBlocks << std::setw(12) << usedBlocks
+              << std::setw(12) << stats.freeBlocks << (uint64_t)usedBlocks * 100 / std::max(stats.totalBlocks, 1u) << "%\n";
+
+    std::cout << std::setw(10) << std::left << "inodes" << std::setw(12) << stats.totalInodes << std::setw(12) << usedInodes
+              << std::setw(12) << stats.freeInodes << (uint64_t)usedInodes * 100 / std::max(stats.totalInodes, 1u) << "%\n";
+
+    std::cout << "block size: " << stats.blockSize << " bytes, free space: "
+              << (uint64_t)stats.freeBlocks * stats.blockSize / 1024 << " KB\n";
+}
+
+void CommandHandlers::findFiles(FileSystem* fs, args argv)
+{
+    std::string usage = "Usage: find <directory> [-name <pattern>] [-type f|d] [-maxdepth <depth>]";
+    std::string pattern = "*";
+    char type = 0;
+    walkOptions options;
+
+    if (argv.empty())
+        throw std::runtime_error(usage);
+
+    for (size_t i = 1; i < argv.size(); i += 2)
+    {
+        if (i + 1 >= argv.size())
+            throw std::runtime_error(usage);
+
+        if (argv[i] == "-name")
+            pattern = argv[i + 1];
+        else if (argv[i] == "-type" && (argv[i + 1] == "f" || argv[i + 1] == "d"))
+            type = argv[i + 1][0];
+        else if (argv[i] == "-maxdepth")
+            options.maxDepth = std::stoul(argv[i + 1]);
+        else
+            throw std::runtime_error(usage);
+    }
+
+    std::vector<std::string> found;
+    std::mutex foundLock;
+
+    fs->walk(argv[0], [&](const walkEntry& entry)
+    {
+        std::string name = entry.path.substr(entry.path.find_last_of('/') + 1);
+        bool isDir = entry.node.flags & DIRTYPE;
+
+        if ((type == 0 || (type == 'd') == isDir) && fnmatch(pattern.c_str(), name.c_str(), 0) == 0)
+        {
+            std::lock_guard<std::mutex> lock(foundLock);
+            found.push_back(entry.path);
+        }
+
+        return true;
+    }, options);
+
+    std::sort(found.begin(), found.end());
+
+    for (const std::string& path : found)
+        std::cout << path << "\n";
+}
+
+void CommandHandlers::showUsage(FileSystem* fs, args argv)
+{
+    struct dirUsage
+    {
+        std::string path;
+        uint32_t parentIndex;
+        uint32_t depth;
+        uint64_t bytes;
+    };
+
+    bool summarize = !argv.empty() && argv[0] == "-s";
+    std::string root = argv.size() > (size_t)summarize ? argv[summarize] : "/";
+    std::unordered_map<uint32_t, dirUsage> dirs;
+    std::mutex dirsLock;
+    walkOptions options;
+
+    options.countBlocks = true;
+
+    // every entry adds to its own directory, the directories are then added to their parents deepest first
+    fs->walk(root, [&](const walkEntry& entry)
+    {
+        std::lock_guard<std::mutex> lock(dirsLock);
+
+        if ((entry.node.flags & DIRTYPE) || entry.depth == 0)
+        {
+            dirUsage& usage = dirs[entry.inodeIndex];
+
+            usage.path = entry.path;
+            usage.parentIndex = entry.parentIndex;
+            usage.depth = entry.depth;
+            usage.bytes += entry.allocatedBytes;
+        }
+        else
+            dirs[entry.parentIndex].bytes += entry.allocatedBytes;
+
+        return true;
+    }, options);
+
+    std::vector<dirUsage*> order;
+
+    for (auto& dir : dirs)
+        order.push_back(&dir.second);
+
+    std::sort(order.begin(), order.end(), [](const dirUsage* a, const dirUsage* b) { return a->depth > b->depth; });
+
+    for (dirUsage* dir : order)
+    {
+        if (dir->depth > 0)
+            dirs[dir->parentIndex].bytes += dir->bytes;
+    }
+
+    std::sort(order.begin(), order.end(), [](const dirUsage* a, const dirUsage* b) { return a->path < b->path; });
+
+    for (dirUsage* dir : order)
+    {
+        if (!summarize || dir->depth == 0)
+            std::cout << std::setw(10) << std::left << (dir->bytes + 1023) / 1024 << dir->path << "\n";
+    }
+}
+
 void CommandHandlers::addContent(FileSystem* fs, args argv)
 {
     std::string content = "", line;
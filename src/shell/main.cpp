@@ -5,7 +5,5 @@ int main(int argc, char* argv[])
 {
     Shell shell(argc, argv);
 
-    shell.interactiveShell();
-
-    return 0;
+    return shell.run();
 }
\ No newline at end of file
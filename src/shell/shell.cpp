@@ -3,19 +3,53 @@
 
 #include <iostream>
 #include <sstream>
+#include <fstream>
+
+#include <unistd.h>
+
+static void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [-r] [-c <commands> | -f <script>] <disk name> [<block size> <blocks amount>]" << std::endl
+              << "  -c  run commands separated by ';' or new lines and exit" << std::endl
+              << "  -f  run the commands of a script file ('-' for the standard input) and exit" << std::endl
+              << "  -r  mount the disk read-only, other processes may have it mounted too" << std::endl;
+    exit(1);
+}
 
 Shell::Shell(int argc, char* argv[])
 {
-    if (argc < 2 || (argc > 2 && argc < 4))
+    int option;
+    bool readOnly = false;
+
+    while ((option = getopt(argc, argv, "c:f:rh")) != -1)
     {
-        std::cerr << "Usage: " << argv[0] << " <disk name> [<block size> <blocks amount>]" << std::endl;
-        exit(1);
+        switch (option)
+        {
+        case 'c':
+            m_commands = optarg;
+            break;
+        case 'f':
+            m_scriptPath = optarg;
+            break;
+        case 'r':
+            readOnly = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
     }
+
+    int positional = argc - optind;
+
+    if ((positional != 1 && positional != 3) || (!m_commands.empty() && !m_scriptPath.empty()) || (readOnly && positional != 1))
+        usage(argv[0]);
     
-    if (argc == 2)
-        m_fs = new FileSystem(argv[1]);
-    else if (argc == 4)
-        m_fs = new FileSystem(argv[1], std::stoi(argv[2]), std::stoi(argv[3]));
+    if (readOnly)
+        m_fs = new FileSystem(argv[optind], OPEN_READ_ONLY);
+    else if (positional == 1)
+        m_fs = new FileSystem(argv[optind]);
+    else
+        m_fs = new FileSystem(argv[optind], std::stoi(argv[optind + 1]), std::stoi(argv[optind + 2]));
 }
 
 Shell::~Shell()
@@ -35,11 +69,24 @@ command Shell::parseCommand(const std::string& cmd)
 
     while (std::getline(ss, part, ' '))
     {
+        if (part.empty())
+            continue;
+
         if (part[0] == '"' || part[0] == '\'')
         {
+            char quote = part[0];
+
             multipleWordParam = part.substr(1);
-            std::getline(ss, part, part[0]);
-            multipleWordParam += " " + part;
+
+            // a quoted single word ends with its quote
+            if (!multipleWordParam.empty() && multipleWordParam.back() == quote)
+                multipleWordParam.pop_back();
+            else
+            {
+                std::getline(ss, part, quote);
+                multipleWordParam += " " + part;
+            }
+
             ans.push_back(multipleWordParam);
         }
         else
@@ -64,7 +111,9 @@ void Shell::interactiveShell()
     do
     {
         std::cout << ">>> ";
-        std::getline(std::cin >> std::ws, cmd);
+        if (!std::getline(std::cin >> std::ws, cmd))
+            break;
+
         command parsedCmd = parseCommand(cmd);
         
         try
@@ -77,4 +126,96 @@ void Shell::interactiveShell()
         }
         
     } while (cmd != "EXIT" && cmd != "exit");
-}
\ No newline at end of file
+}
+
+/**
+ * @brief run the commands given with -c or -f, or the interactive shell if none were given.
+ *
+ * @return int the exit code of the program.
+ */
+int Shell::run()
+{
+    if (!m_commands.empty())
+    {
+        std::string script;
+        char quote = 0;
+
+        // ';' separates commands outside of quotes
+        for (char c : m_commands)
+        {
+            if (quote == 0 && (c == '"' || c == '\''))
+                quote = c;
+            else if (c == quote)
+                quote = 0;
+
+            script += (c == ';' && quote == 0) ? '\n' : c;
+        }
+
+        std::istringstream input(script);
+        return runScript(input, "-c");
+    }
+
+    if (m_scriptPath == "-")
+        return runScript(std::cin, "stdin");
+
+    if (!m_scriptPath.empty())
+    {
+        std::ifstream input(m_scriptPath);
+
+        if (!input)
+        {
+            std::cerr << m_scriptPath << ": could not open the script" << std::endl;
+            return 1;
+        }
+
+        return runScript(input, m_scriptPath);
+    }
+
+    interactiveShell();
+    return 0;
+}
+
+/**
+ * @brief run commands line by line without a prompt, stopping at the first one that fails.
+ *        Empty lines and lines starting with '#' are skipped.
+ *
+ * @param input the commands.
+ * @param source the name of the commands in error messages.
+ * @return int 0 if all the commands succeeded, 1 otherwise.
+ */
+int Shell::runScript(std::istream& input, const std::string& source)
+{
+    std::string line;
+    size_t lineNumber = 0;
+
+    while (std::getline(input, line))
+    {
+        lineNumber++;
+
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#')
+            continue;
+
+        command parsedCmd = parseCommand(line.substr(start));
+
+        if (parsedCmd.empty())
+            continue;
+
+        if (parsedCmd[0] == "exit" || parsedCmd[0] == "EXIT")
+            break;
+
+        try
+        {
+            handleCommand(parsedCmd);
+        }
+        catch (const std::exception& e)
+        {
+            std::cout.flush();
+            std::cerr << source << ":" << lineNumber << ": " << parsedCmd[0] << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout.flush();
+    return 0;
+}